@@ -0,0 +1,232 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clinica.h"
+
+// Microbenchmark da libclinica: chama a API direto, numa sessao so em memoria
+// (nada e lido nem gravado na pasta atual), sobre uma base sintetica.
+//
+// Uso: clinica_bench [--consultas N] [--semente S] [--metricas]
+
+#ifdef _WIN32
+#define ARQ_NULO "NUL"
+#else
+#define ARQ_NULO "/dev/null"
+#endif
+
+#define BENCH_CONSULTAS 200000
+#define BENCH_BUSCAS 1000000
+#define BENCH_LISTAGENS 20
+
+// ======== Utilidades ========
+static int ler_inteiro(const char *s, int *v)
+{
+    char *fim;
+    long x = strtol(s, &fim, 10);
+    if (fim == s || *fim != '\0' || x < INT_MIN || x > INT_MAX)
+        return 0;
+    *v = (int)x;
+    return 1;
+}
+
+// xorshift32: sequencia de chaves reproduzivel e barata
+static unsigned g_sorteio = 2463534242u;
+
+static int sortear(int n)
+{
+    g_sorteio ^= g_sorteio << 13;
+    g_sorteio ^= g_sorteio >> 17;
+    g_sorteio ^= g_sorteio << 5;
+    return (int)(g_sorteio % (unsigned)n);
+}
+
+static void linha_resultado(const char *operacao, int chamadas, double segundos, int falhas)
+{
+    double us = chamadas ? segundos * 1e6 / chamadas : 0;
+    double porSeg = segundos > 0 ? chamadas / segundos : 0;
+    printf("%-24s %10d %10.1f %12.3f %14.0f", operacao, chamadas, segundos * 1000, us, porSeg);
+    if (falhas)
+        printf("   (%d falha(s))", falhas);
+    printf("\n");
+}
+
+// ======== Cadastros ========
+static void bench_buscas(int nCons, int nAnimais)
+{
+    Consulta c;
+    Animal a;
+    int falhas = 0;
+    double t = clinica_segundos();
+    for (int i = 0; i < BENCH_BUSCAS; i++)
+        if (clinica_buscar_consulta(1 + sortear(nCons), &c) != CLINICA_OK)
+            falhas++;
+    linha_resultado("buscar_consulta", BENCH_BUSCAS, clinica_segundos() - t, falhas);
+
+    falhas = 0;
+    t = clinica_segundos();
+    for (int i = 0; i < BENCH_BUSCAS; i++)
+        if (clinica_buscar_animal(1 + sortear(nAnimais), &a) != CLINICA_OK)
+            falhas++;
+    linha_resultado("buscar_animal", BENCH_BUSCAS, clinica_segundos() - t, falhas);
+}
+
+// Inclui, altera e exclui 'n' consultas novas, ligadas a chaves que existem
+static void bench_alteracoes(int n, int nCons)
+{
+    Consulta *novas = (Consulta *)malloc((size_t)n * sizeof(Consulta));
+    if (!novas)
+    {
+        printf("Erro de memoria.\n");
+        return;
+    }
+    for (int i = 0; i < n; i++)
+        clinica_buscar_consulta(1 + sortear(nCons), &novas[i]);
+
+    int falhas = 0;
+    double t = clinica_segundos();
+    for (int i = 0; i < n; i++)
+        if (clinica_incluir_consulta(&novas[i]) != CLINICA_OK)
+            falhas++;
+    linha_resultado("incluir_consulta", n, clinica_segundos() - t, falhas);
+
+    falhas = 0;
+    t = clinica_segundos();
+    for (int i = 0; i < n; i++)
+    {
+        novas[i].valor += 10;
+        if (clinica_alterar_consulta(&novas[i]) != CLINICA_OK)
+            falhas++;
+    }
+    linha_resultado("alterar_consulta valor", n, clinica_segundos() - t, falhas);
+
+    // Troca de data mexe no indice por data e nos agregados por mes
+    falhas = 0;
+    t = clinica_segundos();
+    for (int i = 0; i < n; i++)
+    {
+        int dia = 10 + i % 18; // 10..27 existe em qualquer mes
+        novas[i].dataConsulta[0] = (char)('0' + dia / 10);
+        novas[i].dataConsulta[1] = (char)('0' + dia % 10);
+        if (clinica_alterar_consulta(&novas[i]) != CLINICA_OK)
+            falhas++;
+    }
+    linha_resultado("alterar_consulta data", n, clinica_segundos() - t, falhas);
+
+    falhas = 0;
+    t = clinica_segundos();
+    for (int i = 0; i < n; i++)
+        if (clinica_excluir_consulta(novas[i].idConsulta) != CLINICA_OK)
+            falhas++;
+    linha_resultado("excluir_consulta", n, clinica_segundos() - t, falhas);
+    free(novas);
+}
+
+// ======== Listagens e estatisticas ========
+static void bench_listagem(FILE *nulo, const char *nome, const FiltroConsultas *filtro)
+{
+    int falhas = 0;
+    double t = clinica_segundos();
+    for (int i = 0; i < BENCH_LISTAGENS; i++)
+        if (clinica_listar_consultas(nulo, filtro) < 0)
+            falhas++;
+    linha_resultado(nome, BENCH_LISTAGENS, clinica_segundos() - t, falhas);
+}
+
+static void bench_listagens(int nAnimais)
+{
+    FILE *nulo = fopen(ARQ_NULO, "w");
+    if (!nulo)
+    {
+        printf("Nao foi possivel abrir " ARQ_NULO ".\n");
+        return;
+    }
+    Veterinario v;
+    int crm = 0;
+    for (int i = 0; i < 100000 && !crm; i++) // primeiro CRM cadastrado
+        if (clinica_buscar_vet(i, &v) == CLINICA_OK)
+            crm = i;
+
+    FiltroConsultas f = {CLINICA_TODAS, NULL, NULL, 0, 0, 0, NULL};
+    bench_listagem(nulo, "listar todas", &f);
+    f.tipo = CLINICA_PERIODO;
+    f.data = "01/01/2023";
+    f.dataFim = "31/01/2023";
+    bench_listagem(nulo, "listar periodo (1 mes)", &f);
+    f.tipo = CLINICA_VALOR;
+    f.valorMin = 100;
+    f.valorMax = 150;
+    bench_listagem(nulo, "listar valor 100-150", &f);
+    f.tipo = CLINICA_POR_CRM;
+    f.chave = crm;
+    bench_listagem(nulo, "listar por CRM", &f);
+    f.tipo = CLINICA_POR_ANIMAL;
+    f.chave = 1 + sortear(nAnimais);
+    bench_listagem(nulo, "listar por animal", &f);
+    f.tipo = CLINICA_POR_ESPECIE;
+    f.especie = "Gato";
+    bench_listagem(nulo, "listar por especie", &f);
+
+    static const char *nomes[] = {"estatisticas vet", "estatisticas especie", "estatisticas mes"};
+    for (int tipo = CLINICA_EST_VET; tipo <= CLINICA_EST_MES; tipo++)
+    {
+        int falhas = 0;
+        double t = clinica_segundos();
+        for (int i = 0; i < BENCH_LISTAGENS; i++)
+            if (clinica_estatisticas(nulo, tipo) != CLINICA_OK)
+                falhas++;
+        linha_resultado(nomes[tipo], BENCH_LISTAGENS, clinica_segundos() - t, falhas);
+    }
+    fclose(nulo);
+}
+
+// ======== Principal ========
+int main(int argc, char **argv)
+{
+    int nCons = BENCH_CONSULTAS, semente = 1, metricas = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--consultas") == 0 && i + 1 < argc && ler_inteiro(argv[i + 1], &nCons) && nCons > 0)
+            i++;
+        else if (strcmp(argv[i], "--semente") == 0 && i + 1 < argc && ler_inteiro(argv[i + 1], &semente))
+            i++;
+        else if (strcmp(argv[i], "--metricas") == 0)
+            metricas = 1;
+        else
+        {
+            fprintf(stderr, "Uso: %s [--consultas N] [--semente S] [--metricas]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    OpcoesClinica opcoes = {0, 0, 1, NULL, 0};
+    clinica_definir_avisos(stderr);
+    if (clinica_abrir(&opcoes) != CLINICA_OK)
+        return 1;
+    int nAnimais = nCons / 10 > 10 ? nCons / 10 : 10;
+    int nVets = nCons / 5000 > 10 ? nCons / 5000 : 10;
+    int r = clinica_gerar(nCons, nAnimais, nVets, semente, 0);
+    if (r != CLINICA_OK)
+    {
+        fprintf(stderr, "Falha ao gerar a base: %s.\n", clinica_erro(r));
+        clinica_fechar();
+        return 1;
+    }
+    g_sorteio += (unsigned)semente;
+
+    printf("Base: %d consultas, %d animais, %d veterinarios (so em memoria)\n\n", nCons, nAnimais, nVets);
+    printf("%-24s %10s %10s %12s %14s\n", "operacao", "chamadas", "total ms", "us/chamada", "chamadas/s");
+    printf("--------------------------------------------------------------------------\n");
+    bench_buscas(nCons, nAnimais);
+    bench_alteracoes(nCons / 10 > 1000 ? nCons / 10 : 1000, nCons);
+    bench_listagens(nAnimais);
+
+    if (metricas)
+    {
+        printf("\n");
+        clinica_metricas(stdout);
+    }
+    clinica_fechar();
+    return 0;
+}
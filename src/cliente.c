@@ -0,0 +1,439 @@
+#include "clinica.h"
+#include "protocolo.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if !defined(_WIN32)
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Cliente do servidor (clinica --servidor): a mesma API de clinica.h, mas cada
+// chamada vira um pedido pelo socket Unix. Ligado aos menus de main.c forma o
+// clinica_cliente. Gravar no disco e com o servidor, que confirma cada
+// alteracao no log antes de responder: sincronizar, confirmar e consolidar
+// nao tem o que fazer aqui. Cargas, exportacao e bench so no programa local.
+
+static int g_fd = -1;
+static const char *g_caminho = CLINICA_SOCKET_PADRAO;
+static Quadro g_pedido, g_resposta;
+static FILE *g_avisos = NULL;
+static int g_avisosDefinidos = 0; // 0 = saida padrao
+
+// ======== Conexao ========
+static int desconectar()
+{
+    if (g_fd >= 0)
+    {
+        fprintf(stderr, "Conexao com o servidor em %s perdida.\n", g_caminho);
+#if !defined(_WIN32)
+        close(g_fd);
+#endif
+    }
+    g_fd = -1;
+    return CLINICA_ERRO_CONEXAO;
+}
+
+static Quadro *pedido(int op)
+{
+    quadro_iniciar(&g_pedido, op);
+    return &g_pedido;
+}
+
+// Manda o pedido montado e le a resposta: o texto vai para 'saida' (ou para os
+// avisos) e os resultados ficam em g_resposta. Devolve o codigo da chamada.
+static int chamar(FILE *saida)
+{
+    if (g_fd < 0)
+        return CLINICA_ERRO_CONEXAO;
+    if (g_pedido.erro)
+        return CLINICA_ERRO_MEMORIA;
+    if (!quadro_enviar(g_fd, &g_pedido))
+        return desconectar();
+    for (;;)
+    {
+        if (quadro_receber(g_fd, &g_resposta) != 1)
+            return desconectar();
+        int tipo = quadro_tipo(&g_resposta);
+        if (tipo == RESP_FIM)
+            return quadro_ler_int(&g_resposta);
+        size_t k;
+        const void *p = quadro_ler_resto(&g_resposta, &k);
+        FILE *f = tipo == RESP_SAIDA ? saida : g_avisosDefinidos ? g_avisos : stdout;
+        if (f)
+            fwrite(p, 1, k, f);
+    }
+}
+
+static int indisponivel(const char *o_que)
+{
+    fprintf(stderr, "%s: so no programa local (clinica), nao pelo servidor.\n", o_que);
+    return CLINICA_INVALIDO;
+}
+
+// ======== Sessao ========
+int clinica_abrir(const OpcoesClinica *op)
+{
+#if !defined(_WIN32)
+    struct sockaddr_un end;
+    if (g_fd >= 0)
+        return CLINICA_INVALIDO; // uma sessao aberta por vez
+    g_caminho = op && op->servidor ? op->servidor : CLINICA_SOCKET_PADRAO;
+    memset(&end, 0, sizeof(end));
+    end.sun_family = AF_UNIX;
+    if (strlen(g_caminho) >= sizeof(end.sun_path))
+    {
+        fprintf(stderr, "Caminho do socket longo demais: %s\n", g_caminho);
+        return CLINICA_INVALIDO;
+    }
+    memcpy(end.sun_path, g_caminho, strlen(g_caminho) + 1);
+    signal(SIGPIPE, SIG_IGN); // servidor que caiu vira erro de envio
+
+    g_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (g_fd < 0 || connect(g_fd, (struct sockaddr *)&end, sizeof(end)) != 0)
+    {
+        fprintf(stderr, "Nao foi possivel conectar ao servidor em %s (clinica --servidor).\n", g_caminho);
+        if (g_fd >= 0)
+            close(g_fd);
+        g_fd = -1;
+        return CLINICA_ERRO_CONEXAO;
+    }
+    Quadro *q = pedido(PED_OLA);
+    quadro_int(q, PROTOCOLO_VERSAO);
+    quadro_int(q, (int)sizeof(Animal));
+    quadro_int(q, (int)sizeof(Veterinario));
+    quadro_int(q, (int)sizeof(Consulta));
+    int r = chamar(NULL);
+    if (r != CLINICA_OK)
+    {
+        fprintf(stderr, "O servidor em %s recusou a conexao (%s).\n", g_caminho,
+                r == CLINICA_INVALIDO ? "versao diferente" : clinica_erro(r));
+        clinica_fechar();
+    }
+    return r;
+#else
+    (void)op;
+    fprintf(stderr, "Cliente indisponivel nesta plataforma (sem socket Unix).\n");
+    return CLINICA_ERRO_CONEXAO;
+#endif
+}
+
+void clinica_fechar(void)
+{
+#if !defined(_WIN32)
+    if (g_fd >= 0)
+        close(g_fd);
+#endif
+    g_fd = -1;
+    quadro_liberar(&g_pedido);
+    quadro_liberar(&g_resposta);
+}
+
+void clinica_definir_avisos(FILE *f)
+{
+    g_avisos = f;
+    g_avisosDefinidos = 1;
+}
+
+int clinica_data(const char *data)
+{
+    quadro_texto(pedido(PED_DATA), data);
+    return chamar(NULL);
+}
+
+void clinica_totais(int *animais, int *vets, int *consultas)
+{
+    pedido(PED_TOTAIS);
+    int ok = chamar(NULL) == CLINICA_OK;
+    int a = quadro_ler_int(&g_resposta), v = quadro_ler_int(&g_resposta), c = quadro_ler_int(&g_resposta);
+    if (animais)
+        *animais = ok ? a : 0;
+    if (vets)
+        *vets = ok ? v : 0;
+    if (consultas)
+        *consultas = ok ? c : 0;
+}
+
+double clinica_segundos(void)
+{
+#ifdef _WIN32
+    return (double)clock() / CLOCKS_PER_SEC;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+// ======== Cadastros ========
+// Pedido so com uma chave
+static int chamar_chave(int op, int chave)
+{
+    quadro_int(pedido(op), chave);
+    return chamar(NULL);
+}
+
+int clinica_incluir_animal(Animal *a)
+{
+    quadro_animal(pedido(PED_INCLUIR_ANIMAL), a);
+    int r = chamar(NULL);
+    if (r == CLINICA_OK)
+        quadro_ler_animal(&g_resposta, a);
+    return r;
+}
+
+int clinica_buscar_animal(int id, Animal *a)
+{
+    int r = chamar_chave(PED_BUSCAR_ANIMAL, id);
+    if (r == CLINICA_OK && a)
+        quadro_ler_animal(&g_resposta, a);
+    return r;
+}
+
+int clinica_alterar_animal(const Animal *a)
+{
+    quadro_animal(pedido(PED_ALTERAR_ANIMAL), a);
+    return chamar(NULL);
+}
+
+int clinica_excluir_animal(int id)
+{
+    return chamar_chave(PED_EXCLUIR_ANIMAL, id);
+}
+
+int clinica_incluir_vet(const Veterinario *v)
+{
+    quadro_vet(pedido(PED_INCLUIR_VET), v);
+    return chamar(NULL);
+}
+
+int clinica_buscar_vet(int crm, Veterinario *v)
+{
+    int r = chamar_chave(PED_BUSCAR_VET, crm);
+    if (r == CLINICA_OK && v)
+        quadro_ler_vet(&g_resposta, v);
+    return r;
+}
+
+int clinica_alterar_vet(const Veterinario *v)
+{
+    quadro_vet(pedido(PED_ALTERAR_VET), v);
+    return chamar(NULL);
+}
+
+int clinica_excluir_vet(int crm)
+{
+    return chamar_chave(PED_EXCLUIR_VET, crm);
+}
+
+int clinica_incluir_consulta(Consulta *c)
+{
+    quadro_consulta(pedido(PED_INCLUIR_CONSULTA), c);
+    int r = chamar(NULL);
+    if (r == CLINICA_OK)
+        quadro_ler_consulta(&g_resposta, c);
+    return r;
+}
+
+int clinica_buscar_consulta(int id, Consulta *c)
+{
+    int r = chamar_chave(PED_BUSCAR_CONSULTA, id);
+    if (r == CLINICA_OK && c)
+        quadro_ler_consulta(&g_resposta, c);
+    return r;
+}
+
+int clinica_alterar_consulta(const Consulta *c)
+{
+    quadro_consulta(pedido(PED_ALTERAR_CONSULTA), c);
+    return chamar(NULL);
+}
+
+int clinica_excluir_consulta(int id)
+{
+    return chamar_chave(PED_EXCLUIR_CONSULTA, id);
+}
+
+int clinica_expurgar_consultas(const char *data)
+{
+    quadro_texto(pedido(PED_EXPURGAR), data);
+    return chamar(NULL);
+}
+
+// ======== Listagens e relatorios ========
+// Nome do arquivo gerado no servidor (na pasta dele)
+static void copiar_arquivo(char *arquivo, size_t tam)
+{
+    const char *nome = quadro_ler_texto(&g_resposta);
+    if (tam > 0)
+        snprintf(arquivo, tam, "%s", nome ? nome : "");
+}
+
+int clinica_listar_animais(FILE *f)
+{
+    pedido(PED_LISTAR_ANIMAIS);
+    return chamar(f);
+}
+
+int clinica_listar_vets(FILE *f)
+{
+    pedido(PED_LISTAR_VETS);
+    return chamar(f);
+}
+
+int clinica_listar_consultas(FILE *f, const FiltroConsultas *filtro)
+{
+    quadro_filtro(pedido(PED_LISTAR_CONSULTAS), filtro);
+    return chamar(f);
+}
+
+int clinica_relatorio_consultas(const FiltroConsultas *filtro, char *arquivo, size_t tam)
+{
+    quadro_filtro(pedido(PED_RELATORIO_CONSULTAS), filtro);
+    int r = chamar(NULL);
+    copiar_arquivo(arquivo, tam);
+    return r;
+}
+
+int clinica_relatorios(const char *lista)
+{
+    quadro_texto(pedido(PED_RELATORIOS), lista);
+    return chamar(NULL);
+}
+
+int clinica_relatorios_todos(void)
+{
+    pedido(PED_RELATORIOS_TODOS);
+    return chamar(NULL);
+}
+
+int clinica_estatisticas(FILE *f, int tipo)
+{
+    quadro_int(pedido(PED_ESTATISTICAS), tipo);
+    return chamar(f);
+}
+
+int clinica_relatorio_estatisticas(char *arquivo, size_t tam)
+{
+    pedido(PED_RELATORIO_ESTATISTICAS);
+    int r = chamar(NULL);
+    copiar_arquivo(arquivo, tam);
+    return r;
+}
+
+// ======== Persistencia ========
+int clinica_sincronizar(void)
+{
+    return g_fd >= 0 ? CLINICA_OK : CLINICA_ERRO_CONEXAO;
+}
+
+int clinica_confirmar(void)
+{
+    return clinica_sincronizar();
+}
+
+int clinica_consolidar(void)
+{
+    return clinica_sincronizar();
+}
+
+int clinica_salvar(void)
+{
+    pedido(PED_SALVAR);
+    return chamar(NULL);
+}
+
+int clinica_checkpoint(void)
+{
+    pedido(PED_CHECKPOINT);
+    return chamar(NULL);
+}
+
+// ======== Cargas, exportacao e bench ========
+int clinica_popular_exemplos(void)
+{
+    pedido(PED_POPULAR_EXEMPLOS);
+    return chamar(NULL);
+}
+
+int clinica_gerar(int consultas, int animais, int vets, int semente, int gravar)
+{
+    (void)consultas;
+    (void)animais;
+    (void)vets;
+    (void)semente;
+    (void)gravar;
+    return indisponivel("--gerar");
+}
+
+int clinica_importar(const char *tipo, const char *arquivo)
+{
+    (void)tipo;
+    (void)arquivo;
+    return indisponivel("--importar");
+}
+
+int clinica_exportar(const char *tipo, const char *formato, const char *arquivo)
+{
+    (void)tipo;
+    (void)formato;
+    (void)arquivo;
+    return indisponivel("--exportar");
+}
+
+int clinica_separar_saida_padrao(void)
+{
+    return indisponivel("--exportar");
+}
+
+int clinica_bench(FILE *f)
+{
+    (void)f;
+    return indisponivel("--bench");
+}
+
+int clinica_servir(void)
+{
+    return indisponivel("--servidor");
+}
+
+// ======== Diagnostico ========
+void clinica_uso_memoria(FILE *f)
+{
+    pedido(PED_USO_MEMORIA);
+    chamar(f);
+}
+
+void clinica_metricas(FILE *f)
+{
+    pedido(PED_METRICAS);
+    chamar(f);
+}
+
+void clinica_histogramas(FILE *f)
+{
+    pedido(PED_HISTOGRAMAS);
+    chamar(f);
+}
+
+// O arquivo fica na pasta do servidor
+int clinica_gravar_metricas(const char *arquivo)
+{
+    quadro_texto(pedido(PED_GRAVAR_METRICAS), arquivo);
+    return chamar(NULL);
+}
+
+void clinica_zerar_metricas(void)
+{
+    pedido(PED_ZERAR_METRICAS);
+    chamar(NULL);
+}
+
+void clinica_falhar_realocacao(int n)
+{
+    (void)n; // so a biblioteca local simula falta de memoria
+}
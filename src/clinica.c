@@ -0,0 +1,7275 @@
+#include "clinica.h"
+#include "protocolo.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+
+// Carga por mmap, fsync, threads, writev e o servidor por socket Unix (POSIX);
+// no Windows os arquivos sao lidos com fread, sincronizados com _commit, a
+// importacao roda numa thread so, a saida bufferizada grava com fwrite e nao
+// ha servidor
+#if !defined(_WIN32)
+#define CLINICA_MMAP 1
+#define CLINICA_THREADS 1
+#define CLINICA_WRITEV 1
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CLINICA_CRC_SSE42 1
+#define CLINICA_FILTRO_X86 1 // filtros SSE4.2/AVX2, escolhidos em tempo de execucao
+#include <nmmintrin.h>
+#include <immintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#define CLINICA_CRC_ARM 1
+#include <arm_acle.h>
+#endif
+
+// Os registros sao usados direto do arquivo, que e little-endian
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#error "formato dos .bin e little-endian; host big-endian nao suportado"
+#endif
+
+#define TABELA_CAP_MIN 8 // capacidade inicial de toda tabela
+#define TABELA_MAX_COLUNAS 8
+#define CHAVE_REMOVIDA INT_MIN // lapide: chave primaria de um registro excluido
+#define ESPECIE_MAX 65535 // ids de especie cabem em unsigned short
+#define PAGINA_TAM 4096   // granularidade das gravacoes parciais dos .bin
+
+#define ARQ_ANIMAIS "animais.bin"
+#define ARQ_VETS "veterinarios.bin"
+#define ARQ_CONS "consultas.bin"
+#define ARQ_WAL "clinica.wal"
+#define ARQ_TRAVA "clinica.trava" // modo compartilhado
+
+// ======== Estruturas ========
+// Layout fixo dos registros nos .bin: qualquer mudanca nas structs de clinica.h
+// (ou um compilador com outro alinhamento) falha aqui, nao na carga
+#define LAYOUT_FIXO(nome, cond) typedef char layout_##nome[(cond) ? 1 : -1]
+LAYOUT_FIXO(animal, offsetof(Animal, idAnimal) == 0 && offsetof(Animal, nome) == 4 &&
+                        offsetof(Animal, especie) == 54 && offsetof(Animal, dataNascimento) == 84 &&
+                        offsetof(Animal, peso) == 96 && sizeof(Animal) == 104);
+LAYOUT_FIXO(veterinario, offsetof(Veterinario, crmVet) == 0 && offsetof(Veterinario, nome) == 4 &&
+                             offsetof(Veterinario, telefone) == 54 && sizeof(Veterinario) == 72);
+LAYOUT_FIXO(consulta, offsetof(Consulta, idConsulta) == 0 && offsetof(Consulta, idAnimal) == 4 &&
+                          offsetof(Consulta, crmVet) == 8 && offsetof(Consulta, dataConsulta) == 12 &&
+                          offsetof(Consulta, valor) == 24 && sizeof(Consulta) == 32);
+LAYOUT_FIXO(double, sizeof(double) == 8);
+
+// Hash de enderecamento aberto (sondagem linear): chave int -> posicao na tabela
+typedef struct
+{
+    int *chaves;
+    int *valores;
+    int cap; // potencia de 2 (0 = ainda nao alocado)
+    int n;
+} IndiceHash;
+
+// Coluna auxiliar: vetor paralelo ao da tabela (um valor derivado por registro)
+typedef struct
+{
+    void **ptr;
+    size_t tam;
+} ColunaAux;
+
+// Vetor dinamico generico usado pelas tres entidades, com indice pela chave primaria
+typedef struct
+{
+    void *dados;
+    int n; // posicoes ocupadas, incluindo lapides
+    int cap;
+    int nRemovidos; // lapides ainda nao compactadas
+    size_t tamElem;
+    size_t offChave; // offsetof do campo int que e chave primaria
+    const char *nome;
+    long alocacoes;          // malloc/realloc efetivamente feitos
+    long long bytesCopiados; // bytes movidos quando o realloc troca o bloco de lugar
+    IndiceHash pk;
+    ColunaAux colunas[TABELA_MAX_COLUNAS]; // crescem e deslocam junto com 'dados'
+    int nColunas;
+    void *mapa;      // != NULL: 'dados' aponta para dentro do arquivo mapeado
+    size_t tamMapa;
+    int sujo;                    // algo mudou desde a ultima gravacao do .bin
+    int nArquivo;                // posicoes [0, nArquivo) estao no .bin como na memoria (-1 = regravar tudo)
+    unsigned char *paginasSujas; // bitmap das paginas de [0, nArquivo) alteradas
+    uint32_t *crcs;              // CRC32C de cada pagina do .bin (capBlocos entradas)
+    int capBlocos;               // entradas reservadas no arquivo para os CRCs
+    long offRegistros;           // onde os registros comecam no .bin
+} Tabela;
+
+// Lista de ids de consulta em ordem crescente (= ordem de cadastro)
+typedef struct
+{
+    int *ids;
+    int n;
+    int cap;
+} ListaIds;
+
+// Indice reverso de chave estrangeira: idAnimal/crmVet -> consultas que o referenciam
+typedef struct
+{
+    IndiceHash mapa; // chave -> posicao em 'listas'
+    ListaIds *listas;
+    int n;
+    int cap;
+} IndiceReverso;
+
+// Indice ordenado por data (AAAAMMDD) e, no empate, por idConsulta
+typedef struct
+{
+    int data;
+    int id;
+} ChaveData;
+
+typedef struct
+{
+    ChaveData *itens;
+    int n;
+    int cap;
+} IndiceData;
+
+// Receita (em centavos, soma exata) e numero de consultas de uma chave
+typedef struct
+{
+    long long centavos;
+    int visitas;
+} Agregado;
+
+// Agregados por chave (CRM, especie, mes), atualizados a cada alteracao
+typedef struct
+{
+    IndiceHash mapa; // chave -> posicao em 'chaves'/'valores'
+    int *chaves;
+    Agregado *valores;
+    int n;
+    int cap;
+} TabelaAgregados;
+
+// Dicionario de especies: cada grafia normalizada vira um id pequeno
+typedef struct
+{
+    char chave[ESPECIE_TAM]; // minusculas, sem acento, espacos simples
+    char nome[ESPECIE_TAM];  // primeira grafia vista, para exibicao
+} Especie;
+
+#define TABELA_INIT(tipo, chave, nome) {NULL, 0, 0, 0, sizeof(tipo), offsetof(tipo, chave), nome, 0, 0, {NULL, NULL, 0, 0}, {{NULL, 0}}, 0, NULL, 0, 0, -1, NULL, NULL, 0, 0}
+
+// Tudo o que as buscas, listagens, relatorios e estatisticas leem. O servidor
+// tira copias dele (estado_copiar) para as leituras longas correrem enquanto
+// as alteracoes seguem no original.
+typedef struct
+{
+    Tabela tabAnimais;
+    Tabela tabVets;
+    Tabela tabCons;
+    IndiceReverso consPorAnimal;
+    IndiceReverso consPorVet;
+    IndiceData consPorData;
+    int *consData; // coluna de tabCons: dataConsulta ja convertida (-1 = invalida)
+    // Demais colunas de tabCons: as varreduras leem so os vetores de que
+    // precisam, sem arrastar o registro inteiro (com o texto da data) pela cache
+    int *consId;     // idConsulta, ou CHAVE_REMOVIDA nas lapides
+    int *consAnimal; // idAnimal
+    int *consCrm;    // crmVet
+    double *consValor;
+
+    Especie *especies;
+    int nEspecies;
+    int capEspecies;
+    int *especieHash; // enderecamento aberto: posicao -> id da especie (-1 = vazio)
+    int capEspecieHash;
+    unsigned short *animalEspecie; // coluna de tabAnimais: id da especie
+    IndiceReverso consPorEspecie;
+
+    TabelaAgregados agrPorVet;     // chave: crmVet
+    TabelaAgregados agrPorEspecie; // chave: id da especie
+    TabelaAgregados agrPorMes;     // chave: AAAAMM (-1 = data invalida)
+} Estado;
+
+#ifdef CLINICA_THREADS
+#define POR_THREAD _Thread_local
+#else
+#define POR_THREAD
+#endif
+
+static Estado g_estado = {.tabAnimais = TABELA_INIT(Animal, idAnimal, "animais"),
+                          .tabVets = TABELA_INIT(Veterinario, crmVet, "veterinarios"),
+                          .tabCons = TABELA_INIT(Consulta, idConsulta, "consultas")};
+// Estado que esta thread enxerga: o original, ou a copia de uma leitura do
+// servidor. As threads do pool herdam o de quem despachou a tarefa.
+static POR_THREAD Estado *g_est = &g_estado;
+
+#define g_tabAnimais (g_est->tabAnimais)
+#define g_tabVets (g_est->tabVets)
+#define g_tabCons (g_est->tabCons)
+#define g_consPorAnimal (g_est->consPorAnimal)
+#define g_consPorVet (g_est->consPorVet)
+#define g_consPorData (g_est->consPorData)
+#define g_consData (g_est->consData)
+#define g_consId (g_est->consId)
+#define g_consAnimal (g_est->consAnimal)
+#define g_consCrm (g_est->consCrm)
+#define g_consValor (g_est->consValor)
+#define g_especies (g_est->especies)
+#define g_nEspecies (g_est->nEspecies)
+#define g_capEspecies (g_est->capEspecies)
+#define g_especieHash (g_est->especieHash)
+#define g_capEspecieHash (g_est->capEspecieHash)
+#define g_animalEspecie (g_est->animalEspecie)
+#define g_consPorEspecie (g_est->consPorEspecie)
+#define g_agrPorVet (g_est->agrPorVet)
+#define g_agrPorEspecie (g_est->agrPorEspecie)
+#define g_agrPorMes (g_est->agrPorMes)
+
+// Acesso tipado aos vetores das tabelas. g_nXxx conta tambem as lapides:
+// toda varredura deve pular as posicoes em que tabela_vivo() e falso.
+#define g_animais ((Animal *)g_tabAnimais.dados)
+#define g_nAnimais (g_tabAnimais.n)
+#define g_vets ((Veterinario *)g_tabVets.dados)
+#define g_nVets (g_tabVets.n)
+#define g_consultas ((Consulta *)g_tabCons.dados)
+#define g_nCons (g_tabCons.n)
+
+static int g_nextIdAnimal = 1;
+static int g_nextIdConsulta = 1;
+
+static int g_usarMmap = 1; // desligado por --sem-mmap
+static int g_semGravar = 0; // --gerar --sem-gravar (ou somenteMemoria): nada vai para o disco nesta sessao
+static int g_somenteMemoria = 0; // sessao aberta sem carregar .bin nem log
+static const char *g_socket = NULL; // OpcoesClinica.servidor
+static int g_compartilhado = 0; // OpcoesClinica.compartilhado (--compartilhado)
+static long long g_bytesGravados = 0; // escritos nos .bin desde o inicio
+
+// ======== Utilidades ========
+// Avisos da carga, do checkpoint e resumos das rotinas (clinica_definir_avisos)
+static FILE *g_avisos = NULL;
+static int g_avisosDefinidos = 0; // 0 = saida padrao
+static POR_THREAD FILE *g_avisosConexao = NULL; // servidor: vao para o cliente atendido por esta thread
+
+static void aviso(const char *fmt, ...)
+{
+    FILE *f = g_avisosConexao ? g_avisosConexao : g_avisosDefinidos ? g_avisos : stdout;
+    if (!f)
+        return;
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(f, fmt, ap);
+    va_end(ap);
+}
+
+// Converses de data "DD/MM/AAAA"
+static int parse_data(const char *s, int *dd, int *mm, int *aaaa)
+{
+    if (!s || strlen(s) < 10)
+        return 0;
+    // Caminho rapido para o formato canonico (carga de arquivos grandes)
+    if (s[2] == '/' && s[5] == '/' && (unsigned)(s[0] - '0') < 10 && (unsigned)(s[1] - '0') < 10 &&
+        (unsigned)(s[3] - '0') < 10 && (unsigned)(s[4] - '0') < 10 && (unsigned)(s[6] - '0') < 10 &&
+        (unsigned)(s[7] - '0') < 10 && (unsigned)(s[8] - '0') < 10 && (unsigned)(s[9] - '0') < 10)
+    {
+        *dd = (s[0] - '0') * 10 + (s[1] - '0');
+        *mm = (s[3] - '0') * 10 + (s[4] - '0');
+        *aaaa = (s[6] - '0') * 1000 + (s[7] - '0') * 100 + (s[8] - '0') * 10 + (s[9] - '0');
+    }
+    // Espera "DD/MM/AAAA"
+    else if (sscanf(s, "%2d/%2d/%4d", dd, mm, aaaa) != 3)
+        return 0;
+    if (*dd < 1 || *dd > 31 || *mm < 1 || *mm > 12 || *aaaa < 1)
+        return 0;
+    return 1;
+}
+static int data_to_int(const char *s)
+{
+    int d, m, a;
+    if (!parse_data(s, &d, &m, &a))
+        return -1;
+    return a * 10000 + m * 100 + d; // AAAAMMDD
+}
+
+static double agora_segundos()
+{
+#ifdef _WIN32
+    return (double)clock() / CLOCKS_PER_SEC;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+static int ler_inteiro(const char *s, int *v)
+{
+    char *fim;
+    long x = strtol(s, &fim, 10);
+    if (fim == s || *fim != '\0' || x < INT_MIN || x > INT_MAX)
+        return 0;
+    *v = (int)x;
+    return 1;
+}
+
+static int ler_real(const char *s, double *v)
+{
+    char *fim;
+    *v = strtod(s, &fim);
+    return fim != s && *fim == '\0';
+}
+
+static void copiar_campo(char *dst, const char *src, size_t tam)
+{
+    strncpy(dst, src, tam - 1);
+    dst[tam - 1] = '\0';
+}
+
+// ======== Metricas das operacoes ========
+// Instrumentacao sempre ligada e barata: cada operacao do nucleo le o relogio
+// na entrada e na saida e soma chamadas, linhas percorridas, bytes lidos e
+// gravados, e o tempo vai para um histograma em faixas de potencia de 2 (us).
+// Buscas pelos indices e realocacoes so sao contadas (custam menos que ler o
+// relogio), em contadores de cada thread que o pool junta ao fim das tarefas.
+// Vistas no menu Diagnostico e gravadas em JSON com --metricas.
+#define MET_CARREGAR 0
+#define MET_REAPLICAR_LOG 1
+#define MET_SINCRONIZAR_LOG 2
+#define MET_SALVAR 3
+#define MET_CHECKPOINT 4
+#define MET_INCLUIR 5
+#define MET_ALTERAR 6
+#define MET_EXCLUIR 7
+#define MET_LISTAGEM 8
+#define MET_RELATORIO 9
+#define MET_IMPORTAR 10
+#define MET_EXPORTAR 11
+#define MET_QTD 12
+#define MET_FAIXAS 24 // faixa k: [2^k, 2^(k+1)) us; a 0 vai de 0 a 2 us e a ultima inclui o resto
+
+static const char *const g_metNomes[MET_QTD] = {"carregar", "reaplicar_log", "sincronizar_log", "salvar",
+                                                "checkpoint", "incluir", "alterar", "excluir",
+                                                "listagem", "relatorio", "importar", "exportar"};
+
+typedef struct
+{
+    long long chamadas;
+    long long linhas; // registros percorridos
+    long long bytesLidos, bytesGravados;
+    double total, maximo; // segundos
+    long long faixas[MET_FAIXAS];
+} MetricaOp;
+
+typedef struct
+{
+    long long buscas;      // encontrar_indice_*
+    long long realocacoes; // realocar (todas as estruturas)
+} ContadoresThread;
+
+static MetricaOp g_metricas[MET_QTD];
+static POR_THREAD ContadoresThread g_metThread; // sem disputa nos lacos quentes
+static ContadoresThread g_metAuxiliares;        // juntados das threads do pool, sob g_poolMutex
+static double g_metInicio = 0;                  // partida (ou ultima vez que foram zeradas)
+static long long g_bytesLidos = 0;              // .bin, log e CSV
+static long long g_bytesLog = 0;                // escritos no log
+static long long g_bytesSaida = 0;              // relatorios, listagens e exportacoes
+// Bytes lidos e gravados por esta thread: as medicoes usam estes, para uma
+// listagem do servidor nao contar o log gravado ao mesmo tempo por outra conexao
+static POR_THREAD long long g_lidosThread = 0, g_gravadosThread = 0;
+
+// Relogio e contadores da thread no inicio de uma operacao
+typedef struct
+{
+    double inicio;
+    long long lidos, gravados;
+} Medicao;
+
+static void contar_lidos(long long k)
+{
+    g_bytesLidos += k;
+    g_lidosThread += k;
+}
+
+// total: g_bytesGravados, g_bytesLog ou g_bytesSaida
+static void contar_gravados(long long *total, long long k)
+{
+    *total += k;
+    g_gravadosThread += k;
+}
+
+static Medicao metrica_iniciar()
+{
+    Medicao m = {agora_segundos(), g_lidosThread, g_gravadosThread};
+    return m;
+}
+
+// Fecha a medicao de uma operacao. Fora do servidor so a thread principal
+// chama; no servidor, as leituras longas (listagem, relatorio) e as
+// alteracoes podem correr juntas, mas nunca registram a mesma operacao.
+static void metrica_registrar(int op, const Medicao *m, long long linhas)
+{
+    double dt = agora_segundos() - m->inicio;
+    MetricaOp *o = &g_metricas[op];
+    o->chamadas++;
+    o->linhas += linhas;
+    o->bytesLidos += g_lidosThread - m->lidos;
+    o->bytesGravados += g_gravadosThread - m->gravados;
+    o->total += dt;
+    if (dt > o->maximo)
+        o->maximo = dt;
+    unsigned long long us = dt > 0 ? (unsigned long long)(dt * 1e6) : 0;
+    int k = 0;
+    while (us > 1 && k < MET_FAIXAS - 1)
+    {
+        us >>= 1;
+        k++;
+    }
+    o->faixas[k]++;
+}
+
+static int g_falharRealocacao = 0; // clinica_falhar_realocacao: quantas faltam para a que falha
+
+static void *realocar(void *p, size_t tam)
+{
+    g_metThread.realocacoes++;
+    if (g_falharRealocacao > 0 && --g_falharRealocacao == 0)
+        return NULL;
+    return realloc(p, tam);
+}
+
+// ======== Saida bufferizada ========
+// Bloco grande gravado de uma vez e formatacao feita a mao, sem um fprintf por campo.
+// Serve para exportacoes (arquivo ou pipe) e relatorios: nada alem do bloco atual
+// fica em memoria. Toda gravacao tem exatamente 'cap' bytes (so a ultima e menor):
+// o texto formatado pode passar do bloco e cair na folga, que volta para o inicio.
+#define SAIDA_BUF_TAM (256 * 1024)
+#define SAIDA_FOLGA 1024 // maior pedaco formatado direto no buffer (numero, linha de relatorio)
+#define FMT_REAL_MAX 320 // "%.2f" de qualquer double cabe aqui
+
+typedef struct
+{
+    FILE *f;
+    char *buf;  // cap + SAIDA_FOLGA bytes
+    size_t cap; // tamanho de cada gravacao
+    size_t n;   // ocupado; fica < cap entre uma chamada e outra
+    int erro;
+    int proprio;     // buf alocado por saida_abrir
+    long long bytes; // ja entregues ao arquivo
+} Saida;
+
+// Usa um buffer do chamador, com cap + SAIDA_FOLGA bytes; nao aloca nada
+static void saida_iniciar(Saida *s, FILE *f, char *buf, size_t cap)
+{
+    s->f = f;
+    s->buf = buf;
+    s->cap = cap;
+    s->n = 0;
+    s->erro = 0;
+    s->proprio = 0;
+    s->bytes = 0;
+    if (f == stdout)
+        fflush(f); // a saida padrao segue com o buffer dela (os menus usam printf)
+    else
+        setvbuf(f, NULL, _IONBF, 0); // o bloco ja e o buffer; evita copiar de novo no stdio
+}
+
+static int saida_abrir(Saida *s, FILE *f)
+{
+    char *buf = (char *)malloc(SAIDA_BUF_TAM + SAIDA_FOLGA);
+    if (!buf)
+        return 0;
+    saida_iniciar(s, f, buf, SAIDA_BUF_TAM);
+    s->proprio = 1;
+    return 1;
+}
+
+// Grava p[0..k) seguido de q[0..kq) (kq pode ser 0); no POSIX e um writev so
+static void saida_gravar(Saida *s, const void *p, size_t k, const void *q, size_t kq)
+{
+    if (s->erro)
+        return;
+#ifdef CLINICA_WRITEV
+    struct iovec v[2] = {{(void *)p, k}, {(void *)q, kq}};
+    int i = 0, nv = kq ? 2 : 1;
+    while (i < nv)
+    {
+        ssize_t w = writev(fileno(s->f), v + i, nv - i);
+        if (w < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            s->erro = 1;
+            return;
+        }
+        s->bytes += w;
+        contar_gravados(&g_bytesSaida, w);
+        for (; i < nv && (size_t)w >= v[i].iov_len; i++) // gravacao parcial: continua de onde parou
+            w -= (ssize_t)v[i].iov_len;
+        if (i < nv)
+        {
+            v[i].iov_base = (char *)v[i].iov_base + w;
+            v[i].iov_len -= (size_t)w;
+        }
+    }
+#else
+    if (fwrite(p, 1, k, s->f) != k || (kq > 0 && fwrite(q, 1, kq, s->f) != kq))
+    {
+        s->erro = 1;
+        return;
+    }
+    s->bytes += (long long)(k + kq);
+    contar_gravados(&g_bytesSaida, (long long)(k + kq));
+#endif
+}
+
+static void saida_descarregar(Saida *s)
+{
+    if (s->n > 0)
+        saida_gravar(s, s->buf, s->n, NULL, 0);
+    s->n = 0;
+}
+
+// Onde escrever o proximo pedaco (ate SAIDA_FOLGA bytes); depois, saida_avancar
+static char *saida_espaco(Saida *s)
+{
+    return s->buf + s->n;
+}
+
+static void saida_avancar(Saida *s, size_t k)
+{
+    s->n += k;
+    if (s->n >= s->cap)
+    {
+        saida_gravar(s, s->buf, s->cap, NULL, 0);
+        s->n -= s->cap;
+        memmove(s->buf, s->buf + s->cap, s->n);
+    }
+}
+
+static void saida_bytes(Saida *s, const void *p, size_t k)
+{
+    const char *c = (const char *)p;
+    if (k >= s->cap) // maior que o bloco: vai junto com o que ja esta nele, sem copiar
+    {
+        saida_gravar(s, s->buf, s->n, c, k);
+        s->n = 0;
+        return;
+    }
+    while (k > 0)
+    {
+        size_t m = s->cap - s->n < k ? s->cap - s->n : k;
+        memcpy(s->buf + s->n, c, m);
+        c += m;
+        k -= m;
+        saida_avancar(s, m);
+    }
+}
+
+static void saida_texto(Saida *s, const char *txt)
+{
+    saida_bytes(s, txt, strlen(txt));
+}
+
+static void saida_char(Saida *s, char c)
+{
+    s->buf[s->n] = c;
+    saida_avancar(s, 1);
+}
+
+static int saida_fechar(Saida *s)
+{
+    saida_descarregar(s);
+    if (fflush(s->f) != 0)
+        s->erro = 1;
+    if (s->proprio)
+        free(s->buf);
+    s->buf = NULL;
+    return !s->erro;
+}
+
+// Inteiro em decimal; devolve quantos bytes escreveu em p (ate 20)
+static int fmt_int(char *p, long long v)
+{
+    char tmp[20];
+    int k = 0, n = 0;
+    unsigned long long u = v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+    do
+    {
+        tmp[k++] = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (v < 0)
+        p[n++] = '-';
+    while (k)
+        p[n++] = tmp[--k];
+    return n;
+}
+
+// Centavos de 0 <= a < 1e13 como printf("%.2f") os mostra: o valor binario
+// exato de a*100 arredondado para o inteiro mais proximo (empate -> par)
+static long long centavos_exatos(double a)
+{
+    // c + err == a*100 exatamente (produto de Dekker; 100 tem so 7 bits significativos)
+    double c = a * 100.0;
+    double t = a * 134217729.0; // 2^27 + 1
+    double ah = t - (t - a), al = a - ah;
+    double err = (ah * 100.0 - c) + al * 100.0;
+
+    long long k = (long long)c;
+    double d = c - (double)k; // exato: c < 2^50 aqui
+    if (d > 0.5 || (d == 0.5 && (err > 0 || (err == 0 && (k & 1)))))
+        k++;
+    return k;
+}
+
+// Valor em centavos, igual ao que a tela mostra, para somas exatas.
+// NaN conta como zero e valores fora de +-1e13 saturam.
+static long long centavos(double v)
+{
+    if (v != v)
+        return 0;
+    if (v >= 1e13 || v <= -1e13)
+        return v > 0 ? 1000000000000000LL : -1000000000000000LL;
+    return v < 0 ? -centavos_exatos(-v) : centavos_exatos(v);
+}
+
+// Centavos como "123.45" (ou "-0.05")
+static int fmt_centavos(char *p, long long k)
+{
+    int n = 0;
+    unsigned long long u = k < 0 ? 0ULL - (unsigned long long)k : (unsigned long long)k;
+    if (k < 0)
+        p[n++] = '-';
+    n += fmt_int(p + n, (long long)(u / 100));
+    p[n++] = '.';
+    p[n++] = (char)('0' + u % 100 / 10);
+    p[n++] = (char)('0' + u % 10);
+    return n;
+}
+
+// Igual a printf("%.2f", v) byte a byte
+static int fmt_dinheiro(char *p, double v)
+{
+    if (!(v > -1e13 && v < 1e13)) // enorme, infinito ou NaN: deixa com a libc
+        return snprintf(p, FMT_REAL_MAX, "%.2f", v);
+
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    int neg = (int)(bits >> 63); // inclui -0.0, que sai "-0.00"
+    int n = 0;
+    if (neg)
+        p[n++] = '-';
+    return n + fmt_centavos(p + n, centavos_exatos(neg ? -v : v));
+}
+
+// AAAAMMDD -> "DD/MM/AAAA" (iso = 0) ou "AAAA-MM-DD" (iso = 1); sempre 10 bytes
+static int fmt_data(char *p, int aaaammdd, int iso)
+{
+    int a = aaaammdd / 10000 % 10000, m = aaaammdd / 100 % 100, d = aaaammdd % 100;
+    char dd[2] = {(char)('0' + d / 10), (char)('0' + d % 10)};
+    char mm[2] = {(char)('0' + m / 10), (char)('0' + m % 10)};
+    char aa[4] = {(char)('0' + a / 1000), (char)('0' + a / 100 % 10), (char)('0' + a / 10 % 10), (char)('0' + a % 10)};
+    if (iso)
+    {
+        memcpy(p, aa, 4);
+        p[4] = '-';
+        memcpy(p + 5, mm, 2);
+        p[7] = '-';
+        memcpy(p + 8, dd, 2);
+    }
+    else
+    {
+        memcpy(p, dd, 2);
+        p[2] = '/';
+        memcpy(p + 3, mm, 2);
+        p[5] = '/';
+        memcpy(p + 6, aa, 4);
+    }
+    return 10;
+}
+
+// Texto de um campo de tamanho fixo: para no '\0' ou no fim do campo
+static int fmt_campo(char *p, const char *txt, size_t max)
+{
+    const char *fim = (const char *)memchr(txt, '\0', max);
+    size_t n = fim ? (size_t)(fim - txt) : max;
+    memcpy(p, txt, n);
+    return (int)n;
+}
+
+#define FMT_LIT(p, lit) (memcpy((p), (lit), sizeof(lit) - 1), (int)(sizeof(lit) - 1))
+
+static void saida_int(Saida *s, long long v)
+{
+    saida_avancar(s, (size_t)fmt_int(saida_espaco(s), v));
+}
+
+static void saida_dinheiro(Saida *s, double v)
+{
+    saida_avancar(s, (size_t)fmt_dinheiro(saida_espaco(s), v));
+}
+
+static void saida_data(Saida *s, int aaaammdd, int iso)
+{
+    saida_avancar(s, (size_t)fmt_data(saida_espaco(s), aaaammdd, iso));
+}
+
+// ======== Pool de threads ========
+// Threads criadas uma vez na partida e reaproveitadas: cada tarefa e dividida em
+// partes numeradas; a thread principal faz a parte 0 e as auxiliares as demais.
+// Sem threads (Windows), todas as partes rodam em sequencia na principal.
+#define POOL_MAX 16
+
+typedef void (*TarefaPool)(void *ctx, int parte, int nPartes);
+
+static int g_threads = 0;   // --threads (0 = um por processador)
+static int g_poolUsar = 0;  // partes por tarefa (<= threads do pool; muda no --bench)
+
+#ifdef CLINICA_THREADS
+static pthread_t g_poolIds[POOL_MAX];
+static int g_poolN = 0; // threads auxiliares
+static pthread_mutex_t g_poolMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_poolTarefa = PTHREAD_COND_INITIALIZER; // nova tarefa (ou encerrar)
+static pthread_cond_t g_poolFim = PTHREAD_COND_INITIALIZER;    // todas as auxiliares terminaram
+static TarefaPool g_poolFn = NULL;
+static void *g_poolCtx = NULL;
+static Estado *g_poolEst = NULL; // g_est de quem despachou
+static int g_poolPartes = 0;
+static unsigned g_poolGeracao = 0; // conta as tarefas despachadas
+static int g_poolPendentes = 0;
+static int g_poolSair = 0;
+
+// Passa os contadores da thread atual para g_metAuxiliares; quem chama segura g_poolMutex
+static void metrica_juntar_thread()
+{
+    g_metAuxiliares.buscas += g_metThread.buscas;
+    g_metAuxiliares.realocacoes += g_metThread.realocacoes;
+    memset(&g_metThread, 0, sizeof(g_metThread));
+}
+
+static void *pool_trabalhador(void *arg)
+{
+    int eu = (int)(intptr_t)arg;
+    unsigned vista = 0;
+    pthread_mutex_lock(&g_poolMutex);
+    for (;;)
+    {
+        while (g_poolGeracao == vista && !g_poolSair)
+            pthread_cond_wait(&g_poolTarefa, &g_poolMutex);
+        if (g_poolSair)
+            break;
+        vista = g_poolGeracao;
+        TarefaPool fn = g_poolFn;
+        void *ctx = g_poolCtx;
+        int nPartes = g_poolPartes;
+        g_est = g_poolEst;
+        pthread_mutex_unlock(&g_poolMutex);
+
+        for (int p = eu; p < nPartes; p += g_poolN + 1)
+            fn(ctx, p, nPartes);
+
+        pthread_mutex_lock(&g_poolMutex);
+        metrica_juntar_thread(); // a principal so le depois que todas terminam
+        if (--g_poolPendentes == 0)
+            pthread_cond_signal(&g_poolFim);
+    }
+    pthread_mutex_unlock(&g_poolMutex);
+    return NULL;
+}
+#endif
+
+static int numero_processadores()
+{
+#if defined(CLINICA_THREADS) && defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#else
+    return 1;
+#endif
+}
+
+// Cria as threads auxiliares (antes de qualquer tarefa); se faltar recurso, fica com menos
+static void pool_iniciar()
+{
+    int n = g_threads > 0 ? g_threads : numero_processadores();
+    if (n > POOL_MAX)
+        n = POOL_MAX;
+#ifdef CLINICA_THREADS
+    while (g_poolN < n - 1 &&
+           pthread_create(&g_poolIds[g_poolN], NULL, pool_trabalhador, (void *)(intptr_t)(g_poolN + 1)) == 0)
+        g_poolN++;
+    g_poolUsar = g_poolN + 1;
+#else
+    g_poolUsar = 1;
+#endif
+}
+
+static void pool_encerrar()
+{
+#ifdef CLINICA_THREADS
+    pthread_mutex_lock(&g_poolMutex);
+    g_poolSair = 1;
+    pthread_cond_broadcast(&g_poolTarefa);
+    pthread_mutex_unlock(&g_poolMutex);
+    for (int i = 0; i < g_poolN; i++)
+        pthread_join(g_poolIds[i], NULL);
+    g_poolN = 0;
+    g_poolSair = 0; // a proxima sessao sobe um pool novo
+    g_poolGeracao = 0;
+#endif
+    g_poolUsar = 0;
+}
+
+// Partes por tarefa; 1 antes de pool_iniciar
+static int pool_tamanho()
+{
+    return g_poolUsar > 0 ? g_poolUsar : 1;
+}
+
+// Roda fn(ctx, p, nPartes) para p em [0, nPartes) e so volta quando todas terminarem
+static void pool_executar(TarefaPool fn, void *ctx, int nPartes)
+{
+#ifdef CLINICA_THREADS
+    if (g_poolN > 0 && nPartes > 1)
+    {
+        pthread_mutex_lock(&g_poolMutex);
+        g_poolFn = fn;
+        g_poolCtx = ctx;
+        g_poolPartes = nPartes;
+        g_poolEst = g_est;
+        g_poolPendentes = g_poolN;
+        g_poolGeracao++;
+        pthread_cond_broadcast(&g_poolTarefa);
+        pthread_mutex_unlock(&g_poolMutex);
+
+        for (int p = 0; p < nPartes; p += g_poolN + 1)
+            fn(ctx, p, nPartes);
+
+        pthread_mutex_lock(&g_poolMutex);
+        while (g_poolPendentes > 0)
+            pthread_cond_wait(&g_poolFim, &g_poolMutex);
+        pthread_mutex_unlock(&g_poolMutex);
+        return;
+    }
+#endif
+    for (int p = 0; p < nPartes; p++)
+        fn(ctx, p, nPartes);
+}
+
+// ======== Formatacao paralela em ordem ========
+// Cada parte formata uma faixa contigua de itens no seu proprio buffer; depois
+// os buffers sao gravados na ordem das partes, entao o resultado e igual ao de
+// uma thread so. Rodadas de FAIXA_ITENS itens por parte limitam a memoria.
+#define FAIXA_ITENS 8192
+#define FAIXA_MIN_PARALELO 2048 // abaixo disso nao compensa acordar o pool
+
+// Escreve o item k em p (ate SAIDA_FOLGA bytes) e devolve o tamanho (0 = item pulado)
+typedef int (*FormatarItem)(char *p, int k, const void *ctx);
+
+typedef struct
+{
+    char *p;
+    size_t n;
+    size_t cap;
+} BufferTexto;
+
+typedef struct
+{
+    FormatarItem fmt;
+    const void *ctx;
+    int ini, fim; // itens da rodada
+    int erro;
+} RodadaFormatar;
+
+static BufferTexto g_bufPartes[POOL_MAX]; // um por parte, reaproveitados entre tarefas
+
+static int buffer_garantir(BufferTexto *b, size_t extra)
+{
+    if (b->n + extra <= b->cap)
+        return 1;
+    size_t novo = b->cap ? b->cap * 2 : 256 * 1024;
+    while (novo < b->n + extra)
+        novo *= 2;
+    char *q = (char *)realocar(b->p, novo);
+    if (!q)
+        return 0;
+    b->p = q;
+    b->cap = novo;
+    return 1;
+}
+
+static void buffers_liberar()
+{
+    for (int i = 0; i < POOL_MAX; i++)
+    {
+        free(g_bufPartes[i].p);
+        g_bufPartes[i].p = NULL;
+        g_bufPartes[i].n = g_bufPartes[i].cap = 0;
+    }
+}
+
+static void formatar_parte(void *arg, int parte, int nPartes)
+{
+    RodadaFormatar *r = (RodadaFormatar *)arg;
+    long total = r->fim - r->ini;
+    int ini = r->ini + (int)(total * parte / nPartes), fim = r->ini + (int)(total * (parte + 1) / nPartes);
+    BufferTexto *b = &g_bufPartes[parte];
+    b->n = 0;
+    for (int k = ini; k < fim; k++)
+    {
+        if (!buffer_garantir(b, SAIDA_FOLGA))
+        {
+            r->erro = 1; // so vira 0 -> 1; a principal le depois do pool_executar
+            return;
+        }
+        b->n += (size_t)r->fmt(b->p + b->n, k, r->ctx);
+    }
+}
+
+// Formata os itens [0, n) nas threads do pool e grava em 's' na ordem dos itens
+static int formatar_em_ordem(Saida *s, int n, FormatarItem fmt, const void *ctx)
+{
+    int nPartes = pool_tamanho();
+    if (nPartes == 1 || n < FAIXA_MIN_PARALELO)
+    {
+        for (int k = 0; k < n; k++)
+            saida_avancar(s, (size_t)fmt(saida_espaco(s), k, ctx));
+        return 1;
+    }
+    RodadaFormatar r = {fmt, ctx, 0, 0, 0};
+    for (int ini = 0; ini < n && !r.erro; ini += nPartes * FAIXA_ITENS)
+    {
+        r.ini = ini;
+        r.fim = n - ini < nPartes * FAIXA_ITENS ? n : ini + nPartes * FAIXA_ITENS;
+        pool_executar(formatar_parte, &r, nPartes);
+        for (int p = 0; p < nPartes && !r.erro; p++)
+            saida_bytes(s, g_bufPartes[p].p, g_bufPartes[p].n);
+    }
+    return !r.erro;
+}
+
+// ======== CRC32C ========
+// Castagnoli, forma refletida. Por software usa tabelas "slicing-by-8"; com
+// SSE4.2 (x86) ou a extensao CRC do ARMv8 a instrucao de hardware consome 8
+// bytes por vez. A escolha e feita uma vez, na primeira chamada.
+static uint32_t g_crcTab[8][256];
+static uint32_t (*g_crc32c)(uint32_t, const unsigned char *, size_t) = NULL;
+
+static uint32_t crc32c_software(uint32_t crc, const unsigned char *p, size_t n)
+{
+    while (n >= 8)
+    {
+        uint32_t a, b;
+        memcpy(&a, p, 4);
+        memcpy(&b, p + 4, 4);
+        a ^= crc;
+        crc = g_crcTab[7][a & 0xFF] ^ g_crcTab[6][(a >> 8) & 0xFF] ^ g_crcTab[5][(a >> 16) & 0xFF] ^
+              g_crcTab[4][a >> 24] ^ g_crcTab[3][b & 0xFF] ^ g_crcTab[2][(b >> 8) & 0xFF] ^
+              g_crcTab[1][(b >> 16) & 0xFF] ^ g_crcTab[0][b >> 24];
+        p += 8;
+        n -= 8;
+    }
+    while (n--)
+        crc = (crc >> 8) ^ g_crcTab[0][(crc ^ *p++) & 0xFF];
+    return crc;
+}
+
+#if defined(CLINICA_CRC_SSE42)
+__attribute__((target("sse4.2"))) static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *p, size_t n)
+{
+#if defined(__x86_64__)
+    uint64_t c = crc;
+    for (; n >= 8; p += 8, n -= 8)
+    {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+    }
+    crc = (uint32_t)c;
+#endif
+    for (; n >= 4; p += 4, n -= 4)
+    {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        crc = _mm_crc32_u32(crc, v);
+    }
+    while (n--)
+        crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+#elif defined(CLINICA_CRC_ARM)
+static uint32_t crc32c_arm(uint32_t crc, const unsigned char *p, size_t n)
+{
+    for (; n >= 8; p += 8, n -= 8)
+    {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        crc = __crc32cd(crc, v);
+    }
+    while (n--)
+        crc = __crc32cb(crc, *p++);
+    return crc;
+}
+#endif
+
+static void crc32c_escolher()
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1)));
+        g_crcTab[0][i] = c;
+    }
+    for (int t = 1; t < 8; t++)
+        for (int i = 0; i < 256; i++)
+            g_crcTab[t][i] = (g_crcTab[t - 1][i] >> 8) ^ g_crcTab[0][g_crcTab[t - 1][i] & 0xFF];
+
+    g_crc32c = crc32c_software;
+#if defined(CLINICA_CRC_SSE42)
+    if (__builtin_cpu_supports("sse4.2"))
+        g_crc32c = crc32c_sse42;
+#elif defined(CLINICA_CRC_ARM)
+    g_crc32c = crc32c_arm;
+#endif
+}
+
+static uint32_t crc32c(const void *p, size_t n)
+{
+    if (!g_crc32c)
+        crc32c_escolher();
+    return ~g_crc32c(~0u, (const unsigned char *)p, n);
+}
+
+// ======== Filtros sobre colunas ========
+// Selecionam as posicoes [ini, fim) de uma coluna com lo <= x <= hi e as gravam
+// em 'saida' (espaco para fim - ini posicoes); devolvem quantas. Com AVX2 a
+// comparacao cobre 8 inteiros (4 reais) por instrucao, com SSE4.2 4 (2 reais),
+// e a mascara resultante vira lista de posicoes por tabela. A escolha (e a
+// montagem das tabelas) e feita uma vez em clinica_abrir, antes de subir o
+// pool: os trabalhadores so leem.
+typedef int (*FiltroInt)(const int *col, int ini, int fim, int lo, int hi, int *saida);
+typedef int (*FiltroReal)(const double *col, int ini, int fim, double lo, double hi, int *saida);
+
+static FiltroInt g_filtroInt = NULL;
+static FiltroReal g_filtroReal = NULL;
+
+// Sem desvio por registro: grava sempre e so avanca quando passa.
+// lo <= x <= hi vira uma comparacao sem sinal: x - lo <= hi - lo.
+static int filtro_int_escalar(const int *col, int ini, int fim, int lo, int hi, int *saida)
+{
+    unsigned larg = (unsigned)hi - (unsigned)lo;
+    int n = 0;
+    for (int i = ini; i < fim; i++)
+    {
+        saida[n] = i;
+        n += (unsigned)col[i] - (unsigned)lo <= larg;
+    }
+    return n;
+}
+
+// NaN nunca passa (comparacoes ordenadas, como nos kernels)
+static int filtro_real_escalar(const double *col, int ini, int fim, double lo, double hi, int *saida)
+{
+    int n = 0;
+    for (int i = ini; i < fim; i++)
+    {
+        saida[n] = i;
+        n += (col[i] >= lo) & (col[i] <= hi);
+    }
+    return n;
+}
+
+#if defined(CLINICA_FILTRO_X86)
+// Mascara de 8 comparacoes -> posicoes dos bits ligados, gravadas de uma vez
+// (sem desvio por linha escolhida); a saida avanca pelo numero de bits
+static unsigned char g_filtroPos[256][8];
+static int g_filtroQtd[256];
+
+__attribute__((target("sse4.2"))) static int filtro_int_sse42(const int *col, int ini, int fim, int lo, int hi,
+                                                              int *saida)
+{
+    __m128i vlo = _mm_set1_epi32(lo), larg = _mm_set1_epi32((int)((unsigned)hi - (unsigned)lo));
+    int n = 0, i = ini;
+    for (; i + 4 <= fim; i += 4)
+    {
+        __m128i d = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(col + i)), vlo);
+        __m128i ok = _mm_cmpeq_epi32(_mm_min_epu32(d, larg), d); // d <= larg, sem sinal
+        int m = _mm_movemask_ps(_mm_castsi128_ps(ok));
+        int p4;
+        memcpy(&p4, g_filtroPos[m], 4);
+        __m128i pos = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(p4));
+        _mm_storeu_si128((__m128i *)(saida + n), _mm_add_epi32(pos, _mm_set1_epi32(i)));
+        n += g_filtroQtd[m];
+    }
+    return n + filtro_int_escalar(col, i, fim, lo, hi, saida + n);
+}
+
+__attribute__((target("sse4.2"))) static int filtro_real_sse42(const double *col, int ini, int fim, double lo,
+                                                               double hi, int *saida)
+{
+    __m128d vlo = _mm_set1_pd(lo), vhi = _mm_set1_pd(hi);
+    int n = 0, i = ini;
+    for (; i + 4 <= fim; i += 4)
+    {
+        __m128d a = _mm_loadu_pd(col + i), b = _mm_loadu_pd(col + i + 2);
+        int m = _mm_movemask_pd(_mm_and_pd(_mm_cmpge_pd(a, vlo), _mm_cmple_pd(a, vhi))) |
+                _mm_movemask_pd(_mm_and_pd(_mm_cmpge_pd(b, vlo), _mm_cmple_pd(b, vhi))) << 2;
+        int p4;
+        memcpy(&p4, g_filtroPos[m], 4);
+        __m128i pos = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(p4));
+        _mm_storeu_si128((__m128i *)(saida + n), _mm_add_epi32(pos, _mm_set1_epi32(i)));
+        n += g_filtroQtd[m];
+    }
+    return n + filtro_real_escalar(col, i, fim, lo, hi, saida + n);
+}
+
+__attribute__((target("avx2"))) static int filtro_int_avx2(const int *col, int ini, int fim, int lo, int hi,
+                                                           int *saida)
+{
+    __m256i vlo = _mm256_set1_epi32(lo), larg = _mm256_set1_epi32((int)((unsigned)hi - (unsigned)lo));
+    int n = 0, i = ini;
+    for (; i + 8 <= fim; i += 8)
+    {
+        __m256i d = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(col + i)), vlo);
+        __m256i ok = _mm256_cmpeq_epi32(_mm256_min_epu32(d, larg), d);
+        int m = _mm256_movemask_ps(_mm256_castsi256_ps(ok));
+        __m256i pos = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)g_filtroPos[m]));
+        _mm256_storeu_si256((__m256i *)(saida + n), _mm256_add_epi32(pos, _mm256_set1_epi32(i)));
+        n += g_filtroQtd[m];
+    }
+    return n + filtro_int_escalar(col, i, fim, lo, hi, saida + n);
+}
+
+__attribute__((target("avx2"))) static int filtro_real_avx2(const double *col, int ini, int fim, double lo,
+                                                            double hi, int *saida)
+{
+    __m256d vlo = _mm256_set1_pd(lo), vhi = _mm256_set1_pd(hi);
+    int n = 0, i = ini;
+    for (; i + 8 <= fim; i += 8)
+    {
+        __m256d a = _mm256_loadu_pd(col + i), b = _mm256_loadu_pd(col + i + 4);
+        int m = _mm256_movemask_pd(_mm256_and_pd(_mm256_cmp_pd(a, vlo, _CMP_GE_OQ), _mm256_cmp_pd(a, vhi, _CMP_LE_OQ))) |
+                _mm256_movemask_pd(_mm256_and_pd(_mm256_cmp_pd(b, vlo, _CMP_GE_OQ), _mm256_cmp_pd(b, vhi, _CMP_LE_OQ)))
+                    << 4;
+        __m256i pos = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)g_filtroPos[m]));
+        _mm256_storeu_si256((__m256i *)(saida + n), _mm256_add_epi32(pos, _mm256_set1_epi32(i)));
+        n += g_filtroQtd[m];
+    }
+    return n + filtro_real_escalar(col, i, fim, lo, hi, saida + n);
+}
+#endif
+
+static void filtros_escolher()
+{
+#if defined(CLINICA_FILTRO_X86)
+    for (int m = 0; m < 256; m++)
+    {
+        g_filtroQtd[m] = 0;
+        for (int b = 0; b < 8; b++)
+            if (m >> b & 1)
+                g_filtroPos[m][g_filtroQtd[m]++] = (unsigned char)b;
+    }
+#endif
+    g_filtroInt = filtro_int_escalar;
+    g_filtroReal = filtro_real_escalar;
+#if defined(CLINICA_FILTRO_X86)
+    if (__builtin_cpu_supports("avx2"))
+    {
+        g_filtroInt = filtro_int_avx2;
+        g_filtroReal = filtro_real_avx2;
+    }
+    else if (__builtin_cpu_supports("sse4.2"))
+    {
+        g_filtroInt = filtro_int_sse42;
+        g_filtroReal = filtro_real_sse42;
+    }
+#endif
+}
+
+static int filtrar_int(const int *col, int ini, int fim, int lo, int hi, int *saida)
+{
+    return lo > hi ? 0 : g_filtroInt(col, ini, fim, lo, hi, saida);
+}
+
+static int filtrar_real(const double *col, int ini, int fim, double lo, double hi, int *saida)
+{
+    return g_filtroReal(col, ini, fim, lo, hi, saida);
+}
+
+// ======== Indice hash (chave primaria) ========
+// INT_MIN marca a posicao vazia (e a lapide das tabelas, CHAVE_REMOVIDA): nunca
+// e uma chave valida, e buscar ou remover INT_MIN nao encontra nada
+#define HASH_VAZIO INT_MIN
+#define HASH_CAP_MIN 16
+
+static unsigned hash_int(int chave)
+{
+    uint32_t h = (uint32_t)chave * 0x9E3779B1u;
+    return h ^ (h >> 16);
+}
+
+static int idx_buscar(const IndiceHash *h, int chave)
+{
+    if (h->cap == 0 || chave == HASH_VAZIO)
+        return -1;
+    unsigned mask = (unsigned)h->cap - 1;
+    for (unsigned i = hash_int(chave) & mask;; i = (i + 1) & mask)
+    {
+        if (h->chaves[i] == chave)
+            return h->valores[i];
+        if (h->chaves[i] == HASH_VAZIO)
+            return -1;
+    }
+}
+
+static void idx_limpar(IndiceHash *h)
+{
+    for (int i = 0; i < h->cap; i++)
+        h->chaves[i] = HASH_VAZIO;
+    h->n = 0;
+}
+
+static int idx_redimensionar(IndiceHash *h, int novaCap)
+{
+    int *ch = (int *)malloc((size_t)novaCap * sizeof(int));
+    int *va = (int *)malloc((size_t)novaCap * sizeof(int));
+    if (!ch || !va)
+    {
+        free(ch);
+        free(va);
+        return 0;
+    }
+    for (int i = 0; i < novaCap; i++)
+        ch[i] = HASH_VAZIO;
+
+    unsigned mask = (unsigned)novaCap - 1;
+    for (int i = 0; i < h->cap; i++)
+    {
+        if (h->chaves[i] == HASH_VAZIO)
+            continue;
+        unsigned j = hash_int(h->chaves[i]) & mask;
+        while (ch[j] != HASH_VAZIO)
+            j = (j + 1) & mask;
+        ch[j] = h->chaves[i];
+        va[j] = h->valores[i];
+    }
+    free(h->chaves);
+    free(h->valores);
+    h->chaves = ch;
+    h->valores = va;
+    h->cap = novaCap;
+    return 1;
+}
+
+// Reserva espaco para 'qtd' chaves mantendo fator de carga <= 0.7
+static int idx_reservar(IndiceHash *h, int qtd)
+{
+    int cap = h->cap ? h->cap : HASH_CAP_MIN;
+    while ((long long)qtd * 10 > (long long)cap * 7)
+        cap *= 2;
+    return cap == h->cap || idx_redimensionar(h, cap);
+}
+
+// Insere ou substitui o valor da chave
+static int idx_inserir(IndiceHash *h, int chave, int valor)
+{
+    if (!idx_reservar(h, h->n + 1))
+        return 0;
+    unsigned mask = (unsigned)h->cap - 1;
+    unsigned i = hash_int(chave) & mask;
+    while (h->chaves[i] != HASH_VAZIO && h->chaves[i] != chave)
+        i = (i + 1) & mask;
+    if (h->chaves[i] == HASH_VAZIO)
+        h->n++;
+    h->chaves[i] = chave;
+    h->valores[i] = valor;
+    return 1;
+}
+
+// Troca o valor de uma chave ja presente; nunca aloca (0 = chave ausente)
+static int idx_atualizar(IndiceHash *h, int chave, int valor)
+{
+    if (h->cap == 0 || chave == HASH_VAZIO)
+        return 0;
+    unsigned mask = (unsigned)h->cap - 1;
+    unsigned i = hash_int(chave) & mask;
+    while (h->chaves[i] != chave)
+    {
+        if (h->chaves[i] == HASH_VAZIO)
+            return 0;
+        i = (i + 1) & mask;
+    }
+    h->valores[i] = valor;
+    return 1;
+}
+
+// Remocao com deslocamento reverso: nao deixa lapides na sondagem linear
+static void idx_remover(IndiceHash *h, int chave)
+{
+    if (h->cap == 0 || chave == HASH_VAZIO)
+        return;
+    unsigned mask = (unsigned)h->cap - 1;
+    unsigned i = hash_int(chave) & mask;
+    while (h->chaves[i] != chave)
+    {
+        if (h->chaves[i] == HASH_VAZIO)
+            return;
+        i = (i + 1) & mask;
+    }
+    unsigned j = i;
+    for (;;)
+    {
+        j = (j + 1) & mask;
+        if (h->chaves[j] == HASH_VAZIO)
+            break;
+        unsigned ideal = hash_int(h->chaves[j]) & mask;
+        // move j para o buraco i se a posicao ideal de j nao estiver em (i, j]
+        if ((j > i && (ideal <= i || ideal > j)) || (j < i && (ideal <= i && ideal > j)))
+        {
+            h->chaves[i] = h->chaves[j];
+            h->valores[i] = h->valores[j];
+            i = j;
+        }
+    }
+    h->chaves[i] = HASH_VAZIO;
+    h->n--;
+}
+
+static void idx_liberar(IndiceHash *h)
+{
+    free(h->chaves);
+    free(h->valores);
+    h->chaves = NULL;
+    h->valores = NULL;
+    h->cap = 0;
+    h->n = 0;
+}
+
+// ======== Indice reverso (listas de consultas por FK) ========
+static int lista_posicao(const ListaIds *l, int id)
+{
+    int lo = 0, hi = l->n;
+    while (lo < hi)
+    {
+        int meio = (lo + hi) / 2;
+        if (l->ids[meio] < id)
+            lo = meio + 1;
+        else
+            hi = meio;
+    }
+    return lo;
+}
+
+static int lista_inserir(ListaIds *l, int id)
+{
+    if (l->n == l->cap)
+    {
+        int novo = l->cap ? l->cap * 2 : 4;
+        int *p = (int *)realocar(l->ids, (size_t)novo * sizeof(int));
+        if (!p)
+            return 0;
+        l->ids = p;
+        l->cap = novo;
+    }
+    // Caso comum: id novo e maior que todos (cadastro/carga em ordem)
+    int pos = (l->n == 0 || l->ids[l->n - 1] < id) ? l->n : lista_posicao(l, id);
+    if (pos < l->n && l->ids[pos] == id)
+        return 1;
+    memmove(&l->ids[pos + 1], &l->ids[pos], (size_t)(l->n - pos) * sizeof(int));
+    l->ids[pos] = id;
+    l->n++;
+    return 1;
+}
+
+static void lista_remover(ListaIds *l, int id)
+{
+    int pos = lista_posicao(l, id);
+    if (pos >= l->n || l->ids[pos] != id)
+        return;
+    memmove(&l->ids[pos], &l->ids[pos + 1], (size_t)(l->n - pos - 1) * sizeof(int));
+    l->n--;
+}
+
+static const ListaIds *rev_lista(const IndiceReverso *r, int chave)
+{
+    int i = idx_buscar(&r->mapa, chave);
+    return i < 0 ? NULL : &r->listas[i];
+}
+
+static int rev_contar(const IndiceReverso *r, int chave)
+{
+    const ListaIds *l = rev_lista(r, chave);
+    return l ? l->n : 0;
+}
+
+static int rev_adicionar(IndiceReverso *r, int chave, int idConsulta)
+{
+    int i = idx_buscar(&r->mapa, chave);
+    if (i < 0)
+    {
+        if (r->n == r->cap)
+        {
+            int novo = r->cap ? r->cap * 2 : 16;
+            ListaIds *p = (ListaIds *)realocar(r->listas, (size_t)novo * sizeof(ListaIds));
+            if (!p)
+                return 0;
+            r->listas = p;
+            r->cap = novo;
+        }
+        if (!idx_inserir(&r->mapa, chave, r->n))
+            return 0;
+        i = r->n++;
+        r->listas[i].ids = NULL;
+        r->listas[i].n = 0;
+        r->listas[i].cap = 0;
+    }
+    return lista_inserir(&r->listas[i], idConsulta);
+}
+
+static void rev_remover(IndiceReverso *r, int chave, int idConsulta)
+{
+    int i = idx_buscar(&r->mapa, chave);
+    if (i >= 0)
+        lista_remover(&r->listas[i], idConsulta);
+}
+
+static void rev_liberar(IndiceReverso *r)
+{
+    for (int i = 0; i < r->n; i++)
+        free(r->listas[i].ids);
+    free(r->listas);
+    r->listas = NULL;
+    r->n = 0;
+    r->cap = 0;
+    idx_liberar(&r->mapa);
+}
+
+// ======== Indice de datas (vetor ordenado) ========
+// Primeira posicao com (data, id) >= (data, id) dado
+static int idxdata_posicao(const IndiceData *ix, int data, int id)
+{
+    int lo = 0, hi = ix->n;
+    while (lo < hi)
+    {
+        int meio = (lo + hi) / 2;
+        const ChaveData *k = &ix->itens[meio];
+        if (k->data < data || (k->data == data && k->id < id))
+            lo = meio + 1;
+        else
+            hi = meio;
+    }
+    return lo;
+}
+
+// Garante espaco para 'qtd' chaves; depois disso inserir ate 'qtd' nao aloca
+static int idxdata_reservar(IndiceData *ix, int qtd)
+{
+    if (qtd <= ix->cap)
+        return 1;
+    int novo = ix->cap ? ix->cap * 2 : 16;
+    while (novo < qtd)
+        novo *= 2;
+    ChaveData *p = (ChaveData *)realocar(ix->itens, (size_t)novo * sizeof(ChaveData));
+    if (!p)
+        return 0;
+    ix->itens = p;
+    ix->cap = novo;
+    return 1;
+}
+
+static int idxdata_inserir(IndiceData *ix, int data, int id)
+{
+    if (!idxdata_reservar(ix, ix->n + 1))
+        return 0;
+    int pos = idxdata_posicao(ix, data, id);
+    memmove(&ix->itens[pos + 1], &ix->itens[pos], (size_t)(ix->n - pos) * sizeof(ChaveData));
+    ix->itens[pos].data = data;
+    ix->itens[pos].id = id;
+    ix->n++;
+    return 1;
+}
+
+static void idxdata_remover(IndiceData *ix, int data, int id)
+{
+    int pos = idxdata_posicao(ix, data, id);
+    if (pos >= ix->n || ix->itens[pos].data != data || ix->itens[pos].id != id)
+        return;
+    memmove(&ix->itens[pos], &ix->itens[pos + 1], (size_t)(ix->n - pos - 1) * sizeof(ChaveData));
+    ix->n--;
+}
+
+static int comparar_chave_data(const void *a, const void *b)
+{
+    const ChaveData *x = (const ChaveData *)a, *y = (const ChaveData *)b;
+    if (x->data != y->data)
+        return x->data < y->data ? -1 : 1;
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+// Carga em lote: preenche sem ordenar e ordena uma vez so
+static int idxdata_reconstruir(IndiceData *ix, const ChaveData *itens, int n)
+{
+    if (n > ix->cap)
+    {
+        ChaveData *p = (ChaveData *)realocar(ix->itens, (size_t)n * sizeof(ChaveData));
+        if (!p)
+            return 0;
+        ix->itens = p;
+        ix->cap = n;
+    }
+    ix->n = n;
+    if (n > 0)
+    {
+        memcpy(ix->itens, itens, (size_t)n * sizeof(ChaveData));
+        qsort(ix->itens, (size_t)n, sizeof(ChaveData), comparar_chave_data);
+    }
+    return 1;
+}
+
+// Insercao em lote: ordena so as chaves novas e intercala com as existentes,
+// de tras para frente, em O(n + k log k) em vez de k deslocamentos de O(n)
+static int idxdata_mesclar(IndiceData *ix, ChaveData *novos, int k)
+{
+    if (k == 0)
+        return 1;
+    if (ix->n + k > ix->cap)
+    {
+        int novo = ix->cap ? ix->cap : 16;
+        while (novo < ix->n + k)
+            novo *= 2;
+        ChaveData *p = (ChaveData *)realocar(ix->itens, (size_t)novo * sizeof(ChaveData));
+        if (!p)
+            return 0;
+        ix->itens = p;
+        ix->cap = novo;
+    }
+    qsort(novos, (size_t)k, sizeof(ChaveData), comparar_chave_data);
+    int i = ix->n - 1, j = k - 1, d = ix->n + k - 1;
+    while (j >= 0)
+    {
+        if (i >= 0 && comparar_chave_data(&ix->itens[i], &novos[j]) > 0)
+            ix->itens[d--] = ix->itens[i--];
+        else
+            ix->itens[d--] = novos[j--];
+    }
+    ix->n += k;
+    return 1;
+}
+
+static void idxdata_liberar(IndiceData *ix)
+{
+    free(ix->itens);
+    ix->itens = NULL;
+    ix->n = 0;
+    ix->cap = 0;
+}
+
+// ======== Agregados por chave ========
+// Soma (ou subtrai, com visitas < 0) na chave; so aloca para chave nova
+static int agregado_somar(TabelaAgregados *t, int chave, long long centavos, int visitas)
+{
+    int i = idx_buscar(&t->mapa, chave);
+    if (i < 0)
+    {
+        if (t->n == t->cap)
+        {
+            int novo = t->cap ? t->cap * 2 : 16;
+            int *ch = (int *)realocar(t->chaves, (size_t)novo * sizeof(int));
+            if (!ch)
+                return 0;
+            t->chaves = ch;
+            Agregado *v = (Agregado *)realocar(t->valores, (size_t)novo * sizeof(Agregado));
+            if (!v)
+                return 0;
+            t->valores = v;
+            t->cap = novo;
+        }
+        if (!idx_inserir(&t->mapa, chave, t->n))
+            return 0;
+        i = t->n++;
+        t->chaves[i] = chave;
+        t->valores[i].centavos = 0;
+        t->valores[i].visitas = 0;
+    }
+    t->valores[i].centavos += centavos;
+    t->valores[i].visitas += visitas;
+    return 1;
+}
+
+static void agregados_liberar(TabelaAgregados *t)
+{
+    free(t->chaves);
+    free(t->valores);
+    t->chaves = NULL;
+    t->valores = NULL;
+    t->n = 0;
+    t->cap = 0;
+    idx_liberar(&t->mapa);
+}
+
+// ======== Dicionario de especies ========
+// Letras acentuadas de U+00C0..U+00FF (Latin-1) dobradas para ASCII minusculo
+static const char DOBRA_LATIN1[65] = "aaaaaaaceeeeiiiidnooooo ouuuuytsaaaaaaaceeeeiiiidnooooo ouuuuyty";
+
+// Normaliza a grafia: aceita UTF-8 ou Latin-1, tira acentos, maiusculas e espacos extras
+static void normalizar_especie(const char *s, char *out, size_t tam)
+{
+    size_t n = 0;
+    int espaco = 0;
+    const unsigned char *p = (const unsigned char *)s;
+    while (*p && n + 1 < tam)
+    {
+        unsigned c = *p++;
+        if (c == 0xC3 && *p >= 0x80 && *p <= 0xBF) // UTF-8 de U+00C0..U+00FF
+            c = 0xC0 + (*p++ - 0x80);
+        else if (c == 0xC2 && *p >= 0x80 && *p <= 0xBF) // simbolos U+0080..U+00BF
+        {
+            p++;
+            continue;
+        }
+
+        if (c >= 0xC0)
+            c = (unsigned char)DOBRA_LATIN1[c - 0xC0];
+        else if (c >= 'A' && c <= 'Z')
+            c = c - 'A' + 'a';
+        else if (c >= 0x80)
+            continue;
+
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+        {
+            espaco = (n > 0);
+            continue;
+        }
+        if (espaco && n + 2 < tam)
+            out[n++] = ' ';
+        espaco = 0;
+        out[n++] = (char)c;
+    }
+    out[n] = '\0';
+}
+
+static unsigned hash_texto(const char *s)
+{
+    uint32_t h = 2166136261u; // FNV-1a
+    while (*s)
+        h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h;
+}
+
+static int especie_buscar_chave(const char *chave)
+{
+    if (g_capEspecieHash == 0)
+        return -1;
+    unsigned mask = (unsigned)g_capEspecieHash - 1;
+    for (unsigned i = hash_texto(chave) & mask;; i = (i + 1) & mask)
+    {
+        int id = g_especieHash[i];
+        if (id < 0)
+            return -1;
+        if (strcmp(g_especies[id].chave, chave) == 0)
+            return id;
+    }
+}
+
+static int especie_rehash(int novaCap)
+{
+    int *h = (int *)malloc((size_t)novaCap * sizeof(int));
+    if (!h)
+        return 0;
+    for (int i = 0; i < novaCap; i++)
+        h[i] = -1;
+    unsigned mask = (unsigned)novaCap - 1;
+    for (int id = 0; id < g_nEspecies; id++)
+    {
+        unsigned i = hash_texto(g_especies[id].chave) & mask;
+        while (h[i] >= 0)
+            i = (i + 1) & mask;
+        h[i] = id;
+    }
+    free(g_especieHash);
+    g_especieHash = h;
+    g_capEspecieHash = novaCap;
+    return 1;
+}
+
+// Id da especie com essa grafia (qualquer acento/caixa), ou -1 se nunca vista
+static int especie_buscar(const char *nome)
+{
+    char chave[ESPECIE_TAM];
+    normalizar_especie(nome, chave, sizeof(chave));
+    return especie_buscar_chave(chave);
+}
+
+// Devolve o id da especie, cadastrando-a no dicionario se for nova; -1 sem memoria
+static int especie_internar(const char *nome)
+{
+    char chave[ESPECIE_TAM];
+    normalizar_especie(nome, chave, sizeof(chave));
+    int id = especie_buscar_chave(chave);
+    if (id >= 0)
+        return id;
+    if (g_nEspecies >= ESPECIE_MAX)
+        return -1;
+
+    if (g_nEspecies == g_capEspecies)
+    {
+        int novo = g_capEspecies ? g_capEspecies * 2 : 16;
+        Especie *p = (Especie *)realocar(g_especies, (size_t)novo * sizeof(Especie));
+        if (!p)
+            return -1;
+        g_especies = p;
+        g_capEspecies = novo;
+    }
+    if ((g_nEspecies + 1) * 2 > g_capEspecieHash &&
+        !especie_rehash(g_capEspecieHash ? g_capEspecieHash * 2 : 32))
+        return -1;
+
+    id = g_nEspecies++;
+    strcpy(g_especies[id].chave, chave);
+    copiar_campo(g_especies[id].nome, nome, ESPECIE_TAM);
+
+    unsigned mask = (unsigned)g_capEspecieHash - 1;
+    unsigned i = hash_texto(chave) & mask;
+    while (g_especieHash[i] >= 0)
+        i = (i + 1) & mask;
+    g_especieHash[i] = id;
+    return id;
+}
+
+static void especies_liberar()
+{
+    free(g_especies);
+    free(g_especieHash);
+    g_especies = NULL;
+    g_especieHash = NULL;
+    g_nEspecies = g_capEspecies = g_capEspecieHash = 0;
+}
+
+// ======== Tabela generica: alteracoes pendentes de gravacao ========
+// O .bin guarda as posicoes da tabela na mesma ordem da memoria (lapides
+// inclusive), entao um registro alterado pode ser regravado no proprio lugar.
+// Compactar ou esvaziar a tabela quebra essa correspondencia: ai a proxima
+// gravacao e completa.
+static void tabela_esquecer_arquivo(Tabela *t)
+{
+    free(t->paginasSujas);
+    t->paginasSujas = NULL;
+    free(t->crcs);
+    t->crcs = NULL;
+    t->capBlocos = 0;
+    t->nArquivo = -1;
+    t->sujo = 1;
+}
+
+// As posicoes [0, n) acabaram de ser lidas do arquivo ou gravadas nele
+static void tabela_lembrar_arquivo(Tabela *t, int n)
+{
+    size_t nPaginas = ((size_t)n * t->tamElem + PAGINA_TAM - 1) / PAGINA_TAM;
+    unsigned char *bits = (unsigned char *)calloc(nPaginas / 8 + 1, 1);
+    free(t->paginasSujas);
+    t->paginasSujas = bits;
+    t->nArquivo = bits ? n : -1;
+    t->sujo = !bits;
+}
+
+// Chamado a cada escrita na posicao idx
+static void tabela_marcar(Tabela *t, int idx)
+{
+    t->sujo = 1;
+    if (idx >= t->nArquivo) // posicao nova: vai junto com a cauda
+        return;
+    size_t ini = (size_t)idx * t->tamElem;
+    size_t fim = ini + t->tamElem - 1;
+    for (size_t p = ini / PAGINA_TAM; p <= fim / PAGINA_TAM; p++)
+        t->paginasSujas[p / 8] |= (unsigned char)(1u << (p % 8));
+}
+
+static int pagina_suja(const Tabela *t, size_t p)
+{
+    return (t->paginasSujas[p / 8] >> (p % 8)) & 1;
+}
+
+// ======== Tabela generica: capacidade dinamica ========
+// Cresce em progressao geometrica (dobra) e so encolhe pela metade quando
+// a ocupacao cai abaixo de 1/4, evitando realloc a cada insercao/remocao.
+// Realoca um bloco (vetor principal ou coluna) contabilizando a copia
+static int tabela_realocar_bloco(Tabela *t, void **bloco, size_t tam, int novaCap)
+{
+    void *antigo = *bloco;
+    void *p = realocar(*bloco, (size_t)novaCap * tam);
+    if (!p)
+        return 0;
+    t->alocacoes++;
+    if (antigo && p != antigo)
+        t->bytesCopiados += (long long)(t->cap < novaCap ? t->cap : novaCap) * (long long)tam;
+    *bloco = p;
+    return 1;
+}
+
+// Tira a tabela do arquivo mapeado: copia os registros para o heap
+static int tabela_desmapear(Tabela *t, int novaCap)
+{
+#ifdef CLINICA_MMAP
+    void *p = malloc((size_t)(novaCap > t->n ? novaCap : t->n) * t->tamElem);
+    if (!p)
+        return 0;
+    memcpy(p, t->dados, (size_t)t->n * t->tamElem);
+    munmap(t->mapa, t->tamMapa);
+    t->alocacoes++;
+    t->bytesCopiados += (long long)t->n * (long long)t->tamElem;
+    t->dados = p;
+    t->mapa = NULL;
+    t->tamMapa = 0;
+#else
+    (void)t;
+    (void)novaCap;
+#endif
+    return 1;
+}
+
+static int tabela_realocar(Tabela *t, int novaCap)
+{
+    int ok = t->mapa ? tabela_desmapear(t, novaCap) : tabela_realocar_bloco(t, &t->dados, t->tamElem, novaCap);
+    for (int i = 0; i < t->nColunas; i++)
+        ok = tabela_realocar_bloco(t, t->colunas[i].ptr, t->colunas[i].tam, novaCap) && ok;
+    // Ao crescer so adota a nova capacidade se todos os blocos cresceram;
+    // ao encolher, um bloco que falhou apenas fica maior que o necessario
+    if (!ok && novaCap > t->cap)
+        return 0;
+    t->cap = novaCap;
+    return 1;
+}
+
+// Registra um vetor paralelo que passa a acompanhar a capacidade da tabela
+static int tabela_adicionar_coluna(Tabela *t, void **ptr, size_t tam)
+{
+    if (t->nColunas == TABELA_MAX_COLUNAS)
+        return 0;
+    if (t->cap > 0)
+    {
+        void *p = realocar(*ptr, (size_t)t->cap * tam);
+        if (!p)
+            return 0;
+        *ptr = p;
+    }
+    t->colunas[t->nColunas].ptr = ptr;
+    t->colunas[t->nColunas].tam = tam;
+    t->nColunas++;
+    return 1;
+}
+
+// Reserva explicita para cargas em lote: garante espaco para 'minimo' elementos
+static int tabela_reservar(Tabela *t, int minimo)
+{
+    if (!idx_reservar(&t->pk, minimo))
+        return 0;
+    if (minimo <= t->cap)
+        return 1;
+    return tabela_realocar(t, minimo < TABELA_CAP_MIN ? TABELA_CAP_MIN : minimo);
+}
+
+static int tabela_garantir(Tabela *t, int extra)
+{
+    if (t->n + extra <= t->cap)
+        return 1;
+    int novo = t->cap < TABELA_CAP_MIN ? TABELA_CAP_MIN : t->cap;
+    while (novo < t->n + extra)
+        novo *= 2;
+    return tabela_realocar(t, novo);
+}
+
+// Histerese: encolhe so quando 3/4 da capacidade estao livres
+static void tabela_ajustar(Tabela *t)
+{
+    // Tabela mapeada nao ocupa heap: encolher significaria copiar tudo
+    if (t->mapa || t->cap <= TABELA_CAP_MIN || t->n >= t->cap / 4)
+        return;
+    int novo = t->cap / 2;
+    if (novo < TABELA_CAP_MIN)
+        novo = TABELA_CAP_MIN;
+    tabela_realocar(t, novo); // se falhar, segue com o bloco maior
+}
+
+static int tabela_chave(const Tabela *t, int idx)
+{
+    const char *rec = (const char *)t->dados + (size_t)idx * t->tamElem;
+    int chave;
+    memcpy(&chave, rec + t->offChave, sizeof(int));
+    return chave;
+}
+
+static int tabela_buscar(const Tabela *t, int chave)
+{
+    return idx_buscar(&t->pk, chave);
+}
+
+// Acrescenta uma copia de 'elem' no fim e indexa a chave; devolve a posicao ou -1
+static int tabela_anexar(Tabela *t, const void *elem)
+{
+    if (!tabela_garantir(t, 1))
+        return -1;
+    memcpy((char *)t->dados + (size_t)t->n * t->tamElem, elem, t->tamElem);
+    if (!idx_inserir(&t->pk, tabela_chave(t, t->n), t->n))
+        return -1;
+    tabela_marcar(t, t->n);
+    return t->n++;
+}
+
+static int tabela_vivo(const Tabela *t, int idx)
+{
+    return tabela_chave(t, idx) != CHAVE_REMOVIDA;
+}
+
+static int tabela_ativos(const Tabela *t)
+{
+    return t->n - t->nRemovidos;
+}
+
+// Exclusao O(1): marca lapide na chave e tira do indice. As posicoes dos
+// demais registros nao mudam; o espaco volta na compactacao.
+static void tabela_remover(Tabela *t, int idx)
+{
+    int lapide = CHAVE_REMOVIDA;
+    idx_remover(&t->pk, tabela_chave(t, idx));
+    memcpy((char *)t->dados + (size_t)idx * t->tamElem + t->offChave, &lapide, sizeof(int));
+    t->nRemovidos++;
+    tabela_marcar(t, idx);
+}
+
+// Vale a pena compactar quando ao menos metade das posicoes e lapide:
+// cada compactacao O(n) paga por n/2 exclusoes (custo amortizado O(1))
+static int tabela_precisa_compactar(const Tabela *t)
+{
+    return t->nRemovidos > TABELA_CAP_MIN && t->nRemovidos * 2 >= t->n;
+}
+
+// Junta os registros vivos no inicio (ordem preservada), levando as colunas
+// junto, e corrige o indice primario no lugar (sem alocar, nao falha). Indices secundarios guardam chaves e
+// nao precisam mudar.
+static void tabela_compactar(Tabela *t)
+{
+    if (t->nRemovidos == 0)
+        return;
+    char *base = (char *)t->dados;
+    int j = 0;
+    for (int i = 0; i < t->n; i++)
+    {
+        if (!tabela_vivo(t, i))
+            continue;
+        if (i != j)
+        {
+            memcpy(base + (size_t)j * t->tamElem, base + (size_t)i * t->tamElem, t->tamElem);
+            for (int c = 0; c < t->nColunas; c++)
+            {
+                char *col = (char *)*t->colunas[c].ptr;
+                size_t tam = t->colunas[c].tam;
+                memcpy(col + (size_t)j * tam, col + (size_t)i * tam, tam);
+            }
+            idx_atualizar(&t->pk, tabela_chave(t, j), j); // chave ja indexada: nao aloca
+        }
+        j++;
+    }
+    t->n = j;
+    t->nRemovidos = 0;
+    tabela_esquecer_arquivo(t);
+    tabela_ajustar(t);
+}
+
+// Reconstroi o indice da chave primaria a partir do vetor (apos carga)
+static int tabela_reindexar(Tabela *t)
+{
+    if (!idx_reservar(&t->pk, t->n))
+        return 0;
+    idx_limpar(&t->pk);
+    t->nRemovidos = 0;
+    for (int i = 0; i < t->n; i++)
+    {
+        if (!tabela_vivo(t, i))
+        {
+            t->nRemovidos++;
+            continue;
+        }
+        if (!idx_inserir(&t->pk, tabela_chave(t, i), i))
+            return 0;
+    }
+    return 1;
+}
+
+static void tabela_limpar(Tabela *t)
+{
+    t->n = 0;
+    t->nRemovidos = 0;
+    idx_limpar(&t->pk);
+    tabela_esquecer_arquivo(t);
+}
+
+// Devolve o bloco de registros (heap ou mapa) e zera a tabela; colunas ficam
+static void tabela_soltar_dados(Tabela *t)
+{
+#ifdef CLINICA_MMAP
+    if (t->mapa)
+        munmap(t->mapa, t->tamMapa);
+    else
+#endif
+        free(t->dados);
+    t->dados = NULL;
+    t->mapa = NULL;
+    t->tamMapa = 0;
+    t->n = 0;
+    t->cap = 0;
+    t->nRemovidos = 0;
+    tabela_esquecer_arquivo(t);
+}
+
+// Devolve tudo, colunas inclusive (que deixam de ser registradas)
+static void tabela_liberar(Tabela *t)
+{
+    for (int c = 0; c < t->nColunas; c++)
+    {
+        free(*t->colunas[c].ptr);
+        *t->colunas[c].ptr = NULL;
+    }
+    t->nColunas = 0;
+    tabela_soltar_dados(t);
+    idx_liberar(&t->pk);
+}
+
+// ======== Buscas ========
+static int encontrar_indice_animal_por_id(int id)
+{
+    g_metThread.buscas++;
+    return tabela_buscar(&g_tabAnimais, id);
+}
+static int encontrar_indice_veterinario_por_crm(int crm)
+{
+    g_metThread.buscas++;
+    return tabela_buscar(&g_tabVets, crm);
+}
+static int encontrar_indice_consulta_por_id(int id)
+{
+    g_metThread.buscas++;
+    return tabela_buscar(&g_tabCons, id);
+}
+// Para ids vindos dos indices secundarios (sempre existentes)
+static const Consulta *consulta_por_id(int id)
+{
+    return &g_consultas[encontrar_indice_consulta_por_id(id)];
+}
+// Integridade referencial em O(1): tamanho da lista reversa
+static int tem_consulta_para_animal(int idAnimal)
+{
+    return rev_contar(&g_consPorAnimal, idAnimal) > 0;
+}
+static int tem_consulta_para_vet(int crm)
+{
+    return rev_contar(&g_consPorVet, crm) > 0;
+}
+
+// ======== Log de escrita antecipada (WAL) ========
+// Toda alteracao feita pelas funcoes do nucleo vira um registro no fim de
+// clinica.wal. Os registros se acumulam em memoria e vao para o disco com um
+// unico fsync por grupo (wal_sincronizar), chamado antes de cada nova leitura
+// de opcao dos menus. Na partida o log e reaplicado sobre os .bin (o ultimo
+// checkpoint); o checkpoint regrava os .bin e zera o log.
+#define WAL_MAGICO 0x4C415743 // "CWAL"
+#define WAL_VERSAO 1
+#define WAL_BUF_TAM (64 * 1024)
+#define WAL_CHECKPOINT_BYTES (8L * 1024 * 1024) // checkpoint automatico acima disso
+
+// Tabelas e operacoes gravadas no log
+#define WAL_ANIMAIS 0
+#define WAL_VETS 1
+#define WAL_CONS 2
+#define WAL_TODAS 3
+#define WAL_GRAVAR 1   // registro completo (inclui ou substitui pela chave)
+#define WAL_EXCLUIR 2  // exclusao pela chave
+#define WAL_EXPURGAR 3 // consultas anteriores a 'chave' (AAAAMMDD)
+#define WAL_LIMPAR 4   // esvazia todas as tabelas
+
+typedef struct
+{
+    unsigned soma; // FNV-1a dos demais campos e do registro que vem em seguida
+    int tabela;
+    int op;
+    int chave;
+} RegistroWal; // seguido do registro completo quando op == WAL_GRAVAR
+
+static FILE *g_wal = NULL;
+static unsigned char g_walBuf[WAL_BUF_TAM];
+static size_t g_walUsado = 0;     // bytes no buffer ainda nao escritos
+static long g_walBytes = 0;       // tamanho do log desde o ultimo checkpoint
+static int g_walPendente = 0;     // escrito mas ainda sem fsync
+static int g_walReproduzindo = 0; // reaplicando o log: nada e registrado de novo
+static int g_walErro = 0;
+
+static unsigned soma_bytes(unsigned h, const void *p, size_t n)
+{
+    const unsigned char *b = (const unsigned char *)p;
+    for (size_t i = 0; i < n; i++)
+        h = (h ^ b[i]) * 16777619u; // FNV-1a
+    return h;
+}
+
+static unsigned soma_registro_wal(const RegistroWal *r, const void *dados, size_t tam)
+{
+    unsigned h = soma_bytes(2166136261u, &r->tabela, sizeof(RegistroWal) - offsetof(RegistroWal, tabela));
+    return soma_bytes(h, dados, tam);
+}
+
+// Garante que o que ja foi escrito no arquivo chegou ao disco
+static int sincronizar_arquivo(FILE *f)
+{
+    if (fflush(f) != 0)
+        return 0;
+#ifdef _WIN32
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+
+static int truncar_arquivo(FILE *f, long tam)
+{
+    fflush(f);
+#ifdef _WIN32
+    return _chsize(_fileno(f), tam) == 0;
+#else
+    return ftruncate(fileno(f), (off_t)tam) == 0;
+#endif
+}
+
+// Passa o buffer para o arquivo (sem fsync)
+static int wal_descarregar()
+{
+    if (g_walUsado == 0)
+        return 1;
+    if (fwrite(g_walBuf, 1, g_walUsado, g_wal) != g_walUsado)
+    {
+        g_walErro = 1;
+        return 0;
+    }
+    contar_gravados(&g_bytesLog, (long long)g_walUsado);
+    g_walUsado = 0;
+    g_walPendente = 1;
+    return 1;
+}
+
+// Commit em grupo: tudo que foi registrado desde a ultima chamada, um fsync so
+static int wal_sincronizar()
+{
+    if (!g_wal)
+        return 0;
+    if (g_walUsado == 0 && !g_walPendente)
+        return !g_walErro; // nada a fazer: nao entra nas metricas
+    Medicao m = metrica_iniciar();
+    int ok = wal_descarregar();
+    if (ok && g_walPendente)
+    {
+        ok = sincronizar_arquivo(g_wal);
+        if (ok)
+            g_walPendente = 0;
+        else
+            g_walErro = 1;
+    }
+    metrica_registrar(MET_SINCRONIZAR_LOG, &m, 0);
+    return ok && !g_walErro;
+}
+
+static void wal_registrar(int tabela, int op, int chave, const void *dados, size_t tam)
+{
+    if (!g_wal || g_walReproduzindo)
+        return;
+    RegistroWal r;
+    r.tabela = tabela;
+    r.op = op;
+    r.chave = chave;
+    r.soma = soma_registro_wal(&r, dados, tam);
+    if (g_walUsado + sizeof(r) + tam > WAL_BUF_TAM && !wal_descarregar())
+        return;
+    memcpy(g_walBuf + g_walUsado, &r, sizeof(r));
+    if (tam > 0)
+        memcpy(g_walBuf + g_walUsado + sizeof(r), dados, tam);
+    g_walUsado += sizeof(r) + tam;
+    g_walBytes += (long)(sizeof(r) + tam);
+}
+
+// ======== Nucleo: alteracoes de animais ========
+// Devolve a posicao do novo animal ou -1 (sem memoria)
+static int inserir_animal(const Animal *a)
+{
+    Medicao m = metrica_iniciar();
+    int esp = especie_internar(a->especie);
+    int idx = esp < 0 ? -1 : tabela_anexar(&g_tabAnimais, a);
+    if (idx >= 0)
+    {
+        g_animalEspecie[idx] = (unsigned short)esp;
+        wal_registrar(WAL_ANIMAIS, WAL_GRAVAR, a->idAnimal, a, sizeof(Animal));
+    }
+    metrica_registrar(MET_INCLUIR, &m, 1);
+    return idx;
+}
+
+// Passa as consultas do animal idx (lista e receita) de uma especie para outra.
+// Primeiro todas entram na lista e no agregado da especie nova (o que pode
+// faltar memoria); sem memoria, desfaz o que entrou e nada muda. So depois
+// saem da antiga e a receita troca de lado, o que nunca aloca.
+static int trocar_especie_das_consultas(int idx, int espAntiga, int espNova)
+{
+    const ListaIds *l = rev_lista(&g_consPorAnimal, g_animais[idx].idAnimal);
+    int n = l ? l->n : 0;
+    int k = 0;
+    if (n > 0 && agregado_somar(&g_agrPorEspecie, espNova, 0, 0))
+        while (k < n && rev_adicionar(&g_consPorEspecie, espNova, l->ids[k]))
+            k++;
+    if (k < n)
+    {
+        while (k-- > 0)
+            rev_remover(&g_consPorEspecie, espNova, l->ids[k]);
+        return 0;
+    }
+    for (k = 0; k < n; k++)
+    {
+        long long c = centavos(g_consValor[encontrar_indice_consulta_por_id(l->ids[k])]);
+        rev_remover(&g_consPorEspecie, espAntiga, l->ids[k]);
+        agregado_somar(&g_agrPorEspecie, espAntiga, -c, -1);
+        agregado_somar(&g_agrPorEspecie, espNova, c, 1);
+    }
+    return 1;
+}
+
+// Substitui o registro da posicao idx; o idAnimal nao muda.
+// Se a especie mudar, as consultas do animal (e sua receita) trocam de especie.
+static int alterar_animal(int idx, const Animal *novo)
+{
+    Medicao m = metrica_iniciar();
+    int espAntiga = g_animalEspecie[idx];
+    int espNova = especie_internar(novo->especie);
+    int ok = espNova >= 0 && (espNova == espAntiga || trocar_especie_das_consultas(idx, espAntiga, espNova));
+    if (ok)
+    {
+        g_animalEspecie[idx] = (unsigned short)espNova;
+        int id = g_animais[idx].idAnimal;
+        g_animais[idx] = *novo;
+        g_animais[idx].idAnimal = id;
+        tabela_marcar(&g_tabAnimais, idx);
+        wal_registrar(WAL_ANIMAIS, WAL_GRAVAR, id, &g_animais[idx], sizeof(Animal));
+    }
+    metrica_registrar(MET_ALTERAR, &m, 1);
+    return ok;
+}
+
+// So e chamado para animais sem consultas (integridade verificada antes)
+static void excluir_animal(int idx)
+{
+    Medicao m = metrica_iniciar();
+    wal_registrar(WAL_ANIMAIS, WAL_EXCLUIR, g_animais[idx].idAnimal, NULL, 0);
+    tabela_remover(&g_tabAnimais, idx);
+    metrica_registrar(MET_EXCLUIR, &m, 1);
+}
+
+// ======== Nucleo: alteracoes de veterinarios ========
+// Devolve a posicao do novo veterinario ou -1 (sem memoria)
+static int inserir_vet(const Veterinario *v)
+{
+    Medicao m = metrica_iniciar();
+    int idx = tabela_anexar(&g_tabVets, v);
+    if (idx >= 0)
+        wal_registrar(WAL_VETS, WAL_GRAVAR, v->crmVet, v, sizeof(Veterinario));
+    metrica_registrar(MET_INCLUIR, &m, 1);
+    return idx;
+}
+
+// Substitui o registro da posicao idx; o CRM nao muda
+static void alterar_vet(int idx, const Veterinario *novo)
+{
+    Medicao m = metrica_iniciar();
+    int crm = g_vets[idx].crmVet;
+    g_vets[idx] = *novo;
+    g_vets[idx].crmVet = crm;
+    tabela_marcar(&g_tabVets, idx);
+    wal_registrar(WAL_VETS, WAL_GRAVAR, crm, &g_vets[idx], sizeof(Veterinario));
+    metrica_registrar(MET_ALTERAR, &m, 1);
+}
+
+// So e chamado para veterinarios sem consultas (integridade verificada antes)
+static void excluir_vet(int idx)
+{
+    Medicao m = metrica_iniciar();
+    wal_registrar(WAL_VETS, WAL_EXCLUIR, g_vets[idx].crmVet, NULL, 0);
+    tabela_remover(&g_tabVets, idx);
+    metrica_registrar(MET_EXCLUIR, &m, 1);
+}
+
+// ======== Nucleo: alteracoes de consultas (mantem os indices) ========
+// Especie do animal referenciado (-1 se o animal nao existe)
+static int especie_do_animal(int idAnimal)
+{
+    int ia = encontrar_indice_animal_por_id(idAnimal);
+    return ia < 0 ? -1 : g_animalEspecie[ia];
+}
+
+// Copia o registro idx para as colunas; 'data' ja convertida por quem chama
+static void espelhar_consulta(int idx, int data)
+{
+    const Consulta *c = &g_consultas[idx];
+    g_consId[idx] = c->idConsulta;
+    g_consAnimal[idx] = c->idAnimal;
+    g_consCrm[idx] = c->crmVet;
+    g_consData[idx] = data;
+    g_consValor[idx] = c->valor;
+}
+
+// Mesmo que tabela_vivo(&g_tabCons, idx), lendo so a coluna de ids
+static int consulta_viva(int idx)
+{
+    return g_consId[idx] != CHAVE_REMOVIDA;
+}
+
+// Soma (sinal = 1) ou tira (sinal = -1) a consulta idx dos agregados,
+// pelas colunas atuais; tirar nunca aloca
+static int agregar_consulta(int idx, int sinal)
+{
+    long long c = sinal * centavos(g_consValor[idx]);
+    int esp = especie_do_animal(g_consAnimal[idx]);
+    int mes = g_consData[idx] < 0 ? -1 : g_consData[idx] / 100;
+    return agregado_somar(&g_agrPorVet, g_consCrm[idx], c, sinal) &&
+           (esp < 0 || agregado_somar(&g_agrPorEspecie, esp, c, sinal)) &&
+           agregado_somar(&g_agrPorMes, mes, c, sinal);
+}
+
+static int indexar_consulta(int idx)
+{
+    int esp = especie_do_animal(g_consAnimal[idx]);
+    return rev_adicionar(&g_consPorAnimal, g_consAnimal[idx], g_consId[idx]) &&
+           rev_adicionar(&g_consPorVet, g_consCrm[idx], g_consId[idx]) &&
+           (esp < 0 || rev_adicionar(&g_consPorEspecie, esp, g_consId[idx]));
+}
+static void desindexar_consulta(int idx)
+{
+    rev_remover(&g_consPorAnimal, g_consAnimal[idx], g_consId[idx]);
+    rev_remover(&g_consPorVet, g_consCrm[idx], g_consId[idx]);
+    rev_remover(&g_consPorEspecie, especie_do_animal(g_consAnimal[idx]), g_consId[idx]);
+}
+
+// Monta os indices secundarios e os agregados (vazios) a partir das colunas,
+// deixando de fora as consultas com data valida anterior a 'corte'
+static int indexar_consultas_desde(int corte)
+{
+    ChaveData *chaves = (ChaveData *)malloc((size_t)(g_nCons > 0 ? g_nCons : 1) * sizeof(ChaveData));
+    if (!chaves)
+        return 0;
+    int m = 0;
+    for (int i = 0; i < g_nCons; i++)
+    {
+        if (!consulta_viva(i) || (g_consData[i] >= 0 && g_consData[i] < corte))
+            continue;
+        chaves[m].data = g_consData[i];
+        chaves[m].id = g_consId[i];
+        m++;
+        if (!indexar_consulta(i) || !agregar_consulta(i, 1))
+        {
+            free(chaves);
+            return 0;
+        }
+    }
+    int ok = idxdata_reconstruir(&g_consPorData, chaves, m);
+    free(chaves);
+    return ok;
+}
+
+// Reconstroi os indices secundarios e os agregados a partir das colunas
+static int reindexar_consultas()
+{
+    rev_liberar(&g_consPorAnimal);
+    rev_liberar(&g_consPorVet);
+    rev_liberar(&g_consPorEspecie);
+    agregados_liberar(&g_agrPorVet);
+    agregados_liberar(&g_agrPorEspecie);
+    agregados_liberar(&g_agrPorMes);
+    return indexar_consultas_desde(0);
+}
+
+// Garante as entradas dos agregados para o CRM, a especie e o mes de 'novo'
+// (soma zero), para que somar a consulta nova ou alterada nao precise alocar
+static int reservar_agregados(const Consulta *novo, int dataNova)
+{
+    int esp = especie_do_animal(novo->idAnimal);
+    return agregado_somar(&g_agrPorVet, novo->crmVet, 0, 0) &&
+           (esp < 0 || agregado_somar(&g_agrPorEspecie, esp, 0, 0)) &&
+           agregado_somar(&g_agrPorMes, dataNova < 0 ? -1 : dataNova / 100, 0, 0);
+}
+
+// Tabela, colunas, indices por FK, agregados e log. O indice de datas fica com
+// quem chama: uma chave por vez (inserir_consulta) ou em lote (importacao).
+// Sem memoria, desfaz o que ja entrou (o registro vira lapide e sai do indice
+// primario) e nada vai para o log: o id pode ser usado de novo.
+static int anexar_consulta(const Consulta *c)
+{
+    int data = data_to_int(c->dataConsulta);
+    if (!reservar_agregados(c, data))
+        return -1;
+    int idx = tabela_anexar(&g_tabCons, c);
+    if (idx < 0)
+        return -1;
+    espelhar_consulta(idx, data);
+    if (!indexar_consulta(idx))
+    {
+        desindexar_consulta(idx);
+        tabela_remover(&g_tabCons, idx);
+        g_consId[idx] = CHAVE_REMOVIDA;
+        return -1;
+    }
+    agregar_consulta(idx, 1); // entradas ja reservadas: nao aloca
+    wal_registrar(WAL_CONS, WAL_GRAVAR, c->idConsulta, c, sizeof(Consulta));
+    return idx;
+}
+
+// Devolve a posicao da nova consulta ou -1 (sem memoria). O espaco no indice
+// de datas e reservado antes, para a insercao nele nao falhar depois do log.
+static int inserir_consulta(const Consulta *c)
+{
+    Medicao m = metrica_iniciar();
+    int idx = idxdata_reservar(&g_consPorData, g_consPorData.n + 1) ? anexar_consulta(c) : -1;
+    if (idx >= 0)
+        idxdata_inserir(&g_consPorData, g_consData[idx], c->idConsulta);
+    metrica_registrar(MET_INCLUIR, &m, 1);
+    return idx;
+}
+
+// Leva a consulta idx, nos indices, para o animal, o CRM e a data 'dataNova'
+// de 'novo'. Primeiro entra nas listas novas (o que pode faltar memoria) e so
+// depois sai das antigas (o que nunca falha): sem memoria, desfaz o que ja
+// entrou e a consulta continua onde estava. As colunas nao mudam aqui.
+static int mover_indices_consulta(int idx, const Consulta *novo, int dataNova)
+{
+    const Consulta *atual = &g_consultas[idx];
+    int id = atual->idConsulta;
+    int trocaAnimal = novo->idAnimal != atual->idAnimal;
+    int espAntiga = especie_do_animal(atual->idAnimal);
+    int espNova = especie_do_animal(novo->idAnimal);
+    int trocaEspecie = trocaAnimal && espAntiga != espNova && espNova >= 0;
+    int trocaVet = novo->crmVet != atual->crmVet;
+    int trocaData = dataNova != g_consData[idx];
+
+    int ok = !trocaAnimal || rev_adicionar(&g_consPorAnimal, novo->idAnimal, id);
+    int okEsp = ok && (!trocaEspecie || rev_adicionar(&g_consPorEspecie, espNova, id));
+    int okVet = okEsp && (!trocaVet || rev_adicionar(&g_consPorVet, novo->crmVet, id));
+    int okData = okVet && (!trocaData || idxdata_inserir(&g_consPorData, dataNova, id));
+    if (!okData)
+    {
+        if (okVet && trocaVet)
+            rev_remover(&g_consPorVet, novo->crmVet, id);
+        if (okEsp && trocaEspecie)
+            rev_remover(&g_consPorEspecie, espNova, id);
+        if (ok && trocaAnimal)
+            rev_remover(&g_consPorAnimal, novo->idAnimal, id);
+        return 0;
+    }
+
+    if (trocaAnimal)
+    {
+        rev_remover(&g_consPorAnimal, atual->idAnimal, id);
+        if (espAntiga != espNova)
+            rev_remover(&g_consPorEspecie, espAntiga, id);
+    }
+    if (trocaVet)
+        rev_remover(&g_consPorVet, atual->crmVet, id);
+    if (trocaData)
+        idxdata_remover(&g_consPorData, g_consData[idx], id);
+    return 1;
+}
+
+// Substitui o registro da posicao idx; o idConsulta nao muda. Tudo o que pode
+// falhar (entradas dos agregados e dos indices) vem antes de mexer no
+// registro: sem memoria, nada muda e nada vai para o log.
+static int alterar_consulta(int idx, const Consulta *novo)
+{
+    Medicao m = metrica_iniciar();
+    Consulta *atual = &g_consultas[idx];
+    int data = strcmp(novo->dataConsulta, atual->dataConsulta) != 0 ? data_to_int(novo->dataConsulta) : g_consData[idx];
+    int ok = reservar_agregados(novo, data) && mover_indices_consulta(idx, novo, data);
+    if (ok)
+    {
+        int id = atual->idConsulta;
+        agregar_consulta(idx, -1); // tirar nunca aloca
+        *atual = *novo;
+        atual->idConsulta = id;
+        espelhar_consulta(idx, data);
+        agregar_consulta(idx, 1); // entradas ja reservadas: nao aloca
+        tabela_marcar(&g_tabCons, idx);
+        wal_registrar(WAL_CONS, WAL_GRAVAR, id, atual, sizeof(Consulta));
+    }
+    metrica_registrar(MET_ALTERAR, &m, 1);
+    return ok;
+}
+
+static void excluir_consulta(int idx)
+{
+    Medicao m = metrica_iniciar();
+    wal_registrar(WAL_CONS, WAL_EXCLUIR, g_consultas[idx].idConsulta, NULL, 0);
+    desindexar_consulta(idx);
+    agregar_consulta(idx, -1);
+    idxdata_remover(&g_consPorData, g_consData[idx], g_consId[idx]);
+    tabela_remover(&g_tabCons, idx);
+    g_consId[idx] = CHAVE_REMOVIDA;
+    metrica_registrar(MET_EXCLUIR, &m, 1);
+}
+
+// Indices secundarios e agregados das consultas, fora do estado
+typedef struct
+{
+    IndiceReverso porAnimal, porVet, porEspecie;
+    TabelaAgregados agrPorVet, agrPorEspecie, agrPorMes;
+    IndiceData porData;
+} IndicesConsultas;
+
+// Troca os indices do estado pelos de 'x'
+static void indices_trocar(IndicesConsultas *x)
+{
+    IndicesConsultas atual = {g_consPorAnimal, g_consPorVet, g_consPorEspecie, g_agrPorVet,
+                              g_agrPorEspecie, g_agrPorMes, g_consPorData};
+    g_consPorAnimal = x->porAnimal;
+    g_consPorVet = x->porVet;
+    g_consPorEspecie = x->porEspecie;
+    g_agrPorVet = x->agrPorVet;
+    g_agrPorEspecie = x->agrPorEspecie;
+    g_agrPorMes = x->agrPorMes;
+    g_consPorData = x->porData;
+    *x = atual;
+}
+
+static void indices_liberar(IndicesConsultas *x)
+{
+    rev_liberar(&x->porAnimal);
+    rev_liberar(&x->porVet);
+    rev_liberar(&x->porEspecie);
+    agregados_liberar(&x->agrPorVet);
+    agregados_liberar(&x->agrPorEspecie);
+    agregados_liberar(&x->agrPorMes);
+    idxdata_liberar(&x->porData);
+}
+
+// Exclusao em lote das consultas com data valida anterior a 'corte'. Os
+// indices secundarios sao refeitos uma unica vez, em vez de uma remocao
+// ordenada por linha, e ao lado dos atuais, antes de excluir qualquer coisa:
+// sem memoria, os atuais voltam e nada muda nem vai para o log. So depois
+// cada registro vira lapide em O(1).
+static int expurgar_consultas_antes_de(int corte)
+{
+    Medicao m = metrica_iniciar();
+    int ini = idxdata_posicao(&g_consPorData, 0, INT_MIN);
+    int fim = idxdata_posicao(&g_consPorData, corte, INT_MIN);
+    if (fim <= ini)
+    {
+        metrica_registrar(MET_EXCLUIR, &m, 0);
+        return 0;
+    }
+    IndicesConsultas antigos;
+    memset(&antigos, 0, sizeof(antigos));
+    indices_trocar(&antigos); // o estado fica com indices vazios
+    if (!indexar_consultas_desde(corte))
+    {
+        indices_trocar(&antigos);
+        indices_liberar(&antigos); // os novos, incompletos
+        metrica_registrar(MET_EXCLUIR, &m, 0);
+        return -1;
+    }
+
+    wal_registrar(WAL_CONS, WAL_EXPURGAR, corte, NULL, 0);
+    for (int k = ini; k < fim; k++)
+    {
+        int idx = encontrar_indice_consulta_por_id(antigos.porData.itens[k].id);
+        tabela_remover(&g_tabCons, idx);
+        g_consId[idx] = CHAVE_REMOVIDA;
+    }
+    indices_liberar(&antigos);
+    metrica_registrar(MET_EXCLUIR, &m, fim - ini);
+    return fim - ini;
+}
+
+// Esvazia as tres tabelas, os indices e o dicionario de especies
+static void limpar_tudo()
+{
+    wal_registrar(WAL_TODAS, WAL_LIMPAR, 0, NULL, 0);
+    tabela_limpar(&g_tabAnimais);
+    tabela_limpar(&g_tabVets);
+    tabela_limpar(&g_tabCons);
+    rev_liberar(&g_consPorAnimal);
+    rev_liberar(&g_consPorVet);
+    rev_liberar(&g_consPorEspecie);
+    idxdata_liberar(&g_consPorData);
+    agregados_liberar(&g_agrPorVet);
+    agregados_liberar(&g_agrPorEspecie);
+    agregados_liberar(&g_agrPorMes);
+    especies_liberar();
+    g_nextIdAnimal = 1;
+    g_nextIdConsulta = 1;
+}
+
+// Passo de manutencao separado das exclusoes: compacta quem acumulou lapides
+static void compactar_tabelas(int forcar)
+{
+    Tabela *tabs[3] = {&g_tabAnimais, &g_tabVets, &g_tabCons};
+    for (int i = 0; i < 3; i++)
+        if (forcar || tabela_precisa_compactar(tabs[i]))
+            tabela_compactar(tabs[i]);
+}
+
+// ======== Persistncia ========
+// Formato dos .bin (versao 2), todos os inteiros em little-endian:
+//   0  u32 magico "CLIN"        4  u32 versao           8  u32 tamanho do registro
+//  12  u32 flags               16  u32 posicoes (qtd)   20  i32 proximo id
+//  24  u32 capBlocos           28  u32 offRegistros     32  u32 tamanho do bloco
+//  36..59 zero                 60  u32 CRC32C dos bytes 0..59
+//  64  capBlocos x u32: CRC32C de cada bloco de PAGINA_TAM bytes dos registros
+//  offRegistros (multiplo de 64): os registros, na ordem das posicoes da tabela
+// A area de CRCs e reservada com folga para que registros novos caibam sem
+// mover os registros de lugar. Os registros seguem o layout de LAYOUT_FIXO e
+// ficam alinhados, prontos para uso direto do mapa.
+//
+// Formatos antigos (convertidos na partida): [qtd][registros] e
+// [-1][qtd][registros].
+#define ARQ_MAGICO 0x4E494C43u // "CLIN"
+#define ARQ_VERSAO 2
+#define ARQ_CAB_TAM 64
+#define ARQ_GRAVANDO 1u // flag: gravacao parcial em andamento
+#define ARQ_BLOCOS_MIN 16
+#define ARQ_MARCA_V1 (-1)
+
+typedef struct
+{
+    uint32_t versao;
+    uint32_t tamRegistro;
+    uint32_t flags;
+    uint32_t qtd;
+    int32_t proximoId;
+    uint32_t capBlocos;
+    uint32_t offRegistros;
+    uint32_t tamBloco;
+} CabecalhoArq;
+
+static int g_arquivosLegados = 0; // carregados no formato antigo
+
+static void escrever_u32(unsigned char *p, uint32_t v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static uint32_t ler_u32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void cabecalho_codificar(const CabecalhoArq *c, unsigned char *b)
+{
+    memset(b, 0, ARQ_CAB_TAM);
+    escrever_u32(b, ARQ_MAGICO);
+    escrever_u32(b + 4, c->versao);
+    escrever_u32(b + 8, c->tamRegistro);
+    escrever_u32(b + 12, c->flags);
+    escrever_u32(b + 16, c->qtd);
+    escrever_u32(b + 20, (uint32_t)c->proximoId);
+    escrever_u32(b + 24, c->capBlocos);
+    escrever_u32(b + 28, c->offRegistros);
+    escrever_u32(b + 32, c->tamBloco);
+    escrever_u32(b + 60, crc32c(b, 60));
+}
+
+// Confere magico, CRC, versao e se o arquivo e desta tabela
+static int cabecalho_decodificar(const unsigned char *b, const Tabela *t, CabecalhoArq *c)
+{
+    if (ler_u32(b) != ARQ_MAGICO || ler_u32(b + 60) != crc32c(b, 60))
+        return 0;
+    c->versao = ler_u32(b + 4);
+    c->tamRegistro = ler_u32(b + 8);
+    c->flags = ler_u32(b + 12);
+    c->qtd = ler_u32(b + 16);
+    c->proximoId = (int32_t)ler_u32(b + 20);
+    c->capBlocos = ler_u32(b + 24);
+    c->offRegistros = ler_u32(b + 28);
+    c->tamBloco = ler_u32(b + 32);
+    return c->versao == ARQ_VERSAO && c->tamRegistro == t->tamElem && c->tamBloco == PAGINA_TAM &&
+           c->qtd <= INT_MAX && (uint64_t)c->qtd * t->tamElem <= (uint64_t)c->capBlocos * PAGINA_TAM &&
+           c->offRegistros % 64 == 0 && c->offRegistros >= ARQ_CAB_TAM + (uint64_t)c->capBlocos * 4;
+}
+
+static size_t blocos_para(const Tabela *t, int n)
+{
+    return ((size_t)n * t->tamElem + PAGINA_TAM - 1) / PAGINA_TAM;
+}
+
+// CRC do bloco b considerando as posicoes [0, n)
+static uint32_t crc_bloco(const Tabela *t, size_t b, int n)
+{
+    size_t usados = (size_t)n * t->tamElem;
+    size_t ini = b * PAGINA_TAM;
+    size_t fim = ini + PAGINA_TAM < usados ? ini + PAGINA_TAM : usados;
+    return crc32c((const char *)t->dados + ini, fim - ini);
+}
+
+static void preencher_cabecalho(const Tabela *t, CabecalhoArq *c, uint32_t flags, int qtd, int proximoId)
+{
+    c->versao = ARQ_VERSAO;
+    c->tamRegistro = (uint32_t)t->tamElem;
+    c->flags = flags;
+    c->qtd = (uint32_t)qtd;
+    c->proximoId = proximoId;
+    c->capBlocos = (uint32_t)t->capBlocos;
+    c->offRegistros = (uint32_t)t->offRegistros;
+    c->tamBloco = PAGINA_TAM;
+}
+
+// Troca o arquivo de uma vez: o antigo continua valido para quem o tem mapeado
+static int substituir_arquivo(const char *tmp, const char *path)
+{
+#ifdef _WIN32
+    remove(path);
+#endif
+    return rename(tmp, path) == 0;
+}
+
+// Regravacao completa, em arquivo temporario trocado de uma vez pelo antigo.
+// As lapides sao compactadas antes, para o arquivo sair igual a memoria, e a
+// area de CRCs e reservada com o dobro do necessario.
+static int salvar_completo(Tabela *t, const char *path, int proximoId)
+{
+    tabela_compactar(t);
+    size_t nBlocos = blocos_para(t, t->n);
+    int capBlocos = nBlocos * 2 > ARQ_BLOCOS_MIN ? (int)(nBlocos * 2) : ARQ_BLOCOS_MIN;
+    uint32_t *crcs = (uint32_t *)calloc((size_t)capBlocos, sizeof(uint32_t));
+    unsigned char *area = (unsigned char *)calloc((size_t)capBlocos, 4);
+    if (!crcs || !area)
+    {
+        free(crcs);
+        free(area);
+        return 0;
+    }
+    for (size_t b = 0; b < nBlocos; b++)
+    {
+        crcs[b] = crc_bloco(t, b, t->n);
+        escrever_u32(area + 4 * b, crcs[b]);
+    }
+
+    long offRegistros = (ARQ_CAB_TAM + 4L * capBlocos + 63) / 64 * 64;
+    tabela_esquecer_arquivo(t);
+    t->capBlocos = capBlocos;
+    t->offRegistros = offRegistros;
+    CabecalhoArq c;
+    unsigned char cab[ARQ_CAB_TAM];
+    preencher_cabecalho(t, &c, 0, t->n, proximoId);
+    cabecalho_codificar(&c, cab);
+
+    char tmp[256];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    int ok = f != NULL;
+    if (ok)
+    {
+        static const unsigned char zeros[64] = {0};
+        size_t folga = (size_t)offRegistros - ARQ_CAB_TAM - 4 * (size_t)capBlocos;
+        ok = fwrite(cab, 1, ARQ_CAB_TAM, f) == ARQ_CAB_TAM &&
+             fwrite(area, 4, (size_t)capBlocos, f) == (size_t)capBlocos &&
+             (folga == 0 || fwrite(zeros, 1, folga, f) == folga) &&
+             (t->n == 0 || fwrite(t->dados, t->tamElem, t->n, f) == (size_t)t->n);
+        // O arquivo novo precisa estar no disco antes de substituir o antigo
+        if (ok && !sincronizar_arquivo(f))
+            ok = 0;
+        if (fclose(f) != 0)
+            ok = 0;
+    }
+    free(area);
+    if (!ok || !substituir_arquivo(tmp, path))
+    {
+        remove(tmp);
+        free(crcs);
+        tabela_esquecer_arquivo(t);
+        return 0;
+    }
+    contar_gravados(&g_bytesGravados, offRegistros + (long long)t->n * (long long)t->tamElem);
+    tabela_lembrar_arquivo(t, t->n);
+    t->crcs = crcs;
+    return 1;
+}
+
+static int gravar_em(FILE *f, long pos, const void *p, size_t tam)
+{
+    if (fseek(f, pos, SEEK_SET) != 0 || fwrite(p, 1, tam, f) != tam)
+        return 0;
+    contar_gravados(&g_bytesGravados, (long long)tam);
+    return 1;
+}
+
+// Recalcula e grava os CRCs dos blocos [ini, fim)
+static int gravar_crcs(Tabela *t, FILE *f, size_t ini, size_t fim)
+{
+    unsigned char buf[256];
+    while (ini < fim)
+    {
+        size_t k = fim - ini < sizeof(buf) / 4 ? fim - ini : sizeof(buf) / 4;
+        for (size_t i = 0; i < k; i++)
+        {
+            t->crcs[ini + i] = crc_bloco(t, ini + i, t->n);
+            escrever_u32(buf + 4 * i, t->crcs[ini + i]);
+        }
+        if (!gravar_em(f, ARQ_CAB_TAM + 4 * (long)ini, buf, 4 * k))
+            return 0;
+        ini += k;
+    }
+    return 1;
+}
+
+// Gravacao parcial no proprio arquivo: so as paginas marcadas, as posicoes
+// novas do fim e os CRCs desses blocos. O cabecalho e marcado como "gravando"
+// antes e limpo (com a nova contagem) depois do fsync; se cair no meio, a
+// carga aceita os blocos divergentes e o log refaz as alteracoes.
+static int salvar_paginas(Tabela *t, const char *path, int proximoId)
+{
+    if (!t->crcs || blocos_para(t, t->n) > (size_t)t->capBlocos)
+        return 0; // area de CRCs cheia: regravacao completa com mais folga
+    FILE *f = fopen(path, "r+b");
+    if (!f)
+        return 0;
+    const char *base = (const char *)t->dados;
+    size_t usados = (size_t)t->nArquivo * t->tamElem;
+    size_t nPaginas = blocos_para(t, t->nArquivo);
+    CabecalhoArq c;
+    unsigned char cab[ARQ_CAB_TAM];
+    preencher_cabecalho(t, &c, ARQ_GRAVANDO, t->nArquivo, proximoId);
+    cabecalho_codificar(&c, cab);
+    int ok = gravar_em(f, 0, cab, sizeof(cab)) && sincronizar_arquivo(f);
+
+    for (size_t p = 0; ok && p < nPaginas; p++)
+    {
+        if (!pagina_suja(t, p))
+            continue;
+        size_t q = p + 1; // junta paginas sujas vizinhas numa unica escrita
+        while (q < nPaginas && pagina_suja(t, q))
+            q++;
+        size_t ini = p * PAGINA_TAM;
+        size_t fim = q * PAGINA_TAM < usados ? q * PAGINA_TAM : usados;
+        ok = gravar_em(f, t->offRegistros + (long)ini, base + ini, fim - ini) && gravar_crcs(t, f, p, q);
+        p = q;
+    }
+    if (ok && t->n > t->nArquivo)
+        ok = gravar_em(f, t->offRegistros + (long)usados, base + usados,
+                       (size_t)(t->n - t->nArquivo) * t->tamElem) &&
+             gravar_crcs(t, f, usados / PAGINA_TAM, blocos_para(t, t->n));
+
+    preencher_cabecalho(t, &c, 0, t->n, proximoId);
+    cabecalho_codificar(&c, cab);
+    ok = ok && sincronizar_arquivo(f) && gravar_em(f, 0, cab, sizeof(cab)) && sincronizar_arquivo(f);
+    if (fclose(f) != 0)
+        ok = 0;
+    if (ok)
+        tabela_lembrar_arquivo(t, t->n);
+    return ok;
+}
+
+// Tabela sem alteracoes nao toca no disco
+static int salvar_tabela(Tabela *t, const char *path, int proximoId)
+{
+    if (!t->sujo)
+        return 1;
+    Medicao m = metrica_iniciar();
+    int ok = (t->nArquivo >= 0 && salvar_paginas(t, path, proximoId)) || salvar_completo(t, path, proximoId);
+    metrica_registrar(MET_SALVAR, &m, t->n);
+    return ok;
+}
+
+// Confere os CRCs dos blocos ja carregados/mapeados e assume o arquivo como
+// base das gravacoes parciais. 'area' = CRCs como estao no arquivo.
+static int tabela_conferir(Tabela *t, const char *path, const CabecalhoArq *c, const unsigned char *area)
+{
+    uint32_t *crcs = (uint32_t *)malloc((size_t)(c->capBlocos > 0 ? c->capBlocos : 1) * sizeof(uint32_t));
+    if (!crcs)
+        return 0;
+    int divergentes = 0;
+    size_t nBlocos = blocos_para(t, (int)c->qtd);
+    for (size_t b = 0; b < c->capBlocos; b++)
+        crcs[b] = ler_u32(area + 4 * b);
+    for (size_t b = 0; b < nBlocos; b++)
+        if (crc_bloco(t, b, (int)c->qtd) != crcs[b])
+        {
+            if (!(c->flags & ARQ_GRAVANDO))
+            {
+                aviso("Arquivo %s corrompido (bloco %lu).\n", path, (unsigned long)b);
+                free(crcs);
+                return 0;
+            }
+            divergentes++;
+        }
+    if (c->flags & ARQ_GRAVANDO)
+    {
+        // Gravacao interrompida: o log reaplica o que faltou e a proxima
+        // gravacao refaz o arquivo inteiro
+        aviso("Aviso: %s tem uma gravacao interrompida (%d bloco(s) divergente(s)).\n", path, divergentes);
+        free(crcs);
+        tabela_esquecer_arquivo(t);
+        return 1;
+    }
+    tabela_lembrar_arquivo(t, (int)c->qtd);
+    t->crcs = crcs;
+    t->capBlocos = (int)c->capBlocos;
+    t->offRegistros = (long)c->offRegistros;
+    return 1;
+}
+
+// Mapeia o arquivo (MAP_PRIVATE) e aponta a tabela direto para os registros:
+// nada e copiado na carga e o kernel so duplica uma pagina quando um registro
+// dela e alterado. Devolve 1 se mapeou, 0 para cair na leitura normal e -1
+// se o arquivo esta corrompido.
+static int tabela_mapear(Tabela *t, const char *path, int *proximoId)
+{
+#ifdef CLINICA_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= (off_t)ARQ_CAB_TAM)
+    {
+        close(fd);
+        return 0;
+    }
+    size_t tam = (size_t)st.st_size;
+    void *m = mmap(NULL, tam, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED)
+        return 0;
+
+    CabecalhoArq c;
+    if (!cabecalho_decodificar((const unsigned char *)m, t, &c) || c.qtd == 0 ||
+        tam < (size_t)c.offRegistros + (size_t)c.qtd * t->tamElem)
+    {
+        munmap(m, tam);
+        return 0; // a leitura normal diagnostica o problema
+    }
+
+    // As colunas auxiliares continuam no heap, com a capacidade da tabela
+    for (int k = 0; k < t->nColunas; k++)
+    {
+        void *p = realocar(*t->colunas[k].ptr, (size_t)c.qtd * t->colunas[k].tam);
+        if (!p)
+        {
+            munmap(m, tam);
+            return 0;
+        }
+        *t->colunas[k].ptr = p;
+    }
+    tabela_soltar_dados(t);
+    t->mapa = m;
+    t->tamMapa = tam;
+    t->dados = (char *)m + c.offRegistros;
+    t->n = (int)c.qtd;
+    t->cap = (int)c.qtd;
+    *proximoId = c.proximoId;
+    contar_lidos((long long)tam); // os CRCs a seguir passam por todas as paginas
+    return tabela_conferir(t, path, &c, (const unsigned char *)m + ARQ_CAB_TAM) ? 1 : -1;
+#else
+    (void)t;
+    (void)path;
+    (void)proximoId;
+    return 0;
+#endif
+}
+
+// Le o arquivo com uma unica reserva. Arquivo inexistente = tabela vazia.
+static int carregar_tabela(Tabela *t, const char *path, int *proximoId)
+{
+    *proximoId = 0;
+    int r = g_usarMmap ? tabela_mapear(t, path, proximoId) : 0;
+    if (r != 0)
+        return r > 0 && tabela_reindexar(t);
+
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        tabela_limpar(t);
+        return 1;
+    }
+
+    unsigned char cab[ARQ_CAB_TAM];
+    CabecalhoArq c;
+    unsigned char *area = NULL;
+    size_t lidos = fread(cab, 1, sizeof(cab), f);
+    int qtd = -1;
+    long inicio;
+    if (lidos >= 4 && ler_u32(cab) == ARQ_MAGICO)
+    {
+        if (lidos != sizeof(cab) || !cabecalho_decodificar(cab, t, &c))
+        {
+            aviso("Cabecalho invalido em %s.\n", path);
+            fclose(f);
+            return 0;
+        }
+        area = (unsigned char *)malloc((size_t)(c.capBlocos > 0 ? c.capBlocos : 1) * 4);
+        if (!area || fread(area, 4, c.capBlocos, f) != c.capBlocos)
+        {
+            free(area);
+            fclose(f);
+            return 0;
+        }
+        qtd = (int)c.qtd;
+        inicio = (long)c.offRegistros;
+        *proximoId = c.proximoId;
+    }
+    else if (lidos >= 8 && (int)ler_u32(cab) == ARQ_MARCA_V1)
+    {
+        qtd = (int)ler_u32(cab + 4);
+        inicio = 8;
+    }
+    else if (lidos >= 4)
+    {
+        qtd = (int)ler_u32(cab);
+        inicio = 4;
+    }
+    if (qtd < 0 || fseek(f, inicio, SEEK_SET) != 0)
+    {
+        free(area);
+        fclose(f);
+        return 0;
+    }
+
+    if (t->mapa)
+        tabela_soltar_dados(t);
+    t->n = 0;
+    if (!tabela_reservar(t, qtd) || (qtd > 0 && fread(t->dados, t->tamElem, qtd, f) != (size_t)qtd))
+    {
+        free(area);
+        fclose(f);
+        return 0;
+    }
+    fclose(f);
+    t->n = qtd;
+    contar_lidos(inicio + (long long)qtd * (long long)t->tamElem);
+    int ok = 1;
+    if (area)
+        ok = tabela_conferir(t, path, &c, area);
+    else
+    {
+        tabela_esquecer_arquivo(t); // formato antigo: converte na partida
+        g_arquivosLegados++;
+    }
+    free(area);
+    return ok && tabela_reindexar(t);
+}
+
+static int salvar_animais(const char *path)
+{
+    return salvar_tabela(&g_tabAnimais, path, g_nextIdAnimal);
+}
+static int carregar_animais(const char *path)
+{
+    int proximo = 0;
+    if (!carregar_tabela(&g_tabAnimais, path, &proximo))
+        return 0;
+
+    for (int i = 0; i < g_nAnimais; i++)
+    {
+        if (!tabela_vivo(&g_tabAnimais, i))
+            continue;
+        int esp = especie_internar(g_animais[i].especie);
+        if (esp < 0)
+            return 0;
+        g_animalEspecie[i] = (unsigned short)esp;
+    }
+
+    int maxId = 0;
+    for (int i = 0; i < g_nAnimais; i++)
+        if (g_animais[i].idAnimal > maxId)
+            maxId = g_animais[i].idAnimal;
+    // O cabecalho guarda o proximo id: ids de animais excluidos nao voltam
+    g_nextIdAnimal = maxId + 1 > proximo ? maxId + 1 : proximo;
+    if (g_nextIdAnimal < 1)
+        g_nextIdAnimal = 1;
+
+    return 1;
+}
+
+static int salvar_vets(const char *path)
+{
+    return salvar_tabela(&g_tabVets, path, 0); // CRM vem de fora: sem proximo id
+}
+static int carregar_vets(const char *path)
+{
+    int proximo;
+    return carregar_tabela(&g_tabVets, path, &proximo);
+}
+
+static int salvar_cons(const char *path)
+{
+    return salvar_tabela(&g_tabCons, path, g_nextIdConsulta);
+}
+static int carregar_cons(const char *path)
+{
+    int proximo = 0;
+    if (!carregar_tabela(&g_tabCons, path, &proximo))
+        return 0;
+    // Colunas preenchidas (e datas convertidas) uma unica vez, na carga
+    for (int i = 0; i < g_nCons; i++)
+        espelhar_consulta(i, tabela_vivo(&g_tabCons, i) ? data_to_int(g_consultas[i].dataConsulta) : -1);
+    if (!reindexar_consultas())
+        return 0;
+
+    int maxId = 0;
+    for (int i = 0; i < g_nCons; i++)
+        if (g_consId[i] > maxId)
+            maxId = g_consId[i];
+    g_nextIdConsulta = maxId + 1 > proximo ? maxId + 1 : proximo;
+    if (g_nextIdConsulta < 1)
+        g_nextIdConsulta = 1;
+
+    return 1;
+}
+
+// ======== Reaplicacao do log e checkpoint ========
+typedef union
+{
+    Animal a;
+    Veterinario v;
+    Consulta c;
+} RegistroQualquer;
+
+// Tamanho dos dados que seguem o registro do log; -1 se o registro e invalido
+static long wal_tamanho_dados(const RegistroWal *r)
+{
+    static const size_t tam[3] = {sizeof(Animal), sizeof(Veterinario), sizeof(Consulta)};
+    if (r->op == WAL_LIMPAR)
+        return r->tabela == WAL_TODAS ? 0 : -1;
+    if (r->op == WAL_EXPURGAR)
+        return r->tabela == WAL_CONS ? 0 : -1;
+    if (r->tabela < WAL_ANIMAIS || r->tabela > WAL_CONS)
+        return -1;
+    if (r->op == WAL_EXCLUIR)
+        return 0;
+    return r->op == WAL_GRAVAR ? (long)tam[r->tabela] : -1;
+}
+
+// Aplica um registro do log com semantica de "upsert" pela chave, de modo que
+// reaplicar o log sobre um checkpoint mais novo chega ao mesmo estado
+static int wal_aplicar(const RegistroWal *r, const RegistroQualquer *reg)
+{
+    int idx;
+    switch (r->tabela)
+    {
+    case WAL_ANIMAIS:
+        idx = encontrar_indice_animal_por_id(r->chave);
+        if (r->op == WAL_EXCLUIR)
+        {
+            if (idx >= 0)
+                excluir_animal(idx);
+            return 1;
+        }
+        if (r->chave >= g_nextIdAnimal)
+            g_nextIdAnimal = r->chave + 1;
+        return idx >= 0 ? alterar_animal(idx, &reg->a) : inserir_animal(&reg->a) >= 0;
+    case WAL_VETS:
+        idx = encontrar_indice_veterinario_por_crm(r->chave);
+        if (r->op == WAL_EXCLUIR)
+        {
+            if (idx >= 0)
+                excluir_vet(idx);
+            return 1;
+        }
+        if (idx >= 0)
+        {
+            alterar_vet(idx, &reg->v);
+            return 1;
+        }
+        return inserir_vet(&reg->v) >= 0;
+    case WAL_CONS:
+        if (r->op == WAL_EXPURGAR)
+            return expurgar_consultas_antes_de(r->chave) >= 0;
+        idx = encontrar_indice_consulta_por_id(r->chave);
+        if (r->op == WAL_EXCLUIR)
+        {
+            if (idx >= 0)
+                excluir_consulta(idx);
+            return 1;
+        }
+        if (r->chave >= g_nextIdConsulta)
+            g_nextIdConsulta = r->chave + 1;
+        return idx >= 0 ? alterar_consulta(idx, &reg->c) : inserir_consulta(&reg->c) >= 0;
+    default:
+        limpar_tudo();
+        return 1;
+    }
+}
+
+// Abre (ou cria) o log e reaplica o que houver depois do ultimo checkpoint,
+// ate 'limite' bytes (-1 = tudo). Uma cauda incompleta (queda no meio de uma
+// escrita) e o que passar do limite sao descartados.
+// Devolve 1 ok, 0 se o log nao pode ser aberto, -1 se o log e invalido.
+static int wal_abrir(const char *path, long limite)
+{
+    int cab[2] = {WAL_MAGICO, WAL_VERSAO};
+    FILE *f = fopen(path, "r+b");
+    if (!f)
+        f = fopen(path, "w+b");
+    if (!f)
+        return 0;
+
+    // Arquivo vazio ou com o cabecalho pela metade: queda logo depois de criar
+    // o log, antes de qualquer registro. Vale como log vazio.
+    size_t lidos = fread(cab, sizeof(int), 2, f);
+    if (lidos != 2 && !ferror(f))
+    {
+        cab[0] = WAL_MAGICO;
+        cab[1] = WAL_VERSAO;
+        if (fseek(f, 0, SEEK_SET) != 0 || fwrite(cab, sizeof(int), 2, f) != 2 ||
+            !truncar_arquivo(f, (long)(2 * sizeof(int))) || !sincronizar_arquivo(f))
+        {
+            fclose(f);
+            return 0;
+        }
+        g_wal = f;
+        g_walBytes = 0;
+        return 1;
+    }
+    if (lidos != 2 || cab[0] != WAL_MAGICO || cab[1] != WAL_VERSAO)
+    {
+        fclose(f);
+        return -1;
+    }
+
+    Medicao m = metrica_iniciar();
+    long fimValido = (long)(2 * sizeof(int));
+    int aplicados = 0, ok = 1;
+    RegistroWal r;
+    RegistroQualquer reg;
+    g_walReproduzindo = 1;
+    while ((limite < 0 || fimValido < limite) && fread(&r, sizeof(r), 1, f) == 1)
+    {
+        long tam = wal_tamanho_dados(&r);
+        if (tam < 0 || (tam > 0 && fread(&reg, (size_t)tam, 1, f) != 1) ||
+            soma_registro_wal(&r, &reg, (size_t)tam) != r.soma)
+            break;
+        if (!wal_aplicar(&r, &reg))
+        {
+            ok = 0;
+            break;
+        }
+        fimValido += (long)sizeof(r) + tam;
+        aplicados++;
+    }
+    g_walReproduzindo = 0;
+
+    if (!ok || fseek(f, 0, SEEK_END) != 0)
+    {
+        fclose(f);
+        return -1;
+    }
+    if (ftell(f) > fimValido && (!truncar_arquivo(f, fimValido) || !sincronizar_arquivo(f)))
+    {
+        fclose(f);
+        return -1;
+    }
+    if (fseek(f, fimValido, SEEK_SET) != 0)
+    {
+        fclose(f);
+        return -1;
+    }
+    contar_lidos(fimValido);
+    metrica_registrar(MET_REAPLICAR_LOG, &m, aplicados);
+    if (aplicados > 0)
+        aviso("Log reaplicado: %d alteracao(oes) desde o ultimo checkpoint.\n", aplicados);
+    g_wal = f;
+    g_walBytes = fimValido - (long)(2 * sizeof(int));
+    return 1;
+}
+
+// ======== Modo compartilhado (varios processos) ========
+// Varios processos na mesma pasta, sem servidor. Cada um tem suas tabelas e
+// indices na memoria; o que eles dividem e o log, lido por um mapeamento
+// compartilhado, e uma pagina de controle (clinica.trava, tambem mapeada) que
+// diz ate onde o log vale e quantos checkpoints ja houve.
+//
+// Travas fcntl em bytes de clinica.trava (nunca no proprio log: fechar
+// qualquer descritor do arquivo soltaria a trava):
+// - TRAVA_LOG: exclusiva durante cada alteracao (atualiza, grava no fim do log
+//   e publica o novo fim) e no checkpoint; compartilhada para atualizar antes
+//   de uma leitura. Como o log e uma sequencia so, uma faixa basta; os ids
+//   novos saem com ela, entao nunca se repetem entre os processos.
+// - TRAVA_PRESENCA: compartilhada enquanto o processo vive. Quem consegue a
+//   exclusiva na partida esta sozinho e reinicia o controle a partir dos
+//   arquivos (o que houver nele e de uma sessao que ja terminou).
+#define TRAVA_MAGICO 0x56525443 // "CTRV"
+#define TRAVA_VERSAO 1
+#define TRAVA_LOG 0      // byte de cada trava
+#define TRAVA_PRESENCA 1
+#define TRAVA_SOLTAR 0
+#define TRAVA_LER 1      // compartilhada
+#define TRAVA_GRAVAR 2   // exclusiva
+
+typedef struct
+{
+    int magico;
+    int versao;
+    long long geracao;     // checkpoints desde que o controle foi iniciado
+    long long fimLog;      // fim do ultimo registro publicado (-1 = ainda nao lido)
+    long long fimAnterior; // fimLog no ultimo checkpoint (-1 = todos voltam aos .bin)
+} Controle;
+
+static Controle *g_ctl = NULL;      // mapeado; NULL fora do modo compartilhado
+static int g_ctlFd = -1;
+static int g_ctlEscrita = 0;        // alteracoes abertas (o checkpoint aninha)
+static long long g_ctlGeracao = 0;  // geracao em que a memoria esta
+static int g_ctlForaDoLog = 0;      // a memoria mudou sem passar pelo log (--gerar)
+static long g_walLido = 0;          // fim do log ja aplicado (-1 = recarregar os .bin)
+
+static int travar(int byte, int modo, int esperar)
+{
+#ifdef CLINICA_MMAP
+    static const short tipos[3] = {F_UNLCK, F_RDLCK, F_WRLCK};
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = tipos[modo];
+    fl.l_whence = SEEK_SET;
+    fl.l_start = byte;
+    fl.l_len = 1;
+    while (fcntl(g_ctlFd, esperar ? F_SETLKW : F_SETLK, &fl) != 0)
+        if (errno != EINTR || !esperar)
+            return 0;
+    return 1;
+#else
+    (void)byte;
+    (void)modo;
+    (void)esperar;
+    return 0;
+#endif
+}
+
+static void compartilhado_fechar()
+{
+#ifdef CLINICA_MMAP
+    if (g_ctl)
+        munmap(g_ctl, sizeof(Controle));
+    if (g_ctlFd >= 0)
+        close(g_ctlFd); // solta as travas
+#endif
+    g_ctl = NULL;
+    g_ctlFd = -1;
+    g_ctlEscrita = 0;
+    g_ctlForaDoLog = 0;
+    g_walLido = 0;
+}
+
+// Mapeia o controle e sai com a trava exclusiva do log (a carga dos .bin e
+// do log acontece com ela; compartilhado_publicar solta)
+static int compartilhado_abrir()
+{
+#ifdef CLINICA_MMAP
+    struct stat st;
+    g_ctlFd = open(ARQ_TRAVA, O_RDWR | O_CREAT, 0666);
+    if (g_ctlFd < 0 || !travar(TRAVA_LOG, TRAVA_GRAVAR, 1) || fstat(g_ctlFd, &st) != 0 ||
+        (st.st_size < (off_t)sizeof(Controle) && ftruncate(g_ctlFd, (off_t)sizeof(Controle)) != 0))
+    {
+        aviso("Nao foi possivel abrir " ARQ_TRAVA ".\n");
+        compartilhado_fechar();
+        return CLINICA_ERRO_ARQUIVO;
+    }
+    void *m = mmap(NULL, sizeof(Controle), PROT_READ | PROT_WRITE, MAP_SHARED, g_ctlFd, 0);
+    if (m == MAP_FAILED)
+    {
+        aviso("Nao foi possivel mapear " ARQ_TRAVA ".\n");
+        compartilhado_fechar();
+        return CLINICA_ERRO_ARQUIVO;
+    }
+    g_ctl = (Controle *)m;
+    g_ctlEscrita = 1;
+    int sozinho = travar(TRAVA_PRESENCA, TRAVA_GRAVAR, 0);
+    if (!travar(TRAVA_PRESENCA, TRAVA_LER, 0))
+    {
+        aviso("Nao foi possivel travar " ARQ_TRAVA ".\n");
+        compartilhado_fechar();
+        return CLINICA_ERRO_ARQUIVO;
+    }
+    if (sozinho || g_ctl->magico != TRAVA_MAGICO || g_ctl->versao != TRAVA_VERSAO)
+    {
+        memset(g_ctl, 0, sizeof(*g_ctl));
+        g_ctl->magico = TRAVA_MAGICO;
+        g_ctl->versao = TRAVA_VERSAO;
+        g_ctl->fimLog = -1;
+        g_ctl->fimAnterior = -1;
+    }
+    g_ctlGeracao = g_ctl->geracao;
+    return CLINICA_OK;
+#else
+    aviso("Modo compartilhado indisponivel nesta plataforma.\n");
+    return CLINICA_INVALIDO;
+#endif
+}
+
+// Volta ao ultimo checkpoint (os .bin); o log e reaplicado em seguida
+static int compartilhado_recarregar()
+{
+    g_walReproduzindo = 1; // o esvaziamento nao vai para o log
+    limpar_tudo();
+    g_walReproduzindo = 0;
+    if (!carregar_animais(ARQ_ANIMAIS) || !carregar_vets(ARQ_VETS) || !carregar_cons(ARQ_CONS))
+        return 0;
+    g_walLido = (long)(2 * sizeof(int));
+    return 1;
+}
+
+// Aplica o que os outros processos publicaram desde a ultima vez. Chamada com
+// a trava do log (compartilhada ou exclusiva).
+static int compartilhado_atualizar()
+{
+    if (g_ctl->geracao != g_ctlGeracao)
+    {
+        // Checkpoint de outro processo: se a memoria ja tinha tudo o que ele
+        // gravou nos .bin, basta seguir do inicio do log; senao, recarrega
+        int emDia = g_ctl->geracao == g_ctlGeracao + 1 && g_walLido >= 0 && g_walLido == g_ctl->fimAnterior;
+        g_ctlGeracao = g_ctl->geracao;
+        g_walLido = emDia ? (long)(2 * sizeof(int)) : -1;
+    }
+    long fim = (long)g_ctl->fimLog;
+    if ((g_walLido < 0 || g_walLido > fim) && !compartilhado_recarregar())
+    {
+        g_walLido = -1;
+        aviso("Erro ao recarregar os arquivos de dados.\n");
+        return CLINICA_ERRO_ARQUIVO;
+    }
+    if (g_walLido == fim)
+        return CLINICA_OK;
+
+#ifdef CLINICA_MMAP
+    struct stat st;
+    void *mapa = MAP_FAILED;
+    if (fstat(fileno(g_wal), &st) == 0 && st.st_size >= (off_t)fim)
+        mapa = mmap(NULL, (size_t)fim, PROT_READ, MAP_SHARED, fileno(g_wal), 0);
+    if (mapa == MAP_FAILED)
+    {
+        aviso("Erro ao mapear o log " ARQ_WAL ".\n");
+        return CLINICA_ERRO_ARQUIVO;
+    }
+    Medicao m = metrica_iniciar();
+    const unsigned char *p = (const unsigned char *)mapa;
+    long pos = g_walLido;
+    int aplicados = 0;
+    g_walReproduzindo = 1;
+    while (pos + (long)sizeof(RegistroWal) <= fim)
+    {
+        RegistroWal r;
+        RegistroQualquer reg;
+        memcpy(&r, p + pos, sizeof(r));
+        long tam = wal_tamanho_dados(&r);
+        if (tam < 0 || pos + (long)sizeof(r) + tam > fim)
+            break;
+        memcpy(&reg, p + pos + sizeof(r), (size_t)tam);
+        if (soma_registro_wal(&r, &reg, (size_t)tam) != r.soma || !wal_aplicar(&r, &reg))
+            break;
+        pos += (long)sizeof(r) + tam;
+        aplicados++;
+    }
+    g_walReproduzindo = 0;
+    munmap(mapa, (size_t)fim);
+    contar_lidos(pos - g_walLido);
+    metrica_registrar(MET_REAPLICAR_LOG, &m, aplicados);
+    if (pos != fim)
+    {
+        g_walLido = -1; // a proxima tentativa parte dos .bin
+        aviso("Erro ao reaplicar o log " ARQ_WAL ".\n");
+        return CLINICA_ERRO_ARQUIVO;
+    }
+    g_walLido = fim;
+    g_walBytes = fim - (long)(2 * sizeof(int));
+#endif
+    return CLINICA_OK;
+}
+
+// Abre uma alteracao: trava exclusiva do log, memoria em dia e o arquivo no
+// fim publicado. Fora do modo compartilhado nao faz nada.
+static int compartilhado_escrever()
+{
+    if (!g_ctl || g_ctlEscrita++ > 0)
+        return CLINICA_OK;
+    if (!travar(TRAVA_LOG, TRAVA_GRAVAR, 1))
+    {
+        g_ctlEscrita = 0;
+        aviso("Nao foi possivel travar " ARQ_TRAVA ".\n");
+        return CLINICA_ERRO_ARQUIVO;
+    }
+    int r = compartilhado_atualizar();
+    long fim = (long)g_ctl->fimLog;
+    // Depois do fim publicado so ha restos de quem caiu no meio de uma alteracao
+    if (r == CLINICA_OK && (fseek(g_wal, 0, SEEK_END) != 0 ||
+                            (ftell(g_wal) > fim && !truncar_arquivo(g_wal, fim)) || fseek(g_wal, fim, SEEK_SET) != 0))
+        r = CLINICA_ERRO_GRAVACAO;
+    if (r != CLINICA_OK)
+    {
+        travar(TRAVA_LOG, TRAVA_SOLTAR, 1);
+        g_ctlEscrita = 0;
+    }
+    return r;
+}
+
+// Fecha a alteracao aberta por compartilhado_escrever: passa o buffer do log
+// para o arquivo (o fsync fica para o fim do grupo, como sempre), publica o
+// novo fim e solta a trava. Devolve 'r', ou erro de gravacao.
+static int compartilhado_publicar(int r)
+{
+    if (!g_ctl || --g_ctlEscrita > 0)
+        return r;
+    if (g_semGravar) // --gerar --sem-gravar: a sessao segue sozinha, so na memoria
+    {
+        compartilhado_fechar();
+        return r;
+    }
+    if (wal_descarregar() && fflush(g_wal) == 0)
+    {
+        g_walLido = ftell(g_wal);
+        g_walBytes = g_walLido - (long)(2 * sizeof(int));
+        g_ctl->fimLog = g_walLido;
+    }
+    else
+    {
+        g_walErro = 1;
+        g_walLido = -1; // a memoria tem o que os outros nao vao ver
+        if (r >= 0)
+            r = CLINICA_ERRO_GRAVACAO;
+    }
+    travar(TRAVA_LOG, TRAVA_SOLTAR, 1);
+    return r;
+}
+
+// Antes de uma leitura: aplica o que os outros publicaram
+static void compartilhado_ler()
+{
+    if (!g_ctl || g_ctlEscrita > 0)
+        return;
+    if (!travar(TRAVA_LOG, TRAVA_LER, 1))
+        return;
+    compartilhado_atualizar();
+    travar(TRAVA_LOG, TRAVA_SOLTAR, 1);
+}
+
+// Consolida o log: grava os .bin completos e so entao zera o log. Uma queda
+// entre as duas etapas e inofensiva, pois reaplicar o log e idempotente.
+static int checkpoint_gravar()
+{
+    if (g_semGravar)
+    {
+        aviso("Dados gerados so em memoria (--sem-gravar): nada foi gravado.\n");
+        return 0;
+    }
+    Medicao m = metrica_iniciar();
+    long long linhas = (long long)g_nAnimais + g_nVets + g_nCons;
+    long long antes = g_bytesGravados;
+    int ok = 1;
+    long long fimAnterior = -1;
+    if (g_ctl)
+    {
+        // Quem ja aplicou o log ate aqui tem na memoria o mesmo que os .bin.
+        // Os .bin sao regravados inteiros: as posicoes no arquivo sao as da
+        // memoria de quem gravou por ultimo, nao as deste processo.
+        if (!g_ctlForaDoLog && wal_descarregar() && fflush(g_wal) == 0)
+            fimAnterior = ftell(g_wal);
+        g_ctlForaDoLog = 0;
+        tabela_esquecer_arquivo(&g_tabAnimais);
+        tabela_esquecer_arquivo(&g_tabVets);
+        tabela_esquecer_arquivo(&g_tabCons);
+    }
+    if (!salvar_animais(ARQ_ANIMAIS))
+    {
+        aviso("Falha ao salvar animais.\n");
+        ok = 0;
+    }
+    if (!salvar_vets(ARQ_VETS))
+    {
+        aviso("Falha ao salvar veterinarios.\n");
+        ok = 0;
+    }
+    if (!salvar_cons(ARQ_CONS))
+    {
+        aviso("Falha ao salvar consultas.\n");
+        ok = 0;
+    }
+    if (!ok || !g_wal)
+    {
+        metrica_registrar(MET_CHECKPOINT, &m, linhas);
+        return ok;
+    }
+
+    g_walUsado = 0; // ja esta nos .bin
+    g_walPendente = 0;
+    if (!truncar_arquivo(g_wal, (long)(2 * sizeof(int))) || fseek(g_wal, 0, SEEK_END) != 0 ||
+        !sincronizar_arquivo(g_wal))
+    {
+        aviso("Falha ao zerar o log.\n");
+        metrica_registrar(MET_CHECKPOINT, &m, linhas);
+        return 0;
+    }
+    g_walBytes = 0;
+    g_walErro = 0;
+    if (g_ctl)
+    {
+        g_ctl->fimAnterior = fimAnterior;
+        g_ctlGeracao = ++g_ctl->geracao;
+    }
+    metrica_registrar(MET_CHECKPOINT, &m, linhas);
+    aviso("Checkpoint concluido: %lld bytes gravados nos .bin.\n", g_bytesGravados - antes);
+    return 1;
+}
+
+static int checkpoint()
+{
+    if (compartilhado_escrever() != CLINICA_OK)
+        return 0;
+    return compartilhado_publicar(checkpoint_gravar() ? CLINICA_OK : CLINICA_ERRO_GRAVACAO) == CLINICA_OK;
+}
+
+// ======== API: Animais ========
+// No modo compartilhado o id sai com a trava do log: unico entre os processos
+int clinica_incluir_animal(Animal *a)
+{
+    if (data_to_int(a->dataNascimento) < 0)
+        return CLINICA_DATA_INVALIDA;
+    int r = compartilhado_escrever();
+    if (r != CLINICA_OK)
+        return r;
+    a->idAnimal = g_nextIdAnimal;
+    if (inserir_animal(a) < 0)
+        r = CLINICA_ERRO_MEMORIA;
+    else
+        g_nextIdAnimal++;
+    return compartilhado_publicar(r);
+}
+
+int clinica_buscar_animal(int id, Animal *a)
+{
+    compartilhado_ler();
+    int idx = encontrar_indice_animal_por_id(id);
+    if (idx < 0)
+        return CLINICA_NAO_ENCONTRADO;
+    if (a)
+        *a = g_animais[idx];
+    return CLINICA_OK;
+}
+
+// A data so e conferida se mudou: registros antigos com data invalida
+// continuam editaveis
+int clinica_alterar_animal(const Animal *a)
+{
+    int r = compartilhado_escrever();
+    if (r != CLINICA_OK)
+        return r;
+    int idx = encontrar_indice_animal_por_id(a->idAnimal);
+    if (idx < 0)
+        r = CLINICA_NAO_ENCONTRADO;
+    else if (strcmp(a->dataNascimento, g_animais[idx].dataNascimento) != 0 && data_to_int(a->dataNascimento) < 0)
+        r = CLINICA_DATA_INVALIDA;
+    else if (!alterar_animal(idx, a))
+        r = CLINICA_ERRO_MEMORIA;
+    return compartilhado_publicar(r);
+}
+
+int clinica_excluir_animal(int id)
+{
+    int r = compartilhado_escrever();
+    if (r != CLINICA_OK)
+        return r;
+    int idx = encontrar_indice_animal_por_id(id);
+    if (idx < 0)
+        r = CLINICA_NAO_ENCONTRADO;
+    else if (tem_consulta_para_animal(id))
+        r = CLINICA_EM_USO;
+    else
+        excluir_animal(idx);
+    return compartilhado_publicar(r);
+}
+
+int clinica_listar_animais(FILE *f)
+{
+    compartilhado_ler();
+    int n = tabela_ativos(&g_tabAnimais);
+    if (n == 0)
+        return 0;
+    Medicao m = metrica_iniciar();
+    for (int i = 0; i < g_nAnimais; i++)
+    {
+        if (!tabela_vivo(&g_tabAnimais, i))
+            continue;
+        fprintf(f, "#%d | Nome: %s | Especie: %s | Nasc: %s | Peso: %.2f kg\n",
+                g_animais[i].idAnimal, g_animais[i].nome,
+                g_animais[i].especie, g_animais[i].dataNascimento, g_animais[i].peso);
+    }
+    metrica_registrar(MET_LISTAGEM, &m, g_nAnimais);
+    return n;
+}
+
+// ======== API: Veterinarios ========
+int clinica_incluir_vet(const Veterinario *v)
+{
+    if (v->crmVet <= 0)
+        return CLINICA_INVALIDO;
+    int r = compartilhado_escrever();
+    if (r != CLINICA_OK)
+        return r;
+    if (encontrar_indice_veterinario_por_crm(v->crmVet) != -1)
+        r = CLINICA_DUPLICADO;
+    else if (inserir_vet(v) < 0)
+        r = CLINICA_ERRO_MEMORIA;
+    return compartilhado_publicar(r);
+}
+
+int clinica_buscar_vet(int crm, Veterinario *v)
+{
+    compartilhado_ler();
+    int idx = encontrar_indice_veterinario_por_crm(crm);
+    if (idx < 0)
+        return CLINICA_NAO_ENCONTRADO;
+    if (v)
+        *v = g_vets[idx];
+    return CLINICA_OK;
+}
+
+int clinica_alterar_vet(const Veterinario *v)
+{
+    int r = compartilhado_escrever();
+    if (r != CLINICA_OK)
+        return r;
+    int idx = encontrar_indice_veterinario_por_crm(v->crmVet);
+    if (idx < 0)
+        r = CLINICA_NAO_ENCONTRADO;
+    else
+        alterar_vet(idx, v);
+    return compartilhado_publicar(r);
+}
+
+int clinica_excluir_vet(int crm)
+{
+    int r = compartilhado_escrever();
+    if (r != CLINICA_OK)
+        return r;
+    int idx = encontrar_indice_veterinario_por_crm(crm);
+    if (idx < 0)
+        r = CLINICA_NAO_ENCONTRADO;
+    else if (tem_consulta_para_vet(crm))
+        r = CLINICA_EM_USO;
+    else
+        excluir_vet(idx);
+    return compartilhado_publicar(r);
+}
+
+int clinica_listar_vets(FILE *f)
+{
+    compartilhado_ler();
+    int n = tabela_ativos(&g_tabVets);
+    if (n == 0)
+        return 0;
+    Medicao m = metrica_iniciar();
+    for (int i = 0; i < g_nVets; i++)
+    {
+        if (!tabela_vivo(&g_tabVets, i))
+            continue;
+        fprintf(f, "CRM %d | Nome: %s | Tel: %s\n",
+                g_vets[i].crmVet, g_vets[i].nome, g_vets[i].telefone);
+    }
+    metrica_registrar(MET_LISTAGEM, &m, g_nVets);
+    return n;
+}
+
+// ======== API: Consultas ========
+// Confere as FKs e a data que mudaram em relacao a 'atual' (NULL = inclusao),
+// na ordem em que o menu pergunta
+static int validar_consulta(const Consulta *c, const Consulta *atual)
+{
+    if ((!atual || c->idAnimal != atual->idAnimal) && encontrar_indice_animal_por_id(c->idAnimal) < 0)
+        return CLINICA_ANIMAL_INEXISTENTE;
+    if ((!atual || c->crmVet != atual->crmVet) && encontrar_indice_veterinario_por_crm(c->crmVet) < 0)
+        return CLINICA_VET_INEXISTENTE;
+    if ((!atual || strcmp(c->dataConsulta, atual->dataConsulta) != 0) && data_to_int(c->dataConsulta) < 0)
+        return CLINICA_DATA_INVALIDA;
+    return CLINICA_OK;
+}
+
+int clinica_incluir_consulta(Consulta *c)
+{
+    int r = compartilhado_escrever();
+    if (r != CLINICA_OK)
+        return r;
+    r = validar_consulta(c, NULL);
+    if (r == CLINICA_OK)
+    {
+        c->idConsulta = g_nextIdConsulta;
+        if (inserir_consulta(c) < 0)
+            r = CLINICA_ERRO_MEMORIA;
+        else
+            g_nextIdConsulta++;
+    }
+    return compartilhado_publicar(r);
+}
+
+int clinica_buscar_consulta(int id, Consulta *c)
+{
+    compartilhado_ler();
+    int idx = encontrar_indice_consulta_por_id(id);
+    if (idx < 0)
+        return CLINICA_NAO_ENCONTRADO;
+    if (c)
+        *c = g_consultas[idx];
+    return CLINICA_OK;
+}
+
+int clinica_alterar_consulta(const Consulta *c)
+{
+    int r = compartilhado_escrever();
+    if (r != CLINICA_OK)
+        return r;
+    int idx = encontrar_indice_consulta_por_id(c->idConsulta);
+    if (idx < 0)
+        r = CLINICA_NAO_ENCONTRADO;
+    else if ((r = validar_consulta(c, &g_consultas[idx])) == CLINICA_OK && !alterar_consulta(idx, c))
+        r = CLINICA_ERRO_MEMORIA;
+    return compartilhado_publicar(r);
+}
+
+int clinica_excluir_consulta(int id)
+{
+    int r = compartilhado_escrever();
+    if (r != CLINICA_OK)
+        return r;
+    int idx = encontrar_indice_consulta_por_id(id);
+    if (idx < 0)
+        r = CLINICA_NAO_ENCONTRADO;
+    else
+        excluir_consulta(idx);
+    return compartilhado_publicar(r);
+}
+
+int clinica_expurgar_consultas(const char *data)
+{
+    int corte = data_to_int(data);
+    if (corte < 0)
+        return CLINICA_DATA_INVALIDA;
+    int r = compartilhado_escrever();
+    if (r != CLINICA_OK)
+        return r;
+    int qtd = expurgar_consultas_antes_de(corte);
+    return compartilhado_publicar(qtd < 0 ? CLINICA_ERRO_MEMORIA : qtd);
+}
+// ======== Listagens / Filtros da Estrutura 3 ========
+// Listagens e relatorios formatam as linhas nas threads do pool (formatar_em_ordem)
+// e saem por um buffer reaproveitado, na mesma ordem de uma thread so
+#define LISTA_BUF_TAM (64 * 1024)
+
+static char g_listaBuf[LISTA_BUF_TAM + SAIDA_FOLGA];
+
+// Origem das linhas: item k -> consulta
+typedef struct
+{
+    const ChaveData *chaves; // trecho do indice de datas, ou
+    const int *ids;          // lista de ids (indices reversos), ou nenhum: posicoes de g_consultas
+} FonteConsultas;
+
+// NULL = posicao k de g_consultas e uma lapide
+static const Consulta *fonte_consulta(const FonteConsultas *f, int k)
+{
+    if (f->chaves)
+        return consulta_por_id(f->chaves[k].id);
+    if (f->ids)
+        return consulta_por_id(f->ids[k]);
+    return tabela_vivo(&g_tabCons, k) ? &g_consultas[k] : NULL;
+}
+
+// Mesmos bytes de "#%d | Data: %s | Valor: R$ %.2f | Animal: %s (id %d, %s) | Vet: %s (CRM %d, %s)\n"
+static int formatar_consulta_expandida(char *buf, const Consulta *c)
+{
+    int ia = encontrar_indice_animal_por_id(c->idAnimal);
+    int iv = encontrar_indice_veterinario_por_crm(c->crmVet);
+    char *p = buf;
+    *p++ = '#';
+    p += fmt_int(p, c->idConsulta);
+    p += FMT_LIT(p, " | Data: ");
+    p += fmt_campo(p, c->dataConsulta, DATA_TAM);
+    p += FMT_LIT(p, " | Valor: R$ ");
+    p += fmt_dinheiro(p, c->valor);
+    p += FMT_LIT(p, " | Animal: ");
+    p += ia >= 0 ? fmt_campo(p, g_animais[ia].nome, NOME_TAM) : FMT_LIT(p, "??");
+    p += FMT_LIT(p, " (id ");
+    p += fmt_int(p, c->idAnimal);
+    p += FMT_LIT(p, ", ");
+    p += ia >= 0 ? fmt_campo(p, g_animais[ia].especie, ESPECIE_TAM) : FMT_LIT(p, "??");
+    p += FMT_LIT(p, ") | Vet: ");
+    p += iv >= 0 ? fmt_campo(p, g_vets[iv].nome, NOME_TAM) : FMT_LIT(p, "??");
+    p += FMT_LIT(p, " (CRM ");
+    p += fmt_int(p, c->crmVet);
+    p += FMT_LIT(p, ", ");
+    p += iv >= 0 ? fmt_campo(p, g_vets[iv].telefone, TELEFONE_TAM) : FMT_LIT(p, "??");
+    p += FMT_LIT(p, ")\n");
+    return (int)(p - buf);
+}
+
+static int formatar_item_tela(char *p, int k, const void *ctx)
+{
+    const Consulta *c = fonte_consulta((const FonteConsultas *)ctx, k);
+    return c ? formatar_consulta_expandida(p, c) : 0;
+}
+
+// Mostra os itens [0, n) da fonte no formato da tela; devolve 0 sem memoria
+static int mostrar_consultas(FILE *destino, const FonteConsultas *f, int n)
+{
+    Medicao m = metrica_iniciar();
+    Saida s;
+    saida_iniciar(&s, destino, g_listaBuf, LISTA_BUF_TAM);
+    int ok = formatar_em_ordem(&s, n, formatar_item_tela, f);
+    saida_fechar(&s);
+    metrica_registrar(MET_LISTAGEM, &m, n);
+    return ok;
+}
+
+// Posicao do primeiro item do indice de datas depois de 'fim' (AAAAMMDD)
+static int idxdata_depois_de(int fim)
+{
+    return fim == INT_MAX ? g_consPorData.n : idxdata_posicao(&g_consPorData, fim + 1, INT_MIN);
+}
+
+// Ids das consultas com valor em [lo, hi], na ordem da tabela (-1 = sem memoria).
+// O filtro corre sobre a coluna de valores; as lapides saem depois.
+static int selecionar_por_valor(double lo, double hi, int **ids)
+{
+    int *v = (int *)malloc((size_t)(g_nCons > 0 ? g_nCons : 1) * sizeof(int));
+    if (!v)
+        return -1;
+    int n = filtrar_real(g_consValor, 0, g_nCons, lo, hi, v), m = 0;
+    for (int k = 0; k < n; k++)
+        if (consulta_viva(v[k]))
+            v[m++] = g_consId[v[k]];
+    *ids = v;
+    return m;
+}
+
+// Fonte e quantidade de itens de um filtro (ou codigo de erro). A faixa de
+// valor aloca os ids em *alocados, que o chamador libera.
+static int fonte_do_filtro(const FiltroConsultas *fl, FonteConsultas *f, int **alocados)
+{
+    const ListaIds *l = NULL;
+    f->chaves = NULL;
+    f->ids = NULL;
+    *alocados = NULL;
+    switch (fl->tipo)
+    {
+    case CLINICA_TODAS:
+        return g_nCons;
+    case CLINICA_A_PARTIR_DE:
+    case CLINICA_PERIODO:
+    {
+        int ini = data_to_int(fl->data), fim = fl->tipo == CLINICA_PERIODO ? data_to_int(fl->dataFim) : INT_MAX;
+        if (ini < 0 || fim < 0 || ini > fim)
+            return CLINICA_DATA_INVALIDA;
+        // Busca binaria ate o primeiro >= ini; dali ate 'fim' tudo entra, ja em ordem cronologica
+        int k = idxdata_posicao(&g_consPorData, ini, INT_MIN);
+        f->chaves = g_consPorData.itens + k;
+        return idxdata_depois_de(fim) - k;
+    }
+    case CLINICA_VALOR:
+    {
+        if (!(fl->valorMin <= fl->valorMax))
+            return CLINICA_INVALIDO;
+        int n = selecionar_por_valor(fl->valorMin, fl->valorMax, alocados);
+        if (n < 0)
+            return CLINICA_ERRO_MEMORIA;
+        f->ids = *alocados;
+        return n;
+    }
+    case CLINICA_POR_CRM:
+        l = rev_lista(&g_consPorVet, fl->chave);
+        break;
+    case CLINICA_POR_ANIMAL:
+        l = rev_lista(&g_consPorAnimal, fl->chave);
+        break;
+    case CLINICA_POR_ESPECIE:
+        // Grafia normalizada -> id -> lista da especie; nenhuma comparacao de texto por linha
+        l = rev_lista(&g_consPorEspecie, especie_buscar(fl->especie));
+        break;
+    default:
+        return CLINICA_INVALIDO;
+    }
+    f->ids = l ? l->ids : NULL;
+    return l ? l->n : 0;
+}
+
+int clinica_listar_consultas(FILE *f, const FiltroConsultas *filtro)
+{
+    compartilhado_ler();
+    FonteConsultas fonte;
+    int *alocados;
+    int n = fonte_do_filtro(filtro, &fonte, &alocados);
+    if (n < 0)
+        return n;
+    // Sem filtro a fonte sao as posicoes da tabela, lapides inclusive
+    int total = filtro->tipo == CLINICA_TODAS ? tabela_ativos(&g_tabCons) : n;
+    int ok = total == 0 || mostrar_consultas(f, &fonte, n);
+    free(alocados);
+    return ok ? total : CLINICA_ERRO_MEMORIA;
+}
+// ======== Relatrios .txt ========
+// Os relatorios saem pela Saida bufferizada, com a linha montada a mao (mesmos
+// bytes de "#%d | Data: %s | Valor: %.2f | Animal: %s (id %d, %s) | Vet: %s (CRM %d)\n")
+#define REL_LINHA_TAM SAIDA_FOLGA // campos de tamanho fixo: uma linha nunca passa disso
+
+// Linha de uma consulta nos relatorios, com animal (ia) e veterinario (iv) ja resolvidos
+static int formatar_linha_relatorio(char *buf, const Consulta *c, int ia, int iv)
+{
+    char *p = buf;
+    *p++ = '#';
+    p += fmt_int(p, c->idConsulta);
+    p += FMT_LIT(p, " | Data: ");
+    p += fmt_campo(p, c->dataConsulta, DATA_TAM);
+    p += FMT_LIT(p, " | Valor: ");
+    p += fmt_dinheiro(p, c->valor);
+    p += FMT_LIT(p, " | Animal: ");
+    p += ia >= 0 ? fmt_campo(p, g_animais[ia].nome, NOME_TAM) : FMT_LIT(p, "??");
+    p += FMT_LIT(p, " (id ");
+    p += fmt_int(p, c->idAnimal);
+    p += FMT_LIT(p, ", ");
+    p += ia >= 0 ? fmt_campo(p, g_animais[ia].especie, ESPECIE_TAM) : FMT_LIT(p, "??");
+    p += FMT_LIT(p, ") | Vet: ");
+    p += iv >= 0 ? fmt_campo(p, g_vets[iv].nome, NOME_TAM) : FMT_LIT(p, "??");
+    p += FMT_LIT(p, " (CRM ");
+    p += fmt_int(p, c->crmVet);
+    p += FMT_LIT(p, ")\n");
+    return (int)(p - buf);
+}
+
+static int formatar_item_relatorio(char *p, int k, const void *ctx)
+{
+    const Consulta *c = fonte_consulta((const FonteConsultas *)ctx, k);
+    if (!c)
+        return 0;
+    return formatar_linha_relatorio(p, c, encontrar_indice_animal_por_id(c->idAnimal),
+                                    encontrar_indice_veterinario_por_crm(c->crmVet));
+}
+
+// Escreve os itens [0, n) da fonte; em falta de memoria a saida fica marcada com erro
+static void escrever_consultas(Saida *s, const FonteConsultas *f, int n)
+{
+    if (!formatar_em_ordem(s, n, formatar_item_relatorio, f))
+        s->erro = 1;
+}
+
+static void escrever_rodape_relatorio(Saida *s, int total)
+{
+    saida_texto(s, "\nTotal: ");
+    saida_int(s, total);
+    saida_texto(s, " consultas.\n");
+}
+
+// Fecha um relatorio avulso (medido desde m, com 'linhas' consultas); devolve
+// 0 se algo nao foi gravado
+static int fechar_relatorio(Saida *s, FILE *f, const Medicao *m, int linhas)
+{
+    int ok = saida_fechar(s);
+    if (fclose(f) != 0)
+        ok = 0;
+    metrica_registrar(MET_RELATORIO, m, linhas);
+    return ok;
+}
+
+// Nome do arquivo de um relatorio avulso; 0 = filtro sem relatorio
+static int nomear_relatorio(const FiltroConsultas *fl, char *arquivo, size_t tam)
+{
+    switch (fl->tipo)
+    {
+    case CLINICA_A_PARTIR_DE:
+        snprintf(arquivo, tam, "relatorio_data.txt");
+        return 1;
+    case CLINICA_PERIODO:
+        snprintf(arquivo, tam, "relatorio_periodo.txt");
+        return 1;
+    case CLINICA_VALOR:
+        snprintf(arquivo, tam, "relatorio_valor.txt");
+        return 1;
+    case CLINICA_POR_CRM:
+        snprintf(arquivo, tam, "relatorio_crm_%d.txt", fl->chave);
+        return 1;
+    case CLINICA_POR_ESPECIE:
+        snprintf(arquivo, tam, "relatorio_especie_%s.txt", fl->especie);
+        // Trocar espaos por '_' para nome de arquivo
+        for (char *p = arquivo; *p; ++p)
+            if (*p == ' ')
+                *p = '_';
+        return 1;
+    }
+    return 0;
+}
+
+static void escrever_titulo_relatorio(Saida *s, const FiltroConsultas *fl)
+{
+    switch (fl->tipo)
+    {
+    case CLINICA_A_PARTIR_DE:
+        saida_texto(s, "RELATORIO: Consultas a partir de ");
+        saida_texto(s, fl->data);
+        break;
+    case CLINICA_PERIODO:
+        saida_texto(s, "RELATORIO: Consultas de ");
+        saida_texto(s, fl->data);
+        saida_texto(s, " a ");
+        saida_texto(s, fl->dataFim);
+        break;
+    case CLINICA_VALOR:
+        saida_texto(s, "RELATORIO: Consultas com valor de R$ ");
+        saida_dinheiro(s, fl->valorMin);
+        saida_texto(s, " a R$ ");
+        saida_dinheiro(s, fl->valorMax);
+        break;
+    case CLINICA_POR_CRM:
+        saida_texto(s, "RELATORIO: Consultas por CRM ");
+        saida_int(s, fl->chave);
+        break;
+    case CLINICA_POR_ESPECIE:
+        saida_texto(s, "RELATORIO: Consultas por especie '");
+        saida_texto(s, fl->especie);
+        saida_char(s, '\'');
+        break;
+    }
+    saida_texto(s, "\n\n");
+}
+
+// Devolve quantas consultas entraram no relatorio
+int clinica_relatorio_consultas(const FiltroConsultas *filtro, char *arquivo, size_t tam)
+{
+    if (!nomear_relatorio(filtro, arquivo, tam))
+        return CLINICA_INVALIDO;
+    compartilhado_ler();
+    Medicao m = metrica_iniciar();
+    FonteConsultas fonte;
+    int *alocados;
+    int total = fonte_do_filtro(filtro, &fonte, &alocados);
+    if (total < 0)
+        return total;
+
+    FILE *f = fopen(arquivo, "w");
+    if (!f)
+    {
+        free(alocados);
+        return CLINICA_ERRO_ARQUIVO;
+    }
+    Saida s;
+    saida_iniciar(&s, f, g_listaBuf, LISTA_BUF_TAM);
+    escrever_titulo_relatorio(&s, filtro);
+    if (total > 0)
+        escrever_consultas(&s, &fonte, total);
+    escrever_rodape_relatorio(&s, total);
+    int ok = fechar_relatorio(&s, f, &m, total);
+    free(alocados);
+    return ok ? total : CLINICA_ERRO_GRAVACAO;
+}
+// ======== Relatorios em lote (uma passada) ========
+// Qualquer combinacao de relatorios por data, periodo, CRM e especie sai de uma
+// unica passada por g_consultas em ordem de id: cada consulta resolve animal e
+// veterinario uma vez, e a linha formatada vai para todos os arquivos a que
+// pertence. Os arquivos por CRM e por especie ficam iguais aos avulsos. Os por
+// data precisam de ordem cronologica: guardam so a chave e as posicoes ja
+// resolvidas da linha, e sao ordenados e escritos no fim.
+#define REL_DATA 0
+#define REL_PERIODO 1
+#define REL_CRM 2
+#define REL_ESPECIE 3
+#define REL_MAX_ABERTOS 256 // arquivos abertos ao mesmo tempo; acima disso, mais passadas
+#define REL_BUF_GRUPO (16 * 1024) // buffer de cada arquivo aberto numa passada
+
+typedef struct
+{
+    int data;
+    int id;
+    int idx; // posicao em g_consultas
+    int ia;  // posicao do animal (-1 = nao encontrado)
+    int iv;  // posicao do veterinario (-1 = nao encontrado)
+} LinhaAdiada;
+
+typedef struct
+{
+    int tipo;
+    int ini, fim; // REL_DATA/REL_PERIODO: intervalo em AAAAMMDD
+    int chave;    // REL_CRM: crm; REL_ESPECIE: id da especie (-1 = inexistente)
+    char titulo[128];
+    char arquivo[128];
+    FILE *f;
+    Saida s;
+    int total;
+    int proximo; // outro relatorio da mesma especie (grafias diferentes), -1 = nenhum
+    LinhaAdiada *adiadas;
+    int nAdiadas;
+    int capAdiadas;
+} SaidaRelatorio;
+
+typedef struct
+{
+    SaidaRelatorio *itens;
+    int n;
+    int cap;
+    int gravados; // arquivos criados e fechados sem erro na ultima execucao
+} PlanoRelatorios;
+
+static int plano_adicionar(PlanoRelatorios *p, int tipo, int ini, int fim, int chave, const char *titulo,
+                           const char *arquivo)
+{
+    for (int i = 0; i < p->n; i++) // mesmo arquivo pedido duas vezes: gera uma so
+        if (strcmp(p->itens[i].arquivo, arquivo) == 0)
+            return 1;
+    if (p->n == p->cap)
+    {
+        int novo = p->cap ? p->cap * 2 : 16;
+        SaidaRelatorio *q = (SaidaRelatorio *)realocar(p->itens, (size_t)novo * sizeof(SaidaRelatorio));
+        if (!q)
+            return 0;
+        p->itens = q;
+        p->cap = novo;
+    }
+    SaidaRelatorio *r = &p->itens[p->n++];
+    memset(r, 0, sizeof(*r));
+    r->tipo = tipo;
+    r->ini = ini;
+    r->fim = fim;
+    r->chave = chave;
+    copiar_campo(r->titulo, titulo, sizeof(r->titulo));
+    copiar_campo(r->arquivo, arquivo, sizeof(r->arquivo));
+    return 1;
+}
+
+static int plano_data(PlanoRelatorios *p, const char *data)
+{
+    int corte = data_to_int(data);
+    if (corte < 0)
+        return 0;
+    char titulo[128], arquivo[128];
+    snprintf(titulo, sizeof(titulo), "RELATORIO: Consultas a partir de %s", data);
+    snprintf(arquivo, sizeof(arquivo), "relatorio_data_%08d.txt", corte);
+    return plano_adicionar(p, REL_DATA, corte, INT_MAX, 0, titulo, arquivo);
+}
+
+static int plano_periodo(PlanoRelatorios *p, const char *dataIni, const char *dataFim)
+{
+    int ini = data_to_int(dataIni), fim = data_to_int(dataFim);
+    if (ini < 0 || fim < 0 || ini > fim)
+        return 0;
+    char titulo[128], arquivo[128];
+    snprintf(titulo, sizeof(titulo), "RELATORIO: Consultas de %s a %s", dataIni, dataFim);
+    snprintf(arquivo, sizeof(arquivo), "relatorio_periodo_%08d_%08d.txt", ini, fim);
+    return plano_adicionar(p, REL_PERIODO, ini, fim, 0, titulo, arquivo);
+}
+
+// Mesmo titulo e nome de arquivo de gerar_relatorio_crm
+static int plano_crm(PlanoRelatorios *p, int crm)
+{
+    char titulo[128], arquivo[128];
+    snprintf(titulo, sizeof(titulo), "RELATORIO: Consultas por CRM %d", crm);
+    snprintf(arquivo, sizeof(arquivo), "relatorio_crm_%d.txt", crm);
+    return plano_adicionar(p, REL_CRM, 0, 0, crm, titulo, arquivo);
+}
+
+// Mesmo titulo e nome de arquivo de gerar_relatorio_especie
+static int plano_especie(PlanoRelatorios *p, const char *nome)
+{
+    char esp[ESPECIE_TAM], titulo[128], arquivo[128];
+    copiar_campo(esp, nome, sizeof(esp));
+    snprintf(titulo, sizeof(titulo), "RELATORIO: Consultas por especie '%s'", esp);
+    snprintf(arquivo, sizeof(arquivo), "relatorio_especie_%s.txt", esp);
+    for (char *q = arquivo; *q; ++q)
+        if (*q == ' ')
+            *q = '_';
+    return plano_adicionar(p, REL_ESPECIE, 0, 0, especie_buscar(esp), titulo, arquivo);
+}
+
+static int plano_todos_crm(PlanoRelatorios *p)
+{
+    for (int i = 0; i < g_nVets; i++)
+        if (tabela_vivo(&g_tabVets, i) && !plano_crm(p, g_vets[i].crmVet))
+            return 0;
+    return 1;
+}
+
+// Uma por especie com algum animal cadastrado, com a grafia do dicionario
+static int plano_todas_especies(PlanoRelatorios *p)
+{
+    unsigned char *usada = (unsigned char *)calloc((size_t)g_nEspecies + 1, 1);
+    if (!usada)
+        return 0;
+    for (int i = 0; i < g_nAnimais; i++)
+        if (tabela_vivo(&g_tabAnimais, i))
+            usada[g_animalEspecie[i]] = 1;
+    int ok = 1;
+    for (int e = 0; e < g_nEspecies && ok; e++)
+        if (usada[e])
+            ok = plano_especie(p, g_especies[e].nome);
+    free(usada);
+    return ok;
+}
+
+static void plano_liberar(PlanoRelatorios *p)
+{
+    for (int i = 0; i < p->n; i++)
+        free(p->itens[i].adiadas);
+    free(p->itens);
+    p->itens = NULL;
+    p->n = p->cap = 0;
+}
+
+static int comparar_linha_adiada(const void *a, const void *b)
+{
+    const LinhaAdiada *x = (const LinhaAdiada *)a, *y = (const LinhaAdiada *)b;
+    if (x->data != y->data)
+        return x->data < y->data ? -1 : 1;
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+static int comparar_posicao_por_id(const void *a, const void *b)
+{
+    int x = g_consId[*(const int *)a], y = g_consId[*(const int *)b];
+    return (x > y) - (x < y);
+}
+
+// Posicoes vivas de g_consultas em ordem crescente de id. Quase sempre a tabela
+// ja esta nessa ordem (ids crescem a cada cadastro) e *ordem fica NULL.
+static int ordem_por_id(int **ordem, int *n)
+{
+    int anterior = INT_MIN, crescente = 1;
+    *ordem = NULL;
+    *n = 0;
+    for (int i = 0; i < g_nCons; i++)
+    {
+        if (!consulta_viva(i))
+            continue;
+        if (g_consId[i] < anterior)
+            crescente = 0;
+        anterior = g_consId[i];
+        (*n)++;
+    }
+    if (crescente)
+    {
+        *n = g_nCons;
+        return 1;
+    }
+    int *v = (int *)malloc((size_t)*n * sizeof(int));
+    if (!v)
+        return 0;
+    int k = 0;
+    for (int i = 0; i < g_nCons; i++)
+        if (consulta_viva(i))
+            v[k++] = i;
+    qsort(v, (size_t)k, sizeof(int), comparar_posicao_por_id);
+    *ordem = v;
+    return 1;
+}
+
+static int adiar_linha(SaidaRelatorio *r, const LinhaAdiada *l)
+{
+    if (r->nAdiadas == r->capAdiadas)
+    {
+        int novo = r->capAdiadas ? r->capAdiadas * 2 : 256;
+        LinhaAdiada *q = (LinhaAdiada *)realocar(r->adiadas, (size_t)novo * sizeof(LinhaAdiada));
+        if (!q)
+            return 0;
+        r->adiadas = q;
+        r->capAdiadas = novo;
+    }
+    r->adiadas[r->nAdiadas++] = *l;
+    return 1;
+}
+
+static int formatar_item_adiado(char *p, int k, const void *ctx)
+{
+    const LinhaAdiada *la = &((const LinhaAdiada *)ctx)[k];
+    return formatar_linha_relatorio(p, &g_consultas[la->idx], la->ia, la->iv);
+}
+
+// Vetor dinamico que dobra de tamanho: garante espaco para mais um elemento
+static int vetor_garantir(void **v, int *cap, int n, size_t tam)
+{
+    if (n < *cap)
+        return 1;
+    int novo = *cap ? *cap * 2 : 1024;
+    void *q = realocar(*v, (size_t)novo * tam);
+    if (!q)
+        return 0;
+    *v = q;
+    *cap = novo;
+    return 1;
+}
+
+// O que uma parte do pool produziu numa rodada: linhas formatadas no buffer da
+// parte (g_bufPartes) com o relatorio de destino, e chaves dos relatorios por data
+typedef struct
+{
+    int saida;
+    size_t off;
+    int tam;
+} Trecho;
+
+typedef struct
+{
+    int saida;
+    LinhaAdiada l;
+} AdiadaParte;
+
+typedef struct
+{
+    Trecho *trechos;
+    int nTrechos;
+    int capTrechos;
+    AdiadaParte *adiadas;
+    int nAdiadas;
+    int capAdiadas;
+    int *sel; // posicoes escolhidas pelo filtro de datas
+    int capSel;
+    int erro;
+} ParteGrupo;
+
+typedef struct
+{
+    SaidaRelatorio *r;
+    const IndiceHash *porCrm;
+    const int *porEspecie;
+    const int *datas;
+    int nDatas;
+    const int *ordem;
+    int ini, fim; // faixa da rodada em 'ordem' (ou em g_consultas)
+    ParteGrupo *partes;
+} RodadaGrupo;
+
+static int parte_trecho(ParteGrupo *pg, int saida, size_t off, int tam)
+{
+    if (!vetor_garantir((void **)&pg->trechos, &pg->capTrechos, pg->nTrechos, sizeof(Trecho)))
+        return 0;
+    Trecho t = {saida, off, tam};
+    pg->trechos[pg->nTrechos++] = t;
+    return 1;
+}
+
+// Rodada so com relatorios por data, na ordem da tabela: o filtro vetorizado
+// sobre a coluna de datas escolhe as linhas de cada relatorio, e so elas
+// resolvem animal e veterinario. A ordem nao importa: sao ordenadas no fim.
+static void rotear_datas(const RodadaGrupo *g, ParteGrupo *pg, int ini, int fim)
+{
+    while (pg->capSel < fim - ini)
+        if (!vetor_garantir((void **)&pg->sel, &pg->capSel, pg->capSel, sizeof(int)))
+        {
+            pg->erro = 1;
+            return;
+        }
+    for (int d = 0; d < g->nDatas; d++)
+    {
+        const SaidaRelatorio *rd = &g->r[g->datas[d]];
+        int n = filtrar_int(g_consData, ini, fim, rd->ini, rd->fim, pg->sel);
+        for (int k = 0; k < n; k++)
+        {
+            int i = pg->sel[k];
+            if (!consulta_viva(i))
+                continue;
+            if (!vetor_garantir((void **)&pg->adiadas, &pg->capAdiadas, pg->nAdiadas, sizeof(AdiadaParte)))
+            {
+                pg->erro = 1;
+                return;
+            }
+            AdiadaParte ap = {g->datas[d],
+                              {g_consData[i], g_consId[i], i, encontrar_indice_animal_por_id(g_consAnimal[i]),
+                               encontrar_indice_veterinario_por_crm(g_consCrm[i])}};
+            pg->adiadas[pg->nAdiadas++] = ap;
+        }
+    }
+}
+
+// Roteia as consultas de uma fatia da rodada: o roteamento le so as colunas
+// de CRM, animal e data; o registro inteiro e as juncoes so sao tocados se a
+// consulta entra em algum arquivo, e a linha e formatada uma vez so
+static void rotear_parte(void *ctx, int parte, int nPartes)
+{
+    RodadaGrupo *g = (RodadaGrupo *)ctx;
+    SaidaRelatorio *r = g->r;
+    ParteGrupo *pg = &g->partes[parte];
+    BufferTexto *b = &g_bufPartes[parte];
+    long total = g->fim - g->ini;
+    int ini = g->ini + (int)(total * parte / nPartes), fim = g->ini + (int)(total * (parte + 1) / nPartes);
+    b->n = 0;
+    pg->nTrechos = pg->nAdiadas = 0;
+    if (!g->ordem && !g->porCrm->n && !g->porEspecie)
+    {
+        rotear_datas(g, pg, ini, fim);
+        return;
+    }
+
+    for (int k = ini; k < fim; k++)
+    {
+        int i = g->ordem ? g->ordem[k] : k;
+        if (!g->ordem && !consulta_viva(i))
+            continue;
+
+        int oc = g->porCrm->n ? idx_buscar(g->porCrm, g_consCrm[i]) : -1;
+        int ia = -2, oe = -1, emData = 0;
+        if (g->porEspecie)
+        {
+            ia = encontrar_indice_animal_por_id(g_consAnimal[i]);
+            if (ia >= 0)
+                oe = g->porEspecie[g_animalEspecie[ia]];
+        }
+        for (int d = 0; d < g->nDatas && !emData; d++)
+            emData = g_consData[i] >= r[g->datas[d]].ini && g_consData[i] <= r[g->datas[d]].fim;
+        if (oc < 0 && oe < 0 && !emData)
+            continue;
+        if (ia == -2)
+            ia = encontrar_indice_animal_por_id(g_consAnimal[i]);
+        int iv = encontrar_indice_veterinario_por_crm(g_consCrm[i]);
+
+        if (oc >= 0 || oe >= 0)
+        {
+            if (!buffer_garantir(b, REL_LINHA_TAM))
+            {
+                pg->erro = 1;
+                return;
+            }
+            size_t off = b->n;
+            int tam = formatar_linha_relatorio(b->p + off, &g_consultas[i], ia, iv);
+            b->n += (size_t)tam;
+            if (oc >= 0 && !parte_trecho(pg, oc, off, tam))
+                pg->erro = 1;
+            for (int e = oe; e >= 0; e = r[e].proximo)
+                if (!parte_trecho(pg, e, off, tam))
+                    pg->erro = 1;
+        }
+        for (int d = 0; d < g->nDatas && emData; d++)
+        {
+            if (g_consData[i] < r[g->datas[d]].ini || g_consData[i] > r[g->datas[d]].fim)
+                continue;
+            if (!vetor_garantir((void **)&pg->adiadas, &pg->capAdiadas, pg->nAdiadas, sizeof(AdiadaParte)))
+            {
+                pg->erro = 1;
+                return;
+            }
+            AdiadaParte ap = {g->datas[d], {g_consData[i], g_consId[i], i, ia, iv}};
+            pg->adiadas[pg->nAdiadas++] = ap;
+        }
+    }
+}
+
+// Uma passada para os relatorios [ini, fim) do plano
+static int gerar_grupo(PlanoRelatorios *p, int ini, int fim, const int *ordem, int nOrdem)
+{
+    SaidaRelatorio *r = p->itens;
+    IndiceHash porCrm = {NULL, NULL, 0, 0};
+    int *porEspecie = NULL;
+    int datas[REL_MAX_ABERTOS], nDatas = 0;
+    char *bufs = (char *)malloc((size_t)(fim - ini) * (REL_BUF_GRUPO + SAIDA_FOLGA));
+    if (!bufs)
+        return 0;
+    int ok = 1, semArquivo = 0;
+
+    for (int i = ini; i < fim; i++)
+    {
+        if (!(r[i].f = fopen(r[i].arquivo, "w")))
+        {
+            // Os outros relatorios do grupo seguem; o grupo conta como falha
+            aviso("Erro ao criar arquivo %s.\n", r[i].arquivo);
+            semArquivo = 1;
+            continue;
+        }
+        saida_iniciar(&r[i].s, r[i].f, bufs + (size_t)(i - ini) * (REL_BUF_GRUPO + SAIDA_FOLGA), REL_BUF_GRUPO);
+        saida_texto(&r[i].s, r[i].titulo);
+        saida_texto(&r[i].s, "\n\n");
+        r[i].total = 0;
+        if (r[i].tipo == REL_CRM)
+            ok = ok && idx_inserir(&porCrm, r[i].chave, i);
+        else if (r[i].tipo == REL_ESPECIE && r[i].chave >= 0)
+        {
+            if (!porEspecie && (porEspecie = (int *)malloc((size_t)g_nEspecies * sizeof(int))) != NULL)
+                for (int e = 0; e < g_nEspecies; e++)
+                    porEspecie[e] = -1;
+            if (porEspecie)
+            {
+                r[i].proximo = porEspecie[r[i].chave];
+                porEspecie[r[i].chave] = i;
+            }
+            else
+                ok = 0;
+        }
+        else if (r[i].tipo == REL_DATA || r[i].tipo == REL_PERIODO)
+            datas[nDatas++] = i;
+    }
+
+    // Rodadas: as partes roteiam e formatam em paralelo; a principal entrega
+    // os trechos na ordem das partes, que e a ordem das consultas
+    int nPartes = nOrdem < FAIXA_MIN_PARALELO ? 1 : pool_tamanho();
+    ParteGrupo partes[POOL_MAX];
+    memset(partes, 0, sizeof(partes));
+    RodadaGrupo g = {r, &porCrm, porEspecie, datas, nDatas, ordem, 0, 0, partes};
+    for (int k = 0; k < nOrdem && ok; k += nPartes * FAIXA_ITENS)
+    {
+        g.ini = k;
+        g.fim = nOrdem - k < nPartes * FAIXA_ITENS ? nOrdem : k + nPartes * FAIXA_ITENS;
+        pool_executar(rotear_parte, &g, nPartes);
+        for (int q = 0; q < nPartes && ok; q++)
+        {
+            ParteGrupo *pg = &partes[q];
+            if (pg->erro)
+            {
+                ok = 0;
+                break;
+            }
+            for (int t = 0; t < pg->nTrechos; t++)
+            {
+                SaidaRelatorio *rt = &r[pg->trechos[t].saida];
+                saida_bytes(&rt->s, g_bufPartes[q].p + pg->trechos[t].off, (size_t)pg->trechos[t].tam);
+                rt->total++;
+            }
+            for (int a = 0; a < pg->nAdiadas && ok; a++)
+                ok = adiar_linha(&r[pg->adiadas[a].saida], &pg->adiadas[a].l);
+        }
+    }
+    for (int q = 0; q < POOL_MAX; q++)
+    {
+        free(partes[q].trechos);
+        free(partes[q].adiadas);
+        free(partes[q].sel);
+    }
+
+    // Relatorios por data: ordem cronologica (data, id), como no indice de datas
+    for (int d = 0; d < nDatas && ok; d++)
+    {
+        SaidaRelatorio *rd = &r[datas[d]];
+        qsort(rd->adiadas, (size_t)rd->nAdiadas, sizeof(LinhaAdiada), comparar_linha_adiada);
+        if (!formatar_em_ordem(&rd->s, rd->nAdiadas, formatar_item_adiado, rd->adiadas))
+            ok = 0;
+        rd->total = rd->nAdiadas;
+        free(rd->adiadas);
+        rd->adiadas = NULL;
+        rd->nAdiadas = rd->capAdiadas = 0;
+    }
+
+    for (int i = ini; i < fim; i++)
+    {
+        if (!r[i].f)
+            continue;
+        escrever_rodape_relatorio(&r[i].s, r[i].total);
+        int gravou = saida_fechar(&r[i].s);
+        if (fclose(r[i].f) != 0)
+            gravou = 0;
+        if (gravou && ok)
+            p->gravados++;
+        else
+            ok = 0;
+        r[i].f = NULL;
+    }
+    idx_liberar(&porCrm);
+    free(porEspecie);
+    free(bufs);
+    return ok && !semArquivo;
+}
+
+// Gera todos os relatorios do plano, sem mensagens; devolve 0 em erro de memoria ou gravacao
+static int executar_plano(PlanoRelatorios *p, int *passadas)
+{
+    int *ordem, nOrdem;
+    *passadas = 0;
+    p->gravados = 0;
+    if (!ordem_por_id(&ordem, &nOrdem))
+        return 0;
+    int ok = 1;
+    for (int ini = 0; ini < p->n && ok; ini += REL_MAX_ABERTOS, (*passadas)++)
+        ok = gerar_grupo(p, ini, p->n - ini < REL_MAX_ABERTOS ? p->n : ini + REL_MAX_ABERTOS, ordem, nOrdem);
+    free(ordem);
+    return ok;
+}
+
+static int gerar_relatorios(PlanoRelatorios *p)
+{
+    Medicao m = metrica_iniciar();
+    double inicio = m.inicio;
+    int passadas;
+    int ok = executar_plano(p, &passadas);
+    metrica_registrar(MET_RELATORIO, &m, (long long)passadas * g_nCons);
+    if (!ok)
+        aviso("Erro de memoria ou de gravacao nos relatorios.\n");
+    aviso("Relatorios gerados: %d arquivo(s) em %.3f s (%d passada(s) por %d consulta(s), %d thread(s)).\n", p->gravados,
+          agora_segundos() - inicio, passadas, tabela_ativos(&g_tabCons), pool_tamanho());
+    return ok;
+}
+
+int clinica_relatorios_todos(void)
+{
+    PlanoRelatorios p = {NULL, 0, 0, 0};
+    int r = CLINICA_OK;
+    compartilhado_ler();
+    if (!plano_todos_crm(&p) || !plano_todas_especies(&p))
+        r = CLINICA_ERRO_MEMORIA;
+    else if (p.n == 0)
+        r = CLINICA_NAO_ENCONTRADO;
+    else if (!gerar_relatorios(&p))
+        r = CLINICA_ERRO_GRAVACAO;
+    plano_liberar(&p);
+    return r;
+}
+
+// Lista do --relatorios, separada por virgulas: crm, especie (todos), crm:N,
+// especie:Nome, data:DD/MM/AAAA, periodo:DD/MM/AAAA:DD/MM/AAAA
+static int plano_de_texto(PlanoRelatorios *p, const char *lista)
+{
+    char buf[1024];
+    copiar_campo(buf, lista, sizeof(buf));
+    for (char *item = strtok(buf, ","); item; item = strtok(NULL, ","))
+    {
+        char *arg = strchr(item, ':');
+        if (arg)
+            *arg++ = '\0';
+        int ok, crm;
+        if (strcmp(item, "crm") == 0)
+            ok = arg ? ler_inteiro(arg, &crm) && plano_crm(p, crm) : plano_todos_crm(p);
+        else if (strcmp(item, "especie") == 0)
+            ok = arg ? plano_especie(p, arg) : plano_todas_especies(p);
+        else if (strcmp(item, "data") == 0)
+            ok = arg && plano_data(p, arg);
+        else if (strcmp(item, "periodo") == 0)
+        {
+            char *fim = arg ? strchr(arg, ':') : NULL;
+            if (fim)
+                *fim++ = '\0';
+            ok = fim && plano_periodo(p, arg, fim);
+        }
+        else
+            ok = 0;
+        if (!ok)
+        {
+            fprintf(stderr, "Relatorio invalido: %s%s%s\n", item, arg ? ":" : "", arg ? arg : "");
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int clinica_relatorios(const char *lista)
+{
+    PlanoRelatorios p = {NULL, 0, 0, 0};
+    int r = CLINICA_OK;
+    compartilhado_ler();
+    if (!plano_de_texto(&p, lista))
+        r = CLINICA_INVALIDO;
+    else if (!gerar_relatorios(&p))
+        r = CLINICA_ERRO_GRAVACAO;
+    plano_liberar(&p);
+    return r;
+}
+
+// ======== Estatisticas (receita e consultas) ========
+// Leem so os agregados mantidos pelo nucleo: o custo depende do numero de
+// veterinarios, especies e meses, nao do de consultas
+typedef struct
+{
+    int chave;
+    Agregado a;
+} LinhaEstat;
+
+static int comparar_linha_estat(const void *a, const void *b)
+{
+    int x = ((const LinhaEstat *)a)->chave, y = ((const LinhaEstat *)b)->chave;
+    return (x > y) - (x < y);
+}
+
+static int comparar_linha_especie(const void *a, const void *b)
+{
+    return strcmp(g_especies[((const LinhaEstat *)a)->chave].chave, g_especies[((const LinhaEstat *)b)->chave].chave);
+}
+
+// Media em centavos, com a metade arredondada para longe do zero
+static long long media_centavos(long long centavos, int visitas)
+{
+    long long m = ((centavos < 0 ? -centavos : centavos) * 2 + visitas) / (2LL * visitas);
+    return centavos < 0 ? -m : m;
+}
+
+static int formatar_linha_estat(char *buf, int tipo, const LinhaEstat *l)
+{
+    char *p = buf;
+    if (tipo == CLINICA_EST_VET)
+    {
+        int iv = encontrar_indice_veterinario_por_crm(l->chave);
+        p += FMT_LIT(p, "CRM ");
+        p += fmt_int(p, l->chave);
+        p += FMT_LIT(p, " | ");
+        p += iv >= 0 ? fmt_campo(p, g_vets[iv].nome, NOME_TAM) : FMT_LIT(p, "??");
+    }
+    else if (tipo == CLINICA_EST_ESPECIE)
+        p += fmt_campo(p, g_especies[l->chave].nome, ESPECIE_TAM);
+    else if (l->chave < 0)
+        p += FMT_LIT(p, "(data invalida)");
+    else
+    {
+        char d[10]; // "01/MM/AAAA" -> "MM/AAAA"
+        fmt_data(d, l->chave * 100 + 1, 0);
+        memcpy(p, d + 3, 7);
+        p += 7;
+    }
+    p += FMT_LIT(p, " | Consultas: ");
+    p += fmt_int(p, l->a.visitas);
+    p += FMT_LIT(p, " | Receita: R$ ");
+    p += fmt_centavos(p, l->a.centavos);
+    p += FMT_LIT(p, " | Media: R$ ");
+    p += fmt_centavos(p, media_centavos(l->a.centavos, l->a.visitas));
+    *p++ = '\n';
+    return (int)(p - buf);
+}
+
+// Uma linha por chave com consultas, em ordem de CRM, nome da especie ou mes.
+// Devolve 0 sem memoria.
+static int escrever_estatisticas(Saida *s, int tipo)
+{
+    const TabelaAgregados *t = tipo == CLINICA_EST_VET       ? &g_agrPorVet
+                               : tipo == CLINICA_EST_ESPECIE ? &g_agrPorEspecie
+                                                             : &g_agrPorMes;
+    LinhaEstat *v = (LinhaEstat *)malloc((size_t)(t->n > 0 ? t->n : 1) * sizeof(LinhaEstat));
+    if (!v)
+        return 0;
+    int n = 0;
+    for (int i = 0; i < t->n; i++)
+        if (t->valores[i].visitas > 0)
+        {
+            v[n].chave = t->chaves[i];
+            v[n].a = t->valores[i];
+            n++;
+        }
+    qsort(v, (size_t)n, sizeof(LinhaEstat),
+          tipo == CLINICA_EST_ESPECIE ? comparar_linha_especie : comparar_linha_estat);
+    for (int k = 0; k < n; k++)
+        saida_avancar(s, (size_t)formatar_linha_estat(saida_espaco(s), tipo, &v[k]));
+    if (n == 0)
+        saida_texto(s, "Nenhuma consulta cadastrada.\n");
+    free(v);
+    return 1;
+}
+
+// Todas as consultas caem em algum mes (ou em "data invalida")
+static void escrever_total_estatisticas(Saida *s)
+{
+    long long total = 0;
+    long visitas = 0;
+    for (int i = 0; i < g_agrPorMes.n; i++)
+    {
+        total += g_agrPorMes.valores[i].centavos;
+        visitas += g_agrPorMes.valores[i].visitas;
+    }
+    saida_texto(s, "Total: ");
+    saida_int(s, visitas);
+    saida_texto(s, " consultas | Receita: R$ ");
+    saida_avancar(s, (size_t)fmt_centavos(saida_espaco(s), total));
+    saida_char(s, '\n');
+}
+
+int clinica_estatisticas(FILE *f, int tipo)
+{
+    if (tipo < CLINICA_EST_VET || tipo > CLINICA_EST_MES)
+        return CLINICA_INVALIDO;
+    compartilhado_ler();
+    Saida s;
+    saida_iniciar(&s, f, g_listaBuf, LISTA_BUF_TAM);
+    int ok = escrever_estatisticas(&s, tipo);
+    if (ok)
+        escrever_total_estatisticas(&s);
+    saida_fechar(&s);
+    return ok ? CLINICA_OK : CLINICA_ERRO_MEMORIA;
+}
+
+int clinica_relatorio_estatisticas(char *arquivo, size_t tam)
+{
+    snprintf(arquivo, tam, "relatorio_estatisticas.txt");
+    compartilhado_ler();
+    Medicao m = metrica_iniciar();
+    FILE *f = fopen(arquivo, "w");
+    if (!f)
+        return CLINICA_ERRO_ARQUIVO;
+
+    Saida s;
+    saida_iniciar(&s, f, g_listaBuf, LISTA_BUF_TAM);
+    saida_texto(&s, "RELATORIO: Receita e consultas\n\n");
+    escrever_total_estatisticas(&s);
+    saida_texto(&s, "\nPor veterinario:\n");
+    if (!escrever_estatisticas(&s, CLINICA_EST_VET))
+        s.erro = 1;
+    saida_texto(&s, "\nPor especie:\n");
+    if (!escrever_estatisticas(&s, CLINICA_EST_ESPECIE))
+        s.erro = 1;
+    saida_texto(&s, "\nPor mes:\n");
+    if (!escrever_estatisticas(&s, CLINICA_EST_MES))
+        s.erro = 1;
+    int ok = fechar_relatorio(&s, f, &m, g_agrPorVet.n + g_agrPorEspecie.n + g_agrPorMes.n);
+    return ok ? CLINICA_OK : CLINICA_ERRO_GRAVACAO;
+}
+// ======== Popular exemplos (opcional til para gerar os .bin com >=10) ========
+// Nomes tambem usados pelo gerador (--gerar)
+static const char *const g_exemploAnimais[10] = {"Luna", "Thor", "Mel", "Rex", "Nina", "Bob", "Maya", "Max", "Lola", "Koda"};
+static const char *const g_exemploVets[10] = {"Dr. Silva", "Dra. Souza", "Dr. Pereira", "Dra. Rocha", "Dr. Lima",
+                                              "Dra. Alves", "Dr. Gomes", "Dra. Costa", "Dr. Araujo", "Dra. Moraes"};
+
+static int popular_exemplos()
+{
+    // Limpar atuais
+    limpar_tudo();
+
+    // Animais (10)
+    const char *espsA[10] = {"Cachorro", "Gato", "Cachorro", "Cachorro", "Gato", "Cachorro", "Passaro", "Gato", "Cachorro", "Coelho"};
+    const char *datasA[10] = {"01/01/2020", "15/03/2019", "22/07/2021", "05/11/2018", "09/09/2020", "30/06/2017", "12/12/2022", "25/05/2016", "10/10/2019", "02/08/2023"};
+    double pesosA[10] = {12.5, 4.2, 9.8, 20.1, 3.9, 18.0, 0.2, 5.0, 14.3, 1.1};
+
+    if (!tabela_reservar(&g_tabAnimais, 10) || !tabela_reservar(&g_tabVets, 10) || !tabela_reservar(&g_tabCons, 10))
+        return CLINICA_ERRO_MEMORIA;
+
+    for (int i = 0; i < 10; i++)
+    {
+        Animal a;
+        a.idAnimal = g_nextIdAnimal++;
+        strncpy(a.nome, g_exemploAnimais[i], NOME_TAM);
+        a.nome[NOME_TAM - 1] = '\0';
+        strncpy(a.especie, espsA[i], ESPECIE_TAM);
+        a.especie[ESPECIE_TAM - 1] = '\0';
+        strncpy(a.dataNascimento, datasA[i], DATA_TAM);
+        a.dataNascimento[DATA_TAM - 1] = '\0';
+        a.peso = pesosA[i];
+        inserir_animal(&a);
+    }
+
+    // Veterinarios (10)
+    const char *telsV[10] = {"34-1111-1111", "34-2222-2222", "34-3333-3333", "34-4444-4444", "34-5555-5555",
+                             "34-6666-6666", "34-7777-7777", "34-8888-8888", "34-9999-9999", "34-1234-5678"};
+    for (int i = 0; i < 10; i++)
+    {
+        Veterinario v;
+        v.crmVet = 1000 + i; // nico
+        strncpy(v.nome, g_exemploVets[i], NOME_TAM);
+        v.nome[NOME_TAM - 1] = '\0';
+        strncpy(v.telefone, telsV[i], TELEFONE_TAM);
+        v.telefone[TELEFONE_TAM - 1] = '\0';
+        inserir_vet(&v);
+    }
+
+    // Consultas (10)  distribui datas e valores
+    const char *datasC[10] = {"01/09/2024", "15/10/2024", "20/12/2024", "03/01/2025", "18/02/2025",
+                              "05/03/2025", "22/04/2025", "10/05/2025", "19/06/2025", "01/07/2025"};
+    double valores[10] = {120, 150, 90, 200, 80, 140, 95, 110, 180, 160};
+
+    for (int i = 0; i < 10; i++)
+    {
+        Consulta c;
+        c.idConsulta = g_nextIdConsulta++;
+        c.idAnimal = g_animais[(i * 3) % 10].idAnimal;
+        c.crmVet = g_vets[(i * 2) % 10].crmVet;
+        strncpy(c.dataConsulta, datasC[i], DATA_TAM);
+        c.dataConsulta[DATA_TAM - 1] = '\0';
+        c.valor = valores[i];
+        inserir_consulta(&c);
+    }
+    return CLINICA_OK;
+}
+
+int clinica_popular_exemplos(void)
+{
+    int r = compartilhado_escrever();
+    return r == CLINICA_OK ? compartilhado_publicar(popular_exemplos()) : r;
+}
+
+// ======== Gerador de dados sinteticos (--gerar) ========
+// Bases do tamanho que se queira, sempre iguais para a mesma semente, com
+// distribuicoes parecidas com as de uma clinica de verdade:
+//  - carga dos veterinarios em Zipf: o k-esimo mais procurado atende ~1/k;
+//  - visitas por animal concentradas (1/(k+q)): poucos voltam muito e a
+//    maioria aparece poucas vezes;
+//  - mistura de especies com participacao, preco e peso tipicos de cada uma;
+//  - datas com crescimento ano a ano, sazonalidade mensal e sem domingos,
+//    cadastradas em ordem cronologica (o id cresce com a data).
+// O log fica suspenso durante a geracao e um checkpoint grava os .bin de uma
+// vez; com --sem-gravar os dados ficam so na memoria desta execucao.
+#define GERAR_ANO_INI 2016
+#define GERAR_ANOS 10
+#define GERAR_NASC_INI 2005 // nascimentos entre 2005 e 2024
+#define GERAR_NASC_ANOS 20
+#define GERAR_TENTATIVAS 8 // sorteios de animal ate achar um nascido antes da consulta
+
+typedef struct
+{
+    const char *nome;
+    double participacao; // peso na mistura de especies
+    double preco;        // valor medio da consulta
+    double kgMin, kgMax;
+} EspecieGerada;
+
+static const EspecieGerada g_especiesGeradas[] = {
+    {"Cachorro", 45, 180, 2, 45}, {"Gato", 33, 150, 2.5, 7},       {"Passaro", 8, 120, 0.02, 1.2},
+    {"Coelho", 6, 130, 1, 5},     {"Hamster", 4, 90, 0.03, 0.2},   {"Tartaruga", 3, 140, 0.2, 8},
+    {"Peixe", 1, 80, 0.01, 0.5}};
+#define GERAR_ESPECIES ((int)(sizeof(g_especiesGeradas) / sizeof(g_especiesGeradas[0])))
+
+// Movimento relativo de cada mes (ferias e fim de ano mais cheios)
+static const double g_sazonalidade[12] = {1.30, 1.25, 1.10, 0.95, 0.90, 0.85, 0.85, 0.90, 0.95, 1.00, 1.10, 1.35};
+static const char *const g_sobrenomes[10] = {"Nunes",   "Barros",  "Teixeira", "Campos",  "Ribeiro",
+                                             "Fonseca", "Mendes",  "Cardoso",  "Freitas", "Duarte"};
+
+// splitmix64: estado de 64 bits, rapido e com boa distribuicao
+static uint64_t sortear_u64(uint64_t *s)
+{
+    uint64_t z = (*s += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static double sortear_real(uint64_t *s) // [0, 1)
+{
+    return (double)(sortear_u64(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int sortear_int(uint64_t *s, int n) // [0, n)
+{
+    return (int)(sortear_real(s) * n);
+}
+
+// Aproximadamente normal padrao (soma de 12 uniformes), sem depender da libm
+static double sortear_normal(uint64_t *s)
+{
+    double x = -6.0;
+    for (int i = 0; i < 12; i++)
+        x += sortear_real(s);
+    return x;
+}
+
+// Posicao sorteada numa distribuicao acumulada de n pesos
+static int sortear_acumulada(const double *acum, int n, uint64_t *s)
+{
+    double x = sortear_real(s) * acum[n - 1];
+    int lo = 0, hi = n - 1;
+    while (lo < hi)
+    {
+        int m = lo + (hi - lo) / 2;
+        if (acum[m] > x)
+            hi = m;
+        else
+            lo = m + 1;
+    }
+    return lo;
+}
+
+// Pesos 1/(k+q) para k = 1..n, acumulados; 'perm' (embaralhada) diz qual
+// registro ocupa cada posto, para o mais procurado nao ser sempre o primeiro
+static void zipf_acumulada(double *acum, int *perm, int n, double q, uint64_t *s)
+{
+    double soma = 0;
+    for (int k = 0; k < n; k++)
+    {
+        soma += 1.0 / (k + 1 + q);
+        acum[k] = soma;
+        perm[k] = k;
+    }
+    for (int k = n - 1; k > 0; k--)
+    {
+        int j = sortear_int(s, k + 1);
+        int t = perm[k];
+        perm[k] = perm[j];
+        perm[j] = t;
+    }
+}
+
+static int dias_no_mes(int m, int a)
+{
+    static const int dias[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    return m == 2 && (a % 4 == 0 && (a % 100 != 0 || a % 400 == 0)) ? 29 : dias[m - 1];
+}
+
+// 0 = domingo (metodo de Sakamoto)
+static int dia_da_semana(int a, int m, int d)
+{
+    static const int t[12] = {0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4};
+    if (m < 3)
+        a--;
+    return (a + a / 4 - a / 100 + a / 400 + t[m - 1] + d) % 7;
+}
+
+static double arredondar_centavos(double v)
+{
+    return (double)(long long)(v * 100.0 + 0.5) / 100.0;
+}
+
+// Substitui tudo por uma base gerada; devolve 0 em erro de memoria ou de gravacao
+static int gerar_base(int nCons, int nAnimais, int nVets, int semente, int gravar)
+{
+    double inicio = agora_segundos();
+    uint64_t s = (uint64_t)(unsigned)semente;
+
+    // Dias de atendimento: peso do ano (cresce 8% ao ano) x peso do mes
+    enum { MAX_DIAS = GERAR_ANOS * 366 };
+    static int dias[MAX_DIAS];
+    static double acumDias[MAX_DIAS];
+    int nDias = 0;
+    double soma = 0;
+    for (int a = GERAR_ANO_INI; a < GERAR_ANO_INI + GERAR_ANOS; a++)
+        for (int m = 1; m <= 12; m++)
+            for (int d = 1; d <= dias_no_mes(m, a); d++)
+            {
+                if (dia_da_semana(a, m, d) == 0)
+                    continue;
+                soma += (1.0 + 0.08 * (a - GERAR_ANO_INI)) * g_sazonalidade[m - 1];
+                dias[nDias] = a * 10000 + m * 100 + d;
+                acumDias[nDias++] = soma;
+            }
+    double acumEsp[GERAR_ESPECIES];
+    soma = 0;
+    for (int e = 0; e < GERAR_ESPECIES; e++)
+        acumEsp[e] = soma += g_especiesGeradas[e].participacao;
+
+    double *acumV = (double *)malloc((size_t)nVets * sizeof(double));
+    double *acumA = (double *)malloc((size_t)nAnimais * sizeof(double));
+    int *permV = (int *)malloc((size_t)nVets * sizeof(int));
+    int *permA = (int *)malloc((size_t)nAnimais * sizeof(int));
+    int *nascA = (int *)malloc((size_t)nAnimais * sizeof(int));
+    unsigned char *espA = (unsigned char *)malloc((size_t)nAnimais);
+    int *porDia = (int *)calloc((size_t)nDias, sizeof(int));
+    int ok = acumV && acumA && permV && permA && nascA && espA && porDia;
+
+    FILE *wal = g_wal;
+    g_wal = NULL; // nada vai para o log: o checkpoint do fim grava tudo
+    g_ctlForaDoLog = 1;
+    if (ok)
+    {
+        limpar_tudo();
+        ok = tabela_reservar(&g_tabAnimais, nAnimais) && tabela_reservar(&g_tabVets, nVets) &&
+             tabela_reservar(&g_tabCons, nCons);
+    }
+
+    for (int i = 0; i < nVets && ok; i++)
+    {
+        Veterinario v;
+        memset(&v, 0, sizeof(v));
+        v.crmVet = 1000 + i;
+        snprintf(v.nome, NOME_TAM, "%s %s", g_exemploVets[i % 10], g_sobrenomes[i / 10 % 10]);
+        snprintf(v.telefone, TELEFONE_TAM, "34-%04d-%04d", sortear_int(&s, 10000), sortear_int(&s, 10000));
+        ok = inserir_vet(&v) >= 0;
+    }
+
+    for (int i = 0; i < nAnimais && ok; i++)
+    {
+        int e = sortear_acumulada(acumEsp, GERAR_ESPECIES, &s);
+        const EspecieGerada *eg = &g_especiesGeradas[e];
+        int ano = GERAR_NASC_INI + sortear_int(&s, GERAR_NASC_ANOS), mes = 1 + sortear_int(&s, 12);
+        int dia = 1 + sortear_int(&s, dias_no_mes(mes, ano));
+        Animal a;
+        memset(&a, 0, sizeof(a));
+        a.idAnimal = g_nextIdAnimal++;
+        copiar_campo(a.nome, g_exemploAnimais[sortear_int(&s, 10)], NOME_TAM);
+        copiar_campo(a.especie, eg->nome, ESPECIE_TAM);
+        fmt_data(a.dataNascimento, ano * 10000 + mes * 100 + dia, 0);
+        a.peso = arredondar_centavos(eg->kgMin + (eg->kgMax - eg->kgMin) * sortear_real(&s));
+        nascA[i] = ano * 10000 + mes * 100 + dia;
+        espA[i] = (unsigned char)e;
+        ok = inserir_animal(&a) >= 0;
+    }
+
+    // Quantas consultas cada dia recebe; depois os dias saem em ordem
+    if (ok)
+    {
+        zipf_acumulada(acumV, permV, nVets, 0, &s);
+        zipf_acumulada(acumA, permA, nAnimais, nAnimais / 100.0, &s);
+        for (int i = 0; i < nCons; i++)
+            porDia[sortear_acumulada(acumDias, nDias, &s)]++;
+    }
+    for (int d = 0; d < nDias && ok; d++)
+        for (int k = 0; k < porDia[d] && ok; k++)
+        {
+            int ia = permA[sortear_acumulada(acumA, nAnimais, &s)];
+            for (int t = 1; t < GERAR_TENTATIVAS && nascA[ia] > dias[d]; t++)
+                ia = permA[sortear_acumulada(acumA, nAnimais, &s)];
+            double preco = g_especiesGeradas[espA[ia]].preco;
+            double valor = preco * (1.0 + 0.25 * sortear_normal(&s));
+            Consulta c;
+            memset(&c, 0, sizeof(c));
+            c.idConsulta = g_nextIdConsulta++;
+            c.idAnimal = ia + 1; // ids dos animais gerados sao 1..nAnimais
+            c.crmVet = 1000 + permV[sortear_acumulada(acumV, nVets, &s)];
+            fmt_data(c.dataConsulta, dias[d], 0);
+            c.valor = arredondar_centavos(valor < 0.3 * preco ? 0.3 * preco : valor);
+            ok = inserir_consulta(&c) >= 0;
+        }
+    g_wal = wal;
+
+    free(acumV);
+    free(acumA);
+    free(permV);
+    free(permA);
+    free(nascA);
+    free(espA);
+    free(porDia);
+    if (!ok)
+    {
+        aviso("Erro de memoria.\n");
+        return CLINICA_ERRO_MEMORIA;
+    }
+    aviso("Gerados: %d animais, %d veterinarios e %d consultas em %.3f s (semente %d).\n", nAnimais, nVets, nCons,
+          agora_segundos() - inicio, semente);
+    if (gravar)
+        return checkpoint() ? CLINICA_OK : CLINICA_ERRO_GRAVACAO;
+    if (g_wal)
+        fclose(g_wal);
+    g_wal = NULL;
+    g_semGravar = 1;
+    aviso("Dados so em memoria (--sem-gravar): nada sera gravado nesta execucao.\n");
+    return CLINICA_OK;
+}
+
+int clinica_gerar(int nCons, int nAnimais, int nVets, int semente, int gravar)
+{
+    // Toda consulta sorteia um animal e um veterinario; os CRMs vao de 1000 a 999 + nVets
+    if (nCons < 0 || nAnimais < 1 || nVets < 1 || nVets > INT_MAX - 1000)
+        return CLINICA_INVALIDO;
+    int r = compartilhado_escrever();
+    return r == CLINICA_OK ? compartilhado_publicar(gerar_base(nCons, nAnimais, nVets, semente, gravar)) : r;
+}
+
+// ======== Uso de memoria das tabelas ========
+static void mostrar_tabela_memoria(FILE *f, const Tabela *t)
+{
+    size_t linha = t->tamElem;
+    for (int c = 0; c < t->nColunas; c++)
+        linha += t->colunas[c].tam;
+    fprintf(f, "%-13s | reg: %8d | lapides: %7d | cap: %8d | %10lu bytes | alocacoes: %6ld | copiados: %lld bytes%s\n",
+               t->nome, tabela_ativos(t), t->nRemovidos, t->cap, (unsigned long)((size_t)t->cap * linha),
+               t->alocacoes, t->bytesCopiados, t->mapa ? " | mmap" : "");
+}
+
+void clinica_uso_memoria(FILE *f)
+{
+    mostrar_tabela_memoria(f, &g_tabAnimais);
+    mostrar_tabela_memoria(f, &g_tabVets);
+    mostrar_tabela_memoria(f, &g_tabCons);
+}
+
+// ======== Diagnostico (metricas das operacoes) ========
+#define MET_BARRA 30 // largura da maior barra do histograma
+
+static long long metrica_buscas()
+{
+    return g_metThread.buscas + g_metAuxiliares.buscas;
+}
+
+static long long metrica_realocacoes()
+{
+    return g_metThread.realocacoes + g_metAuxiliares.realocacoes;
+}
+
+// Limite superior (us) da faixa em que cai a fracao p das chamadas; na
+// ultima faixa, que nao tem limite, vale o maior tempo visto
+static double metrica_percentil(const MetricaOp *o, double p)
+{
+    long long alvo = (long long)(p * (double)o->chamadas + 0.5), acum = 0;
+    if (alvo < 1)
+        alvo = 1;
+    for (int k = 0; k < MET_FAIXAS - 1; k++)
+    {
+        acum += o->faixas[k];
+        if (acum >= alvo)
+            return (double)(2ull << k);
+    }
+    return o->maximo * 1e6;
+}
+
+void clinica_metricas(FILE *f)
+{
+    fprintf(f, "Desde a partida: %.1f s, %d thread(s).\n", agora_segundos() - g_metInicio, pool_tamanho());
+    fprintf(f, "%-16s %9s %12s %11s %11s %11s %10s %9s %9s %10s\n", "operacao", "chamadas", "linhas", "lidos(KB)",
+               "gravad(KB)", "total(ms)", "media(us)", "p50(us)", "p99(us)", "max(us)");
+    for (int op = 0; op < MET_QTD; op++)
+    {
+        const MetricaOp *o = &g_metricas[op];
+        if (o->chamadas == 0)
+            continue;
+        fprintf(f, "%-16s %9lld %12lld %11lld %11lld %11.2f %10.1f %9.0f %9.0f %10.1f\n", g_metNomes[op], o->chamadas,
+                   o->linhas, o->bytesLidos / 1024, o->bytesGravados / 1024, o->total * 1e3,
+                   o->total * 1e6 / (double)o->chamadas, metrica_percentil(o, 0.5), metrica_percentil(o, 0.99),
+                   o->maximo * 1e6);
+    }
+    fprintf(f, "Buscas nos indices: %lld | Realocacoes: %lld\n", metrica_buscas(), metrica_realocacoes());
+    fprintf(f, "Bytes lidos: %lld | Gravados: .bin %lld, log %lld, relatorios/listagens/exportacoes %lld\n",
+               g_bytesLidos, g_bytesGravados, g_bytesLog, g_bytesSaida);
+    fprintf(f, "(p50 e p99: limite superior da faixa do histograma em que o percentil cai)\n");
+}
+
+void clinica_histogramas(FILE *f)
+{
+    int algum = 0;
+    for (int op = 0; op < MET_QTD; op++)
+    {
+        const MetricaOp *o = &g_metricas[op];
+        if (o->chamadas == 0)
+            continue;
+        long long maior = 0;
+        for (int k = 0; k < MET_FAIXAS; k++)
+            if (o->faixas[k] > maior)
+                maior = o->faixas[k];
+        fprintf(f, "%s (%lld chamada(s))\n", g_metNomes[op], o->chamadas);
+        for (int k = 0; k < MET_FAIXAS; k++)
+        {
+            if (o->faixas[k] == 0)
+                continue;
+            char barra[MET_BARRA + 1];
+            int w = (int)((o->faixas[k] * MET_BARRA + maior - 1) / maior);
+            memset(barra, '#', (size_t)w);
+            barra[w] = '\0';
+            if (k == MET_FAIXAS - 1)
+                fprintf(f, "  >= %9llu us | %-*s %lld\n", 1ull << k, MET_BARRA, barra, o->faixas[k]);
+            else
+                fprintf(f, "  %7llu-%-7llu us | %-*s %lld\n", k ? 1ull << k : 0ull, 2ull << k, MET_BARRA, barra,
+                           o->faixas[k]);
+        }
+        algum = 1;
+    }
+    if (!algum)
+        fprintf(f, "Nenhuma operacao medida ainda.\n");
+}
+
+// Mesmos numeros em JSON, para ferramentas
+int clinica_gravar_metricas(const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return CLINICA_ERRO_ARQUIVO;
+    fprintf(f, "{\n  \"duracao_s\": %.6f,\n  \"threads\": %d,\n", agora_segundos() - g_metInicio, pool_tamanho());
+    fprintf(f, "  \"buscas\": %lld,\n  \"realocacoes\": %lld,\n  \"bytes_lidos\": %lld,\n", metrica_buscas(),
+            metrica_realocacoes(), g_bytesLidos);
+    fprintf(f, "  \"bytes_gravados\": {\"bin\": %lld, \"log\": %lld, \"saida\": %lld},\n", g_bytesGravados,
+            g_bytesLog, g_bytesSaida);
+    fprintf(f, "  \"faixas_us\": [");
+    for (int k = 0; k < MET_FAIXAS; k++)
+        fprintf(f, "%s%llu", k ? ", " : "", k ? 1ull << k : 0ull);
+    fprintf(f, "],\n  \"operacoes\": {\n");
+    for (int op = 0; op < MET_QTD; op++)
+    {
+        const MetricaOp *o = &g_metricas[op];
+        fprintf(f,
+                "    \"%s\": {\"chamadas\": %lld, \"linhas\": %lld, \"bytes_lidos\": %lld, \"bytes_gravados\": %lld, "
+                "\"total_s\": %.6f, \"max_s\": %.6f, \"p50_us\": %.1f, \"p99_us\": %.1f, \"histograma\": [",
+                g_metNomes[op], o->chamadas, o->linhas, o->bytesLidos, o->bytesGravados, o->total, o->maximo,
+                o->chamadas ? metrica_percentil(o, 0.5) : 0.0, o->chamadas ? metrica_percentil(o, 0.99) : 0.0);
+        for (int k = 0; k < MET_FAIXAS; k++)
+            fprintf(f, "%s%lld", k ? ", " : "", o->faixas[k]);
+        fprintf(f, "]}%s\n", op < MET_QTD - 1 ? "," : "");
+    }
+    fprintf(f, "  }\n}\n");
+    return fclose(f) == 0 ? CLINICA_OK : CLINICA_ERRO_GRAVACAO;
+}
+
+void clinica_zerar_metricas(void)
+{
+    memset(g_metricas, 0, sizeof(g_metricas));
+    memset(&g_metThread, 0, sizeof(g_metThread));
+    memset(&g_metAuxiliares, 0, sizeof(g_metAuxiliares));
+    g_bytesLidos = g_bytesGravados = g_bytesLog = g_bytesSaida = 0;
+    g_metInicio = agora_segundos();
+}
+
+void clinica_falhar_realocacao(int n)
+{
+    g_falharRealocacao = n > 0 ? n : 0;
+}
+
+// ======== API: persistencia ========
+int clinica_sincronizar(void)
+{
+    return !g_wal || wal_sincronizar() ? CLINICA_OK : CLINICA_ERRO_GRAVACAO;
+}
+
+// Fecha um grupo (menu, lote, importacao): sincroniza o log e faz a
+// manutencao de sempre
+int clinica_confirmar(void)
+{
+    compactar_tabelas(0);
+    int ok = !g_wal || wal_sincronizar();
+    if (g_walBytes >= WAL_CHECKPOINT_BYTES)
+        ok = checkpoint() && ok;
+    return ok ? CLINICA_OK : CLINICA_ERRO_GRAVACAO;
+}
+
+// Com o log ativo, salvar custa so as alteracoes pendentes
+int clinica_salvar(void)
+{
+    if (!g_wal)
+        return checkpoint() ? CLINICA_OK : CLINICA_ERRO_GRAVACAO;
+    if (wal_sincronizar())
+        return CLINICA_OK;
+    aviso("Falha ao gravar o log.\n");
+    return CLINICA_ERRO_GRAVACAO;
+}
+
+int clinica_checkpoint(void)
+{
+    return checkpoint() ? CLINICA_OK : CLINICA_ERRO_GRAVACAO;
+}
+
+int clinica_consolidar(void)
+{
+    if (!wal_sincronizar() || g_walBytes >= WAL_CHECKPOINT_BYTES)
+        return clinica_checkpoint();
+    return CLINICA_OK;
+}
+// ======== Importacao CSV (--importar) ========
+// Arquivos CSV com uma linha por registro e cabecalho opcional:
+//   animais:   id,nome,especie,nascimento,peso   (id vazio = proximo livre)
+//   vets:      crm,nome,telefone
+//   consultas: id,idAnimal,crm,data,valor         (id vazio = proximo livre)
+// O arquivo e lido em blocos; cada bloco e dividido em faixas de linhas
+// convertidas em paralelo (formato, tamanhos, datas). A thread principal
+// confere chaves e FKs pelos indices hash, na ordem do arquivo, e insere pelo
+// nucleo. Linhas rejeitadas vao para <arquivo>.erros com o numero da linha.
+// Campos entre aspas podem conter virgulas ("" = aspas), mas nao quebras de linha.
+#define CSV_BLOCO_TAM (4 * 1024 * 1024)
+#define CSV_MAX_CAMPOS 5
+#define CSV_LINHA_TAM 1024 // mesmo limite de linha do --lote
+
+#define CSV_ANIMAIS 0
+#define CSV_VETS 1
+#define CSV_CONS 2
+
+typedef struct
+{
+    long linha;        // relativa ao inicio da faixa
+    const char *texto; // linha original (dentro do bloco), para o arquivo de erros
+    int tam;
+    const char *erro; // NULL = formato ok
+    int temId;        // animais/consultas: id informado no arquivo
+    RegistroQualquer reg;
+} LinhaCsv;
+
+typedef struct
+{
+    int tipo;
+    const char *ini, *fim; // faixa do bloco, termina em fim de linha
+    int pularCabecalho;
+    LinhaCsv *linhas;
+    int n, cap;
+    long nLinhas; // linhas fisicas da faixa (inclusive vazias)
+    int semMemoria;
+} FaixaCsv;
+
+// Separa os campos de 's' (ja copiada) no lugar; devolve a quantidade ou -1
+static int csv_campos(char *s, char **campos, int max)
+{
+    int n = 0;
+    for (;;)
+    {
+        if (n == max)
+            return -1;
+        char *out = s;
+        campos[n++] = s;
+        if (*s == '"')
+        {
+            s++;
+            for (;;)
+            {
+                if (*s == '\0')
+                    return -1; // aspas sem fechar
+                if (*s == '"' && s[1] == '"')
+                {
+                    *out++ = '"';
+                    s += 2;
+                }
+                else if (*s == '"')
+                {
+                    s++;
+                    break;
+                }
+                else
+                    *out++ = *s++;
+            }
+            if (*s != ',' && *s != '\0')
+                return -1;
+        }
+        else
+        {
+            while (*s && *s != ',')
+                *out++ = *s++;
+        }
+        int fimLinha = *s == '\0';
+        *out = '\0';
+        if (fimLinha)
+            return n;
+        s++;
+    }
+}
+
+static int csv_texto(char *dst, const char *src, size_t tam)
+{
+    if (strlen(src) >= tam)
+        return 0;
+    strcpy(dst, src);
+    return 1;
+}
+
+// Id opcional: vazio -> 0
+static int csv_id(const char *s, int *id)
+{
+    if (*s == '\0')
+    {
+        *id = 0;
+        return 1;
+    }
+    return ler_inteiro(s, id) && *id > 0;
+}
+
+// Converte uma linha ja separada; devolve a mensagem de erro ou NULL
+static const char *csv_converter(int tipo, char **c, int n, LinhaCsv *l)
+{
+    static const int nCampos[3] = {5, 3, 5};
+    if (n != nCampos[tipo])
+        return "quantidade de campos errada";
+    memset(&l->reg, 0, sizeof(l->reg));
+    switch (tipo)
+    {
+    case CSV_ANIMAIS:
+    {
+        Animal *a = &l->reg.a;
+        if (!csv_id(c[0], &a->idAnimal))
+            return "id invalido";
+        if (!csv_texto(a->nome, c[1], NOME_TAM) || !csv_texto(a->especie, c[2], ESPECIE_TAM))
+            return "campo muito longo";
+        if (!csv_texto(a->dataNascimento, c[3], DATA_TAM) || data_to_int(a->dataNascimento) < 0)
+            return "data invalida";
+        if (!ler_real(c[4], &a->peso) || a->peso < 0)
+            return "peso invalido";
+        l->temId = a->idAnimal > 0;
+        return NULL;
+    }
+    case CSV_VETS:
+    {
+        Veterinario *v = &l->reg.v;
+        if (!ler_inteiro(c[0], &v->crmVet) || v->crmVet <= 0)
+            return "CRM invalido";
+        if (!csv_texto(v->nome, c[1], NOME_TAM) || !csv_texto(v->telefone, c[2], TELEFONE_TAM))
+            return "campo muito longo";
+        return NULL;
+    }
+    default:
+    {
+        Consulta *k = &l->reg.c;
+        if (!csv_id(c[0], &k->idConsulta))
+            return "id invalido";
+        if (!ler_inteiro(c[1], &k->idAnimal) || !ler_inteiro(c[2], &k->crmVet))
+            return "FK invalida";
+        if (!csv_texto(k->dataConsulta, c[3], DATA_TAM) || data_to_int(k->dataConsulta) < 0)
+            return "data invalida";
+        if (!ler_real(c[4], &k->valor) || k->valor < 0)
+            return "valor invalido";
+        l->temId = k->idConsulta > 0;
+        return NULL;
+    }
+    }
+}
+
+// Trabalho de uma thread: converte todas as linhas da faixa
+static void csv_converter_faixa(FaixaCsv *fx)
+{
+    char copia[CSV_LINHA_TAM];
+    char *campos[CSV_MAX_CAMPOS];
+    const char *p = fx->ini;
+    while (p < fx->fim)
+    {
+        const char *nl = (const char *)memchr(p, '\n', (size_t)(fx->fim - p));
+        const char *fimLinha = nl ? nl : fx->fim;
+        long linha = fx->nLinhas++;
+        int tam = (int)(fimLinha - p);
+        if (tam > 0 && p[tam - 1] == '\r')
+            tam--;
+        const char *texto = p;
+        p = nl ? nl + 1 : fx->fim;
+        if (tam == 0)
+            continue;
+
+        if (fx->n == fx->cap)
+        {
+            int novo = fx->cap ? fx->cap * 2 : 1024;
+            LinhaCsv *l = (LinhaCsv *)realocar(fx->linhas, (size_t)novo * sizeof(LinhaCsv));
+            if (!l)
+            {
+                fx->semMemoria = 1;
+                return;
+            }
+            fx->linhas = l;
+            fx->cap = novo;
+        }
+        LinhaCsv *l = &fx->linhas[fx->n];
+        l->linha = linha;
+        l->texto = texto;
+        l->tam = tam;
+        l->temId = 0;
+        if (tam >= CSV_LINHA_TAM)
+        {
+            l->erro = "linha muito longa";
+            fx->n++;
+            continue;
+        }
+        memcpy(copia, texto, (size_t)tam);
+        copia[tam] = '\0';
+        int n = csv_campos(copia, campos, CSV_MAX_CAMPOS);
+        // Cabecalho: primeira linha com o primeiro campo nao numerico
+        if (fx->pularCabecalho && linha == 0 && n > 0 && campos[0][0] != '\0' &&
+            (campos[0][0] < '0' || campos[0][0] > '9'))
+            continue;
+        l->erro = n < 0 ? "campos mal formados" : csv_converter(fx->tipo, campos, n, l);
+        fx->n++;
+    }
+}
+
+// Chaves de data das consultas aceitas no bloco atual (intercaladas no fim)
+static ChaveData *g_csvDatas = NULL;
+static int g_csvNDatas = 0, g_csvCapDatas = 0;
+
+// Confere chaves e FKs contra as tabelas e insere; devolve o erro ou NULL
+static const char *csv_inserir(int tipo, LinhaCsv *l)
+{
+    switch (tipo)
+    {
+    case CSV_ANIMAIS:
+    {
+        Animal *a = &l->reg.a;
+        if (!l->temId)
+            a->idAnimal = g_nextIdAnimal;
+        else if (encontrar_indice_animal_por_id(a->idAnimal) >= 0)
+            return "id de animal repetido";
+        if (inserir_animal(a) < 0)
+            return "erro de memoria";
+        if (a->idAnimal >= g_nextIdAnimal)
+            g_nextIdAnimal = a->idAnimal + 1;
+        return NULL;
+    }
+    case CSV_VETS:
+        if (encontrar_indice_veterinario_por_crm(l->reg.v.crmVet) >= 0)
+            return "CRM repetido";
+        return inserir_vet(&l->reg.v) < 0 ? "erro de memoria" : NULL;
+    default:
+    {
+        Consulta *c = &l->reg.c;
+        if (encontrar_indice_animal_por_id(c->idAnimal) < 0)
+            return "animal inexistente";
+        if (encontrar_indice_veterinario_por_crm(c->crmVet) < 0)
+            return "veterinario inexistente";
+        if (!l->temId)
+            c->idConsulta = g_nextIdConsulta;
+        else if (encontrar_indice_consulta_por_id(c->idConsulta) >= 0)
+            return "id de consulta repetido";
+        if (g_csvNDatas == g_csvCapDatas)
+        {
+            int novo = g_csvCapDatas ? g_csvCapDatas * 2 : 4096;
+            ChaveData *p = (ChaveData *)realocar(g_csvDatas, (size_t)novo * sizeof(ChaveData));
+            if (!p)
+                return "erro de memoria";
+            g_csvDatas = p;
+            g_csvCapDatas = novo;
+        }
+        int idx = anexar_consulta(c);
+        if (idx < 0)
+            return "erro de memoria";
+        g_csvDatas[g_csvNDatas].data = g_consData[idx];
+        g_csvDatas[g_csvNDatas].id = c->idConsulta;
+        g_csvNDatas++;
+        if (c->idConsulta >= g_nextIdConsulta)
+            g_nextIdConsulta = c->idConsulta + 1;
+        return NULL;
+    }
+    }
+}
+
+// Converte as faixas do bloco em paralelo, uma por parte do pool
+static void csv_converter_parte(void *ctx, int parte, int nPartes)
+{
+    (void)nPartes;
+    csv_converter_faixa(&((FaixaCsv *)ctx)[parte]);
+}
+
+static int importar_csv(const char *nomeTipo, const char *path)
+{
+    static const char *tipos[3] = {"animais", "vets", "consultas"};
+    Tabela *tabelas[3] = {&g_tabAnimais, &g_tabVets, &g_tabCons};
+    int tipo = -1;
+    for (int i = 0; i < 3; i++)
+        if (strcmp(nomeTipo, tipos[i]) == 0)
+            tipo = i;
+    if (tipo < 0)
+    {
+        fprintf(stderr, "Tipo de importacao desconhecido: %s (animais, vets ou consultas).\n", nomeTipo);
+        return CLINICA_INVALIDO;
+    }
+
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        fprintf(stderr, "Nao foi possivel abrir %s.\n", path);
+        return CLINICA_ERRO_ARQUIVO;
+    }
+    char pathErros[256];
+    snprintf(pathErros, sizeof(pathErros), "%s.erros", path);
+    FILE *ferr = NULL;
+    fseek(f, 0, SEEK_END);
+    long tamArquivo = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    int nThreads = pool_tamanho();
+    char *buf = (char *)malloc(CSV_BLOCO_TAM);
+    FaixaCsv fx[POOL_MAX];
+    memset(fx, 0, sizeof(fx));
+    if (!buf)
+    {
+        fclose(f);
+        aviso("Erro de memoria.\n");
+        return CLINICA_ERRO_MEMORIA;
+    }
+
+    long nLinhasBase = 0, aceitas = 0, rejeitadas = 0, bytesLidos = 0;
+    int reservado = 0, ok = 1;
+    size_t sobra = 0; // bytes de uma linha incompleta do bloco anterior
+    Medicao m = metrica_iniciar();
+    double inicio = m.inicio;
+    for (;;)
+    {
+        size_t lidos = fread(buf + sobra, 1, CSV_BLOCO_TAM - sobra, f);
+        size_t total = sobra + lidos;
+        if (total == 0)
+            break;
+        bytesLidos += (long)lidos;
+        contar_lidos((long long)lidos);
+        // O bloco termina na ultima quebra de linha; o resto vai para o proximo
+        size_t usar = total;
+        int cortada = 0; // linha maior que o bloco: o comeco e rejeitado aqui
+        if (lidos > 0)
+        {
+            while (usar > 0 && buf[usar - 1] != '\n')
+                usar--;
+            if (usar == 0)
+            {
+                usar = total;
+                cortada = total == CSV_BLOCO_TAM;
+            }
+        }
+
+        // Faixas de tamanho parecido, cortadas em fim de linha
+        int nFaixas = 0;
+        const char *p = buf, *fimBloco = buf + usar;
+        for (int i = 0; i < nThreads && p < fimBloco; i++)
+        {
+            const char *fim = i == nThreads - 1 ? fimBloco : p + (fimBloco - p) / (nThreads - i);
+            if (fim < fimBloco)
+            {
+                const char *nl = (const char *)memchr(fim, '\n', (size_t)(fimBloco - fim));
+                fim = nl ? nl + 1 : fimBloco;
+            }
+            fx[nFaixas].tipo = tipo;
+            fx[nFaixas].ini = p;
+            fx[nFaixas].fim = fim;
+            fx[nFaixas].pularCabecalho = nLinhasBase == 0 && i == 0;
+            fx[nFaixas].n = 0;
+            fx[nFaixas].nLinhas = 0;
+            nFaixas++;
+            p = fim;
+        }
+        pool_executar(csv_converter_parte, fx, nFaixas);
+
+        // Uma reserva so, estimada pelo tamanho do arquivo e pelas linhas do primeiro bloco
+        if (!reservado)
+        {
+            long linhas = 0;
+            for (int i = 0; i < nFaixas; i++)
+                linhas += fx[i].n;
+            long estimativa = tamArquivo > 0 && usar > 0 ? (long)((double)linhas * tamArquivo / (double)usar) + 1 : linhas;
+            if (estimativa > INT_MAX - tabelas[tipo]->n)
+                estimativa = INT_MAX - tabelas[tipo]->n;
+            tabela_reservar(tabelas[tipo], tabelas[tipo]->n + (int)estimativa);
+            reservado = 1;
+        }
+
+        long base = nLinhasBase;
+        for (int i = 0; i < nFaixas; i++)
+        {
+            if (fx[i].semMemoria)
+                ok = 0;
+            for (int k = 0; k < fx[i].n; k++)
+            {
+                LinhaCsv *l = &fx[i].linhas[k];
+                const char *erro = l->erro ? l->erro : csv_inserir(tipo, l);
+                if (!erro)
+                {
+                    aceitas++;
+                    continue;
+                }
+                rejeitadas++;
+                if (!ferr && !(ferr = fopen(pathErros, "w")))
+                    continue;
+                fprintf(ferr, "linha %ld: %s: %.*s\n", base + l->linha + 1, erro, l->tam, l->texto);
+            }
+            base += fx[i].nLinhas;
+        }
+        nLinhasBase = base;
+        if (!idxdata_mesclar(&g_consPorData, g_csvDatas, g_csvNDatas))
+            ok = 0;
+        g_csvNDatas = 0;
+        if (!ok || clinica_confirmar() != CLINICA_OK)
+        {
+            ok = 0;
+            break;
+        }
+
+        sobra = total - usar;
+        memmove(buf, buf + usar, sobra);
+
+        // O resto da linha cortada e descartado ate a proxima quebra: nao
+        // vira um registro novo nem conta como outra linha
+        while (cortada)
+        {
+            lidos = fread(buf, 1, CSV_BLOCO_TAM, f);
+            bytesLidos += (long)lidos;
+            contar_lidos((long long)lidos);
+            const char *nl = (const char *)memchr(buf, '\n', lidos);
+            if (nl)
+            {
+                sobra = lidos - (size_t)(nl + 1 - buf);
+                memmove(buf, nl + 1, sobra);
+                cortada = 0;
+            }
+            else if (lidos < CSV_BLOCO_TAM)
+                cortada = 0;
+        }
+    }
+    if (ferror(f))
+        ok = 0;
+    fclose(f);
+    if (ferr)
+        fclose(ferr);
+    for (int i = 0; i < POOL_MAX; i++)
+        free(fx[i].linhas);
+    free(buf);
+    free(g_csvDatas);
+    g_csvDatas = NULL;
+    g_csvCapDatas = 0;
+    metrica_registrar(MET_IMPORTAR, &m, nLinhasBase);
+
+    double seg = agora_segundos() - inicio;
+    aviso("Importacao de %s: %ld linha(s), %ld aceita(s), %ld rejeitada(s) em %.3f s (%d thread(s))", tipos[tipo],
+          nLinhasBase, aceitas, rejeitadas, seg, nThreads);
+    if (seg > 0)
+        aviso(", %.1f MB/s", bytesLidos / seg / (1024.0 * 1024.0));
+    aviso(".\n");
+    if (rejeitadas > 0)
+        aviso("Linhas rejeitadas em %s.\n", pathErros);
+    if (!ok)
+        aviso("Importacao interrompida por erro de memoria ou de gravacao.\n");
+    return !ok ? CLINICA_ERRO_GRAVACAO : rejeitadas > 0 ? CLINICA_INVALIDO : CLINICA_OK;
+}
+
+// Os outros processos esperam a importacao inteira
+int clinica_importar(const char *nomeTipo, const char *path)
+{
+    int r = compartilhado_escrever();
+    return r == CLINICA_OK ? compartilhado_publicar(importar_csv(nomeTipo, path)) : r;
+}
+
+// ======== Exportacao (--exportar) ========
+// Tabelas inteiras, ou a visao de atendimentos (consulta + animal + veterinario),
+// em CSV (mesmas colunas do --importar, com cabecalho) ou NDJSON (um objeto por
+// linha, datas ISO e texto em UTF-8). Os registros sao percorridos na ordem da
+// tabela e formatados direto no bloco de saida; com destino "-" vao para a saida
+// padrao e as mensagens para stderr.
+#define EXP_ANIMAIS 0
+#define EXP_VETS 1
+#define EXP_CONS 2
+#define EXP_ATENDIMENTOS 3
+
+static const char *const EXP_TIPOS[4] = {"animais", "vets", "consultas", "atendimentos"};
+static const char *const EXP_CAMPOS[4][10] = {
+    {"id", "nome", "especie", "nascimento", "peso", NULL},
+    {"crm", "nome", "telefone", NULL},
+    {"id", "idAnimal", "crm", "data", "valor", NULL},
+    {"id", "data", "valor", "idAnimal", "animal", "especie", "crm", "veterinario", "telefone", NULL}};
+
+static FILE *g_saidaExportacao = NULL; // saida padrao original, quando o destino e "-"
+
+typedef struct
+{
+    Saida *s;
+    int json;
+    const char *const *campos;
+    int campo; // proximo campo da linha
+} LinhaExp;
+
+static void exp_inicio(LinhaExp *l)
+{
+    l->campo = 0;
+    if (l->json)
+        saida_char(l->s, '{');
+}
+
+static void exp_fim(LinhaExp *l)
+{
+    if (l->json)
+        saida_char(l->s, '}');
+    saida_char(l->s, '\n');
+}
+
+// Separador e, no NDJSON, o nome do proximo campo
+static void exp_chave(LinhaExp *l)
+{
+    const char *nome = l->campos[l->campo];
+    if (l->campo++ > 0)
+        saida_char(l->s, ',');
+    if (l->json)
+    {
+        saida_char(l->s, '"');
+        saida_texto(l->s, nome);
+        saida_bytes(l->s, "\":", 2);
+    }
+}
+
+// Tamanho de uma sequencia UTF-8 valida em p (0 = nao e UTF-8)
+static int utf8_sequencia(const unsigned char *p, size_t resto)
+{
+    int k = p[0] >= 0xF0 && p[0] <= 0xF4 ? 4 : p[0] >= 0xE0 ? 3 : p[0] >= 0xC2 && p[0] < 0xE0 ? 2 : 0;
+    if (k == 0 || (size_t)k > resto)
+        return 0;
+    for (int i = 1; i < k; i++)
+        if ((p[i] & 0xC0) != 0x80)
+            return 0;
+    return k;
+}
+
+// Campo de texto de tamanho fixo (pode nao ter '\0' se veio corrompido do arquivo)
+static void exp_texto(LinhaExp *l, const char *txt, size_t max)
+{
+    Saida *s = l->s;
+    const char *fimTxt = (const char *)memchr(txt, '\0', max);
+    size_t n = fimTxt ? (size_t)(fimTxt - txt) : max;
+    exp_chave(l);
+
+    if (!l->json)
+    {
+        // CSV: aspas so quando precisa, com "" para aspas internas
+        size_t k = 0;
+        while (k < n && txt[k] != ',' && txt[k] != '"' && txt[k] != '\r' && txt[k] != '\n')
+            k++;
+        if (k == n)
+        {
+            saida_bytes(s, txt, n);
+            return;
+        }
+        saida_char(s, '"');
+        for (size_t i = 0; i < n; i++)
+        {
+            if (txt[i] == '"')
+                saida_char(s, '"');
+            saida_char(s, txt[i]);
+        }
+        saida_char(s, '"');
+        return;
+    }
+
+    // JSON: escapes e bytes que nao formam UTF-8 valido tratados como Latin-1
+    static const char HEX[] = "0123456789abcdef";
+    const unsigned char *p = (const unsigned char *)txt;
+    saida_char(s, '"');
+    for (size_t i = 0; i < n;)
+    {
+        unsigned c = p[i];
+        char *o = saida_espaco(s);
+        if (c == '"' || c == '\\')
+        {
+            o[0] = '\\';
+            o[1] = (char)c;
+            saida_avancar(s, 2);
+            i++;
+        }
+        else if (c < 0x20)
+        {
+            memcpy(o, "\\u00", 4);
+            o[4] = HEX[c >> 4];
+            o[5] = HEX[c & 15];
+            saida_avancar(s, 6);
+            i++;
+        }
+        else if (c < 0x80)
+        {
+            o[0] = (char)c;
+            saida_avancar(s, 1);
+            i++;
+        }
+        else
+        {
+            int k = utf8_sequencia(p + i, n - i);
+            if (k > 0)
+            {
+                memcpy(o, p + i, (size_t)k);
+                saida_avancar(s, (size_t)k);
+                i += (size_t)k;
+            }
+            else
+            {
+                o[0] = (char)(0xC0 | (c >> 6));
+                o[1] = (char)(0x80 | (c & 0x3F));
+                saida_avancar(s, 2);
+                i++;
+            }
+        }
+    }
+    saida_char(s, '"');
+}
+
+static void exp_int(LinhaExp *l, long long v)
+{
+    exp_chave(l);
+    saida_int(l->s, v);
+}
+
+static void exp_dinheiro(LinhaExp *l, double v)
+{
+    exp_chave(l);
+    if (l->json && !(v - v == 0)) // JSON nao tem infinito nem NaN
+        saida_texto(l->s, "null");
+    else
+        saida_dinheiro(l->s, v);
+}
+
+// Data ja convertida (AAAAMMDD); invalida sai como o texto original no CSV e null no NDJSON
+static void exp_data(LinhaExp *l, int data, const char *original)
+{
+    if (data < 0)
+    {
+        if (l->json)
+        {
+            exp_chave(l);
+            saida_texto(l->s, "null");
+        }
+        else
+            exp_texto(l, original, DATA_TAM);
+        return;
+    }
+    exp_chave(l);
+    if (l->json)
+        saida_char(l->s, '"');
+    saida_data(l->s, data, l->json);
+    if (l->json)
+        saida_char(l->s, '"');
+}
+
+static void exp_nulo(LinhaExp *l)
+{
+    exp_chave(l);
+    if (l->json)
+        saida_texto(l->s, "null");
+}
+
+static void exp_animal(LinhaExp *l, const Animal *a)
+{
+    exp_int(l, a->idAnimal);
+    exp_texto(l, a->nome, NOME_TAM);
+    exp_texto(l, a->especie, ESPECIE_TAM);
+    exp_data(l, data_to_int(a->dataNascimento), a->dataNascimento);
+    exp_dinheiro(l, a->peso);
+}
+
+static void exp_vet(LinhaExp *l, const Veterinario *v)
+{
+    exp_int(l, v->crmVet);
+    exp_texto(l, v->nome, NOME_TAM);
+    exp_texto(l, v->telefone, TELEFONE_TAM);
+}
+
+// O texto original da data so e lido quando ela e invalida
+static void exp_consulta(LinhaExp *l, int i)
+{
+    exp_int(l, g_consId[i]);
+    exp_int(l, g_consAnimal[i]);
+    exp_int(l, g_consCrm[i]);
+    exp_data(l, g_consData[i], g_consultas[i].dataConsulta);
+    exp_dinheiro(l, g_consValor[i]);
+}
+
+static void exp_atendimento(LinhaExp *l, int i)
+{
+    int ia = encontrar_indice_animal_por_id(g_consAnimal[i]);
+    int iv = encontrar_indice_veterinario_por_crm(g_consCrm[i]);
+    exp_int(l, g_consId[i]);
+    exp_data(l, g_consData[i], g_consultas[i].dataConsulta);
+    exp_dinheiro(l, g_consValor[i]);
+    exp_int(l, g_consAnimal[i]);
+    if (ia >= 0)
+    {
+        exp_texto(l, g_animais[ia].nome, NOME_TAM);
+        exp_texto(l, g_animais[ia].especie, ESPECIE_TAM);
+    }
+    else
+    {
+        exp_nulo(l);
+        exp_nulo(l);
+    }
+    exp_int(l, g_consCrm[i]);
+    if (iv >= 0)
+    {
+        exp_texto(l, g_vets[iv].nome, NOME_TAM);
+        exp_texto(l, g_vets[iv].telefone, TELEFONE_TAM);
+    }
+    else
+    {
+        exp_nulo(l);
+        exp_nulo(l);
+    }
+}
+
+// Com destino "-", guarda a saida padrao original para os dados e passa a
+// mandar tudo o que o programa imprime (avisos da carga, resumo) para stderr
+int clinica_separar_saida_padrao(void)
+{
+    fflush(stdout);
+    int fd = dup(1);
+    if (fd < 0)
+        return CLINICA_ERRO_ARQUIVO;
+    if (dup2(2, 1) < 0 || !(g_saidaExportacao = fdopen(fd, "wb")))
+    {
+        close(fd);
+        return CLINICA_ERRO_ARQUIVO;
+    }
+    return CLINICA_OK;
+}
+
+int clinica_exportar(const char *nomeTipo, const char *formato, const char *path)
+{
+    int tipo = -1;
+    for (int i = 0; i < 4; i++)
+        if (strcmp(nomeTipo, EXP_TIPOS[i]) == 0)
+            tipo = i;
+    if (tipo < 0)
+    {
+        fprintf(stderr, "Tipo de exportacao desconhecido: %s (animais, vets, consultas ou atendimentos).\n", nomeTipo);
+        return CLINICA_INVALIDO;
+    }
+    int json = strcmp(formato, "ndjson") == 0;
+    if (!json && strcmp(formato, "csv") != 0)
+    {
+        fprintf(stderr, "Formato desconhecido: %s (csv ou ndjson).\n", formato);
+        return CLINICA_INVALIDO;
+    }
+
+    compartilhado_ler();
+    int padrao = strcmp(path, "-") == 0;
+    FILE *f = padrao ? g_saidaExportacao : fopen(path, "wb");
+    if (!f)
+    {
+        fprintf(stderr, "Nao foi possivel abrir %s.\n", padrao ? "a saida padrao" : path);
+        return CLINICA_ERRO_ARQUIVO;
+    }
+    Saida s;
+    if (!saida_abrir(&s, f))
+    {
+        if (!padrao)
+            fclose(f);
+        aviso("Erro de memoria.\n");
+        return CLINICA_ERRO_MEMORIA;
+    }
+
+    Medicao m = metrica_iniciar();
+    double inicio = m.inicio;
+    LinhaExp l = {&s, json, EXP_CAMPOS[tipo], 0};
+    if (!json)
+    {
+        for (int k = 0; l.campos[k]; k++)
+        {
+            if (k > 0)
+                saida_char(&s, ',');
+            saida_texto(&s, l.campos[k]);
+        }
+        saida_char(&s, '\n');
+    }
+
+    long registros = 0;
+    Tabela *t = tipo == EXP_ANIMAIS ? &g_tabAnimais : tipo == EXP_VETS ? &g_tabVets : &g_tabCons;
+    for (int i = 0; i < t->n && !s.erro; i++)
+    {
+        if (!tabela_vivo(t, i))
+            continue;
+        exp_inicio(&l);
+        if (tipo == EXP_ANIMAIS)
+            exp_animal(&l, &g_animais[i]);
+        else if (tipo == EXP_VETS)
+            exp_vet(&l, &g_vets[i]);
+        else if (tipo == EXP_CONS)
+            exp_consulta(&l, i);
+        else
+            exp_atendimento(&l, i);
+        exp_fim(&l);
+        registros++;
+    }
+
+    int ok = saida_fechar(&s);
+    if (!padrao && fclose(f) != 0)
+        ok = 0;
+    metrica_registrar(MET_EXPORTAR, &m, t->n);
+
+    double seg = agora_segundos() - inicio;
+    double mb = s.bytes / (1024.0 * 1024.0);
+    aviso("Exportacao de %s (%s): %ld registro(s), %.1f MB em %.3f s", EXP_TIPOS[tipo], json ? "ndjson" : "csv",
+          registros, mb, seg);
+    if (seg > 0)
+        aviso(", %.1f MB/s", mb / seg);
+    aviso(".\n");
+    if (!ok)
+        aviso("Erro de gravacao em %s.\n", padrao ? "a saida padrao" : path);
+    return ok ? CLINICA_OK : CLINICA_ERRO_GRAVACAO;
+}
+
+// ======== Bench (--bench) ========
+// Mede os relatorios em lote (periodo com todo o historico, todos os CRMs e
+// todas as especies) com 1, 2, 4... threads ate o tamanho do pool. Os arquivos
+// sao gravados de verdade na pasta atual; vale o melhor de BENCH_REPETICOES.
+// Depois compara os filtros por data, CRM e valor: o laco por registro contra
+// cada kernel disponivel sobre as colunas (melhor de BENCH_FILTRO_REPETICOES).
+#define BENCH_REPETICOES 3
+#define BENCH_FILTRO_REPETICOES 5
+
+#define FILTRO_DATA 0
+#define FILTRO_CRM 1
+#define FILTRO_VALOR 2
+
+typedef struct
+{
+    int tipo;
+    int lo, hi;   // data ou CRM
+    double vlo, vhi; // valor
+} PredicadoBench;
+
+// O laco de antes das colunas: desvio por registro, lendo o registro inteiro
+static int filtrar_registros(const PredicadoBench *pr, int *saida)
+{
+    int n = 0;
+    for (int i = 0; i < g_nCons; i++)
+    {
+        if (!tabela_vivo(&g_tabCons, i))
+            continue;
+        const Consulta *c = &g_consultas[i];
+        if (pr->tipo == FILTRO_DATA ? g_consData[i] >= pr->lo && g_consData[i] <= pr->hi
+            : pr->tipo == FILTRO_CRM ? c->crmVet == pr->lo
+                                     : c->valor >= pr->vlo && c->valor <= pr->vhi)
+            saida[n++] = i;
+    }
+    return n;
+}
+
+// Kernel sobre a coluna e depois a retirada das lapides, como na listagem
+static int filtrar_colunas(const PredicadoBench *pr, FiltroInt fi, FiltroReal fr, int *saida)
+{
+    int n = pr->tipo == FILTRO_VALOR ? fr(g_consValor, 0, g_nCons, pr->vlo, pr->vhi, saida)
+                                     : fi(pr->tipo == FILTRO_DATA ? g_consData : g_consCrm, 0, g_nCons, pr->lo,
+                                          pr->hi, saida);
+    int m = 0;
+    for (int k = 0; k < n; k++)
+        if (consulta_viva(saida[k]))
+            saida[m++] = saida[k];
+    return m;
+}
+
+// Melhor tempo em ms (k = -1: laco por registro); *n recebe quantas passaram
+static double medir_filtro(const PredicadoBench *pr, int k, FiltroInt fi, FiltroReal fr, int *saida, int *n)
+{
+    double melhor = -1;
+    for (int rep = 0; rep < BENCH_FILTRO_REPETICOES; rep++)
+    {
+        double inicio = agora_segundos();
+        *n = k < 0 ? filtrar_registros(pr, saida) : filtrar_colunas(pr, fi, fr, saida);
+        double ms = (agora_segundos() - inicio) * 1000.0;
+        if (melhor < 0 || ms < melhor)
+            melhor = ms;
+    }
+    return melhor;
+}
+
+static int bench_filtros(FILE *f)
+{
+    const char *nomes[3] = {"escalar", NULL, NULL};
+    FiltroInt fi[3] = {filtro_int_escalar, NULL, NULL};
+    FiltroReal fr[3] = {filtro_real_escalar, NULL, NULL};
+    int nk = 1;
+#if defined(CLINICA_FILTRO_X86)
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        nomes[nk] = "sse4.2";
+        fi[nk] = filtro_int_sse42;
+        fr[nk++] = filtro_real_sse42;
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        nomes[nk] = "avx2";
+        fi[nk] = filtro_int_avx2;
+        fr[nk++] = filtro_real_avx2;
+    }
+#endif
+    int *saida = (int *)malloc((size_t)(g_nCons > 0 ? g_nCons : 1) * sizeof(int));
+    if (!saida)
+    {
+        fprintf(f, "Erro de memoria.\n");
+        return 0;
+    }
+
+    // Um ano do meio do historico, o CRM da primeira consulta e R$ 100 a 200
+    int ano = g_consPorData.n ? g_consPorData.itens[g_consPorData.n / 2].data / 10000 : 2000;
+    int crm = 0;
+    for (int i = 0; i < g_nCons && !crm; i++)
+        if (consulta_viva(i))
+            crm = g_consCrm[i];
+    PredicadoBench preds[3] = {{FILTRO_DATA, ano * 10000 + 101, ano * 10000 + 1231, 0, 0},
+                               {FILTRO_CRM, crm, crm, 0, 0},
+                               {FILTRO_VALOR, 0, 0, 100.0, 200.0}};
+
+    fprintf(f, "\nFiltros: %d consulta(s), melhor de %d execucoes, tempos em ms.\n", tabela_ativos(&g_tabCons),
+               BENCH_FILTRO_REPETICOES);
+    fprintf(f, "filtro            selecionadas   registros");
+    for (int k = 0; k < nk; k++)
+        fprintf(f, " %10s", nomes[k]);
+    fprintf(f, "   aceleracao\n");
+    int ok = 1;
+    for (int p = 0; p < 3; p++)
+    {
+        char rotulo[32];
+        if (p == FILTRO_DATA)
+            snprintf(rotulo, sizeof(rotulo), "data (ano %d)", ano);
+        else if (p == FILTRO_CRM)
+            snprintf(rotulo, sizeof(rotulo), "crm (%d)", crm);
+        else
+            snprintf(rotulo, sizeof(rotulo), "valor (100-200)");
+        int nBase, n;
+        double base = medir_filtro(&preds[p], -1, NULL, NULL, saida, &nBase), melhor = base;
+        fprintf(f, "%-17s %12d %11.3f", rotulo, nBase, base);
+        for (int k = 0; k < nk; k++)
+        {
+            double ms = medir_filtro(&preds[p], k, fi[k], fr[k], saida, &n);
+            if (ms < melhor)
+                melhor = ms;
+            fprintf(f, " %10.3f", ms);
+            if (n != nBase)
+                ok = 0;
+        }
+        fprintf(f, "   %9.2fx\n", melhor > 0 ? base / melhor : 0.0);
+    }
+    if (!ok)
+        fprintf(f, "Erro: os filtros discordam do laco por registro.\n");
+    free(saida);
+    return ok;
+}
+
+int clinica_bench(FILE *f)
+{
+    PlanoRelatorios p = {NULL, 0, 0, 0};
+    if (!plano_periodo(&p, "01/01/0001", "31/12/9999") || !plano_todos_crm(&p) || !plano_todas_especies(&p))
+    {
+        fprintf(f, "Erro de memoria.\n");
+        plano_liberar(&p);
+        return CLINICA_ERRO_MEMORIA;
+    }
+    int maximo = pool_tamanho(), ok = 1;
+    double base = 0;
+    fprintf(f, "Bench: %d consulta(s), %d relatorio(s), melhor de %d execucoes.\n", tabela_ativos(&g_tabCons), p.n,
+               BENCH_REPETICOES);
+    fprintf(f, "threads    tempo (s)   aceleracao\n");
+    for (int t = 1; t <= maximo && ok; t = t * 2 > maximo && t < maximo ? maximo : t * 2)
+    {
+        double melhor = -1;
+        g_poolUsar = t;
+        for (int rep = 0; rep < BENCH_REPETICOES && ok; rep++)
+        {
+            int passadas;
+            double inicio = agora_segundos();
+            ok = executar_plano(&p, &passadas);
+            double seg = agora_segundos() - inicio;
+            if (melhor < 0 || seg < melhor)
+                melhor = seg;
+        }
+        if (t == 1)
+            base = melhor;
+        fprintf(f, "%7d    %9.3f   %9.2fx\n", t, melhor, melhor > 0 ? base / melhor : 0.0);
+    }
+    g_poolUsar = maximo;
+    if (!ok)
+        fprintf(f, "Erro de memoria ou de gravacao nos relatorios.\n");
+    plano_liberar(&p);
+    return bench_filtros(f) && ok ? CLINICA_OK : CLINICA_ERRO_GRAVACAO;
+}
+
+// ======== Servidor (--servidor) ========
+// Um processo dono das tabelas atende os terminais pelo socket Unix, com uma
+// thread por conexao. Buscas e totais rodam em paralelo sob a trava de
+// leitura. Listagens e relatorios leem uma copia do estado (g_srvCopia), tirada
+// sob a trava de leitura e refeita so depois de alguma alteracao: enquanto
+// formatam, as alteracoes seguem no original. Estatisticas e diagnostico leem
+// o original sob a trava de leitura. Todos esses dividem g_listaBuf, o pool e
+// as metricas e passam um de cada vez por g_srvSerial (sempre antes da trava
+// de leitura). Alteracoes pegam a trava de escrita e so respondem depois do
+// commit do log.
+#ifdef CLINICA_THREADS
+#define SERVIDOR_MAX_CLIENTES 64
+#define SERVIDOR_PEDACO (64 * 1024) // texto por quadro RESP_SAIDA / RESP_AVISO
+#define SERVIDOR_ESPERA_MS 500      // intervalo em que o laco do accept confere o sinal
+#define SERVIDOR_COPIA_MIN 50000    // registros; abaixo disso ler o original e mais rapido que copiar
+
+#define MODO_LIVRE 0       // nao toca nas tabelas
+#define MODO_LEITURA 1     // em paralelo com outras leituras
+#define MODO_INSTANTANEO 2 // leitura longa, sobre a copia
+#define MODO_SERIAL 3      // leitura que usa os buffers da sessao
+#define MODO_ESCRITA 4     // exclusivo
+
+typedef struct
+{
+    int fd;
+    int numero;   // para o log do servidor
+    int ocupada;  // tem thread (rodando ou por juntar); so a principal mexe
+    int terminou; // a thread saiu; a principal junta e fecha o fd
+    pthread_t thread;
+    FILE *saida;  // texto das listagens (temporario, criado no primeiro uso)
+    FILE *avisos; // avisos das operacoes, idem
+    Quadro pedido, resposta;
+} Conexao;
+
+static Conexao g_conexoes[SERVIDOR_MAX_CLIENTES];
+static pthread_mutex_t g_conexoesMutex = PTHREAD_MUTEX_INITIALIZER; // so para 'terminou'
+static pthread_rwlock_t g_srvDados;
+static pthread_mutex_t g_srvSerial = PTHREAD_MUTEX_INITIALIZER;
+static volatile sig_atomic_t g_srvParar = 0;
+static FILE *g_srvLog = NULL; // fluxo de avisos da sessao, fixado na partida
+static Estado g_srvCopia;           // sob g_srvSerial
+static int g_srvCopiaValida = 0;    // idem
+static unsigned g_srvVersaoCopia;   // idem
+static unsigned g_srvVersao = 0;    // alteracoes atendidas; muda sob a trava de escrita
+
+static void servidor_log(const char *fmt, ...)
+{
+    if (!g_srvLog)
+        return;
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(g_srvLog, fmt, ap);
+    va_end(ap);
+    fflush(g_srvLog);
+}
+
+static void servidor_sinal(int s)
+{
+    (void)s;
+    g_srvParar = 1;
+}
+
+// ---- Copia do estado para as leituras longas ----
+// Cada copia reaproveita os blocos da anterior: realocar no mesmo tamanho nao
+// custa paginas novas, e so o memcpy fica sob a trava de leitura.
+static int copiar_bloco(void **dst, const void *src, size_t k)
+{
+    if (k == 0)
+        return 1;
+    void *p = realloc(*dst, k);
+    if (!p)
+        return 0;
+    memcpy(p, src, k);
+    *dst = p;
+    return 1;
+}
+
+static int idx_copiar(IndiceHash *d, const IndiceHash *s)
+{
+    int ok = copiar_bloco((void **)&d->chaves, s->chaves, (size_t)s->cap * sizeof(int)) &&
+             copiar_bloco((void **)&d->valores, s->valores, (size_t)s->cap * sizeof(int));
+    d->cap = ok ? s->cap : 0;
+    d->n = ok ? s->n : 0;
+    return ok;
+}
+
+// So o que as leituras usam: registros, chave primaria e colunas
+static int tabela_copiar(Tabela *d, const Tabela *s, Estado *copia)
+{
+    d->tamElem = s->tamElem;
+    d->offChave = s->offChave;
+    d->nome = s->nome;
+    d->n = d->cap = d->nRemovidos = 0;
+    if (!copiar_bloco(&d->dados, s->dados, (size_t)s->n * s->tamElem) || !idx_copiar(&d->pk, &s->pk))
+        return 0;
+    for (int c = 0; c < s->nColunas; c++)
+    {
+        // Toda coluna e um campo de g_estado: na copia, o mesmo campo da copia
+        void **campo = (void **)((char *)copia + ((const char *)s->colunas[c].ptr - (const char *)&g_estado));
+        if (!copiar_bloco(campo, *s->colunas[c].ptr, (size_t)s->n * s->colunas[c].tam))
+            return 0;
+    }
+    d->n = d->cap = s->n;
+    d->nRemovidos = s->nRemovidos;
+    return 1;
+}
+
+static int reverso_copiar(IndiceReverso *d, const IndiceReverso *s)
+{
+    if (!idx_copiar(&d->mapa, &s->mapa))
+        return 0;
+    for (int i = s->n; i < d->n; i++) // chaves que sumiram desde a copia anterior
+        free(d->listas[i].ids);
+    if (d->n > s->n)
+        d->n = s->n;
+    if (s->n > d->cap)
+    {
+        ListaIds *p = (ListaIds *)realloc(d->listas, (size_t)s->n * sizeof(ListaIds));
+        if (!p)
+            return 0;
+        d->listas = p;
+        d->cap = s->n;
+    }
+    for (; d->n < s->n; d->n++)
+    {
+        d->listas[d->n].ids = NULL;
+        d->listas[d->n].n = d->listas[d->n].cap = 0;
+    }
+    for (int i = 0; i < s->n; i++)
+    {
+        ListaIds *l = &d->listas[i];
+        const ListaIds *o = &s->listas[i];
+        l->n = 0;
+        if (o->n > l->cap)
+        {
+            int *p = (int *)realloc(l->ids, (size_t)o->n * sizeof(int));
+            if (!p)
+                return 0;
+            l->ids = p;
+            l->cap = o->n;
+        }
+        if (o->n > 0)
+            memcpy(l->ids, o->ids, (size_t)o->n * sizeof(int));
+        l->n = o->n;
+    }
+    return 1;
+}
+
+static int agregados_copiar(TabelaAgregados *d, const TabelaAgregados *s)
+{
+    d->n = 0;
+    if (!idx_copiar(&d->mapa, &s->mapa) ||
+        !copiar_bloco((void **)&d->chaves, s->chaves, (size_t)s->n * sizeof(int)) ||
+        !copiar_bloco((void **)&d->valores, s->valores, (size_t)s->n * sizeof(Agregado)))
+        return 0;
+    d->n = d->cap = s->n;
+    return 1;
+}
+
+static void estado_liberar(Estado *e)
+{
+    Tabela *t[3] = {&e->tabAnimais, &e->tabVets, &e->tabCons};
+    for (int i = 0; i < 3; i++)
+    {
+        free(t[i]->dados);
+        idx_liberar(&t[i]->pk);
+    }
+    free(e->consData);
+    free(e->consId);
+    free(e->consAnimal);
+    free(e->consCrm);
+    free(e->consValor);
+    free(e->animalEspecie);
+    rev_liberar(&e->consPorAnimal);
+    rev_liberar(&e->consPorVet);
+    rev_liberar(&e->consPorEspecie);
+    idxdata_liberar(&e->consPorData);
+    agregados_liberar(&e->agrPorVet);
+    agregados_liberar(&e->agrPorEspecie);
+    agregados_liberar(&e->agrPorMes);
+    free(e->especies);
+    free(e->especieHash);
+    memset(e, 0, sizeof(*e));
+}
+
+// Copia g_estado em d (a copia anterior); sem memoria, libera d e devolve 0
+static int estado_copiar(Estado *d)
+{
+    const Estado *s = &g_estado;
+    d->consPorData.n = d->nEspecies = d->capEspecieHash = 0;
+    int ok = tabela_copiar(&d->tabAnimais, &s->tabAnimais, d) && tabela_copiar(&d->tabVets, &s->tabVets, d) &&
+             tabela_copiar(&d->tabCons, &s->tabCons, d) && reverso_copiar(&d->consPorAnimal, &s->consPorAnimal) &&
+             reverso_copiar(&d->consPorVet, &s->consPorVet) &&
+             reverso_copiar(&d->consPorEspecie, &s->consPorEspecie) &&
+             copiar_bloco((void **)&d->consPorData.itens, s->consPorData.itens,
+                          (size_t)s->consPorData.n * sizeof(ChaveData)) &&
+             copiar_bloco((void **)&d->especies, s->especies, (size_t)s->nEspecies * sizeof(Especie)) &&
+             copiar_bloco((void **)&d->especieHash, s->especieHash, (size_t)s->capEspecieHash * sizeof(int)) &&
+             agregados_copiar(&d->agrPorVet, &s->agrPorVet) && agregados_copiar(&d->agrPorEspecie, &s->agrPorEspecie) &&
+             agregados_copiar(&d->agrPorMes, &s->agrPorMes);
+    if (!ok)
+    {
+        estado_liberar(d);
+        return 0;
+    }
+    d->consPorData.n = d->consPorData.cap = s->consPorData.n;
+    d->nEspecies = d->capEspecies = s->nEspecies;
+    d->capEspecieHash = s->capEspecieHash;
+    return 1;
+}
+
+// Estado para uma leitura longa; quem chama segura g_srvSerial. NULL = ler o
+// original sob a trava de leitura (base pequena ou sem memoria para a copia).
+static Estado *servidor_copia()
+{
+    Estado *e = NULL;
+    pthread_rwlock_rdlock(&g_srvDados);
+    if (g_srvCopiaValida && g_srvVersaoCopia == g_srvVersao)
+        e = &g_srvCopia;
+    else if (g_estado.tabAnimais.n + g_estado.tabVets.n + g_estado.tabCons.n >= SERVIDOR_COPIA_MIN)
+    {
+        g_srvCopiaValida = estado_copiar(&g_srvCopia);
+        g_srvVersaoCopia = g_srvVersao;
+        if (g_srvCopiaValida)
+            e = &g_srvCopia;
+        else
+            servidor_log("Sem memoria para a copia das leituras: a listagem segura as alteracoes.\n");
+    }
+    pthread_rwlock_unlock(&g_srvDados);
+    return e;
+}
+
+static int modo_do_pedido(int op)
+{
+    switch (op)
+    {
+    case PED_OLA:
+    case PED_DATA:
+        return MODO_LIVRE;
+    case PED_TOTAIS:
+    case PED_BUSCAR_ANIMAL:
+    case PED_BUSCAR_VET:
+    case PED_BUSCAR_CONSULTA:
+        return MODO_LEITURA;
+    case PED_INCLUIR_ANIMAL:
+    case PED_ALTERAR_ANIMAL:
+    case PED_EXCLUIR_ANIMAL:
+    case PED_INCLUIR_VET:
+    case PED_ALTERAR_VET:
+    case PED_EXCLUIR_VET:
+    case PED_INCLUIR_CONSULTA:
+    case PED_ALTERAR_CONSULTA:
+    case PED_EXCLUIR_CONSULTA:
+    case PED_EXPURGAR:
+    case PED_SALVAR:
+    case PED_CHECKPOINT:
+    case PED_POPULAR_EXEMPLOS:
+        return MODO_ESCRITA;
+    case PED_LISTAR_ANIMAIS:
+    case PED_LISTAR_VETS:
+    case PED_LISTAR_CONSULTAS:
+    case PED_RELATORIO_CONSULTAS:
+    case PED_RELATORIOS:
+    case PED_RELATORIOS_TODOS:
+        return MODO_INSTANTANEO;
+    default:
+        return MODO_SERIAL;
+    }
+}
+
+// Arquivo temporario da conexao, criado no primeiro uso (NULL se nao abrir)
+static FILE *temporario(FILE **f)
+{
+    if (!*f)
+        *f = tmpfile();
+    return *f;
+}
+
+// So o nome, sem pasta: o cliente nao grava fora da pasta do servidor
+static int nome_simples(const char *s)
+{
+    return s && *s && !strchr(s, '/');
+}
+
+// Le os argumentos do pedido, chama a API e poe os resultados na resposta
+static int executar_pedido(Conexao *c, int op)
+{
+    Quadro *q = &c->pedido, *r = &c->resposta;
+    Animal a;
+    Veterinario v;
+    Consulta k;
+    FiltroConsultas f;
+    char arquivo[128] = "";
+    const char *texto;
+    int x, st;
+    switch (op)
+    {
+    case PED_OLA:
+        x = quadro_ler_int(q);
+        st = quadro_ler_int(q) == (int)sizeof(Animal) && quadro_ler_int(q) == (int)sizeof(Veterinario) &&
+             quadro_ler_int(q) == (int)sizeof(Consulta);
+        return !q->erro && x == PROTOCOLO_VERSAO && st ? CLINICA_OK : CLINICA_INVALIDO;
+    case PED_DATA:
+        return data_to_int(quadro_ler_texto(q));
+    case PED_TOTAIS:
+    {
+        int nA, nV, nC;
+        clinica_totais(&nA, &nV, &nC);
+        quadro_int(r, nA);
+        quadro_int(r, nV);
+        quadro_int(r, nC);
+        return CLINICA_OK;
+    }
+
+    case PED_INCLUIR_ANIMAL:
+        quadro_ler_animal(q, &a);
+        if (q->erro)
+            return CLINICA_INVALIDO;
+        st = clinica_incluir_animal(&a);
+        quadro_animal(r, &a);
+        return st;
+    case PED_BUSCAR_ANIMAL:
+        x = quadro_ler_int(q);
+        st = q->erro ? CLINICA_INVALIDO : clinica_buscar_animal(x, &a);
+        if (st == CLINICA_OK)
+            quadro_animal(r, &a);
+        return st;
+    case PED_ALTERAR_ANIMAL:
+        quadro_ler_animal(q, &a);
+        return q->erro ? CLINICA_INVALIDO : clinica_alterar_animal(&a);
+    case PED_EXCLUIR_ANIMAL:
+        x = quadro_ler_int(q);
+        return q->erro ? CLINICA_INVALIDO : clinica_excluir_animal(x);
+
+    case PED_INCLUIR_VET:
+        quadro_ler_vet(q, &v);
+        return q->erro ? CLINICA_INVALIDO : clinica_incluir_vet(&v);
+    case PED_BUSCAR_VET:
+        x = quadro_ler_int(q);
+        st = q->erro ? CLINICA_INVALIDO : clinica_buscar_vet(x, &v);
+        if (st == CLINICA_OK)
+            quadro_vet(r, &v);
+        return st;
+    case PED_ALTERAR_VET:
+        quadro_ler_vet(q, &v);
+        return q->erro ? CLINICA_INVALIDO : clinica_alterar_vet(&v);
+    case PED_EXCLUIR_VET:
+        x = quadro_ler_int(q);
+        return q->erro ? CLINICA_INVALIDO : clinica_excluir_vet(x);
+
+    case PED_INCLUIR_CONSULTA:
+        quadro_ler_consulta(q, &k);
+        if (q->erro)
+            return CLINICA_INVALIDO;
+        st = clinica_incluir_consulta(&k);
+        quadro_consulta(r, &k);
+        return st;
+    case PED_BUSCAR_CONSULTA:
+        x = quadro_ler_int(q);
+        st = q->erro ? CLINICA_INVALIDO : clinica_buscar_consulta(x, &k);
+        if (st == CLINICA_OK)
+            quadro_consulta(r, &k);
+        return st;
+    case PED_ALTERAR_CONSULTA:
+        quadro_ler_consulta(q, &k);
+        return q->erro ? CLINICA_INVALIDO : clinica_alterar_consulta(&k);
+    case PED_EXCLUIR_CONSULTA:
+        x = quadro_ler_int(q);
+        return q->erro ? CLINICA_INVALIDO : clinica_excluir_consulta(x);
+    case PED_EXPURGAR:
+        return clinica_expurgar_consultas(quadro_ler_texto(q));
+
+    case PED_LISTAR_ANIMAIS:
+        return temporario(&c->saida) ? clinica_listar_animais(c->saida) : CLINICA_ERRO_ARQUIVO;
+    case PED_LISTAR_VETS:
+        return temporario(&c->saida) ? clinica_listar_vets(c->saida) : CLINICA_ERRO_ARQUIVO;
+    case PED_LISTAR_CONSULTAS:
+        quadro_ler_filtro(q, &f);
+        if (q->erro)
+            return CLINICA_INVALIDO;
+        return temporario(&c->saida) ? clinica_listar_consultas(c->saida, &f) : CLINICA_ERRO_ARQUIVO;
+    case PED_RELATORIO_CONSULTAS:
+        quadro_ler_filtro(q, &f);
+        if (q->erro)
+            return CLINICA_INVALIDO;
+        st = clinica_relatorio_consultas(&f, arquivo, sizeof(arquivo));
+        quadro_texto(r, arquivo);
+        return st;
+    case PED_RELATORIOS:
+        texto = quadro_ler_texto(q);
+        return texto ? clinica_relatorios(texto) : CLINICA_INVALIDO;
+    case PED_RELATORIOS_TODOS:
+        return clinica_relatorios_todos();
+    case PED_ESTATISTICAS:
+        x = quadro_ler_int(q);
+        if (q->erro)
+            return CLINICA_INVALIDO;
+        return temporario(&c->saida) ? clinica_estatisticas(c->saida, x) : CLINICA_ERRO_ARQUIVO;
+    case PED_RELATORIO_ESTATISTICAS:
+        st = clinica_relatorio_estatisticas(arquivo, sizeof(arquivo));
+        quadro_texto(r, arquivo);
+        return st;
+
+    case PED_SALVAR:
+        return clinica_salvar();
+    case PED_CHECKPOINT:
+        return clinica_checkpoint();
+    case PED_POPULAR_EXEMPLOS:
+        return clinica_popular_exemplos();
+
+    case PED_USO_MEMORIA:
+    case PED_METRICAS:
+    case PED_HISTOGRAMAS:
+        if (!temporario(&c->saida))
+            return CLINICA_ERRO_ARQUIVO;
+        if (op == PED_USO_MEMORIA)
+            clinica_uso_memoria(c->saida);
+        else if (op == PED_METRICAS)
+            clinica_metricas(c->saida);
+        else
+            clinica_histogramas(c->saida);
+        return CLINICA_OK;
+    case PED_GRAVAR_METRICAS:
+        texto = quadro_ler_texto(q);
+        return nome_simples(texto) ? clinica_gravar_metricas(texto) : CLINICA_INVALIDO;
+    case PED_ZERAR_METRICAS:
+        clinica_zerar_metricas();
+        return CLINICA_OK;
+    default:
+        return CLINICA_INVALIDO;
+    }
+}
+
+// Manda o que a operacao escreveu em f, em quadros do tipo dado, e esvazia f.
+// Usa o quadro do pedido, que ja foi atendido.
+static int enviar_texto(Conexao *c, FILE *f, int tipo)
+{
+    struct stat st;
+    if (!f)
+        return 1;
+    fflush(f);
+    int fd = fileno(f);
+    if (fstat(fd, &st) != 0)
+        return 0;
+    if (st.st_size == 0)
+        return 1;
+    for (off_t pos = 0; pos < st.st_size;)
+    {
+        size_t k = st.st_size - pos < SERVIDOR_PEDACO ? (size_t)(st.st_size - pos) : SERVIDOR_PEDACO;
+        quadro_iniciar(&c->pedido, tipo);
+        char *p = (char *)quadro_reservar(&c->pedido, k);
+        ssize_t lido = p ? pread(fd, p, k, pos) : -1;
+        if (lido <= 0)
+            return 0;
+        c->pedido.n = QUADRO_CABECALHO + (size_t)lido;
+        if (!quadro_enviar(c->fd, &c->pedido))
+            return 0;
+        pos += lido;
+    }
+    if (ftruncate(fd, 0) != 0)
+        return 0;
+    rewind(f);
+    return 1;
+}
+
+// Um pedido: trava conforme o modo, executa e solta; o texto e o RESP_FIM so
+// saem depois, para um cliente lento nao segurar as travas. 0 = fechar a conexao.
+static int atender(Conexao *c)
+{
+    int op = quadro_tipo(&c->pedido), modo = modo_do_pedido(op);
+    quadro_iniciar(&c->resposta, RESP_FIM);
+    quadro_int(&c->resposta, 0); // codigo, trocado no fim
+
+    int serial = modo == MODO_INSTANTANEO || modo == MODO_SERIAL;
+    Estado *copia = NULL;
+    if (serial)
+        pthread_mutex_lock(&g_srvSerial);
+    if (modo == MODO_INSTANTANEO)
+        copia = servidor_copia();
+    if (copia)
+        g_est = copia;
+    else if (modo == MODO_ESCRITA)
+        pthread_rwlock_wrlock(&g_srvDados);
+    else if (modo != MODO_LIVRE)
+        pthread_rwlock_rdlock(&g_srvDados);
+
+    if (modo >= MODO_INSTANTANEO)
+        g_avisosConexao = temporario(&c->avisos);
+    int st = executar_pedido(c, op);
+    if (modo == MODO_ESCRITA)
+    {
+        g_srvVersao++;
+        if (op != PED_SALVAR && op != PED_CHECKPOINT && clinica_confirmar() != CLINICA_OK && st >= 0)
+            st = CLINICA_ERRO_GRAVACAO;
+    }
+    g_avisosConexao = NULL;
+
+    if (copia)
+        g_est = &g_estado;
+    else if (modo != MODO_LIVRE)
+        pthread_rwlock_unlock(&g_srvDados);
+    if (serial)
+        pthread_mutex_unlock(&g_srvSerial);
+
+    quadro_int_em(&c->resposta, 0, st);
+    return enviar_texto(c, c->saida, RESP_SAIDA) && enviar_texto(c, c->avisos, RESP_AVISO) &&
+           quadro_enviar(c->fd, &c->resposta);
+}
+
+static void *servir_conexao(void *arg)
+{
+    Conexao *c = (Conexao *)arg;
+    while (quadro_receber(c->fd, &c->pedido) == 1 && atender(c))
+    {
+    }
+    if (c->saida)
+        fclose(c->saida);
+    if (c->avisos)
+        fclose(c->avisos);
+    c->saida = c->avisos = NULL;
+    quadro_liberar(&c->pedido);
+    quadro_liberar(&c->resposta);
+
+    // Buscas contadas nesta thread; as metricas so sao lidas em modo serial
+    pthread_mutex_lock(&g_srvSerial);
+    pthread_rwlock_rdlock(&g_srvDados);
+    pthread_mutex_lock(&g_poolMutex);
+    metrica_juntar_thread();
+    pthread_mutex_unlock(&g_poolMutex);
+    pthread_rwlock_unlock(&g_srvDados);
+    pthread_mutex_unlock(&g_srvSerial);
+
+    servidor_log("Cliente %d desconectado.\n", c->numero);
+    pthread_mutex_lock(&g_conexoesMutex);
+    c->terminou = 1;
+    pthread_mutex_unlock(&g_conexoesMutex);
+    return NULL;
+}
+
+// Junta as threads que ja sairam; devolve uma vaga livre (NULL = lotado)
+static Conexao *servidor_vaga()
+{
+    Conexao *livre = NULL;
+    for (int i = 0; i < SERVIDOR_MAX_CLIENTES; i++)
+    {
+        Conexao *c = &g_conexoes[i];
+        pthread_mutex_lock(&g_conexoesMutex);
+        int terminou = c->ocupada && c->terminou;
+        pthread_mutex_unlock(&g_conexoesMutex);
+        if (terminou)
+        {
+            pthread_join(c->thread, NULL);
+            close(c->fd);
+            c->ocupada = 0;
+        }
+        if (!c->ocupada && !livre)
+            livre = c;
+    }
+    return livre;
+}
+
+// Socket escutando em 'caminho' (-1 = erro). Um socket que sobrou de uma
+// execucao anterior e removido, mas so se ninguem atende nele.
+static int servidor_escutar(const char *caminho)
+{
+    struct sockaddr_un end;
+    struct stat st;
+    memset(&end, 0, sizeof(end));
+    end.sun_family = AF_UNIX;
+    if (strlen(caminho) >= sizeof(end.sun_path))
+    {
+        fprintf(stderr, "Caminho do socket longo demais: %s\n", caminho);
+        return -1;
+    }
+    memcpy(end.sun_path, caminho, strlen(caminho) + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&end, sizeof(end)) == 0)
+    {
+        fprintf(stderr, "Ja existe um servidor em %s.\n", caminho);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    if (lstat(caminho, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(caminho);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&end, sizeof(end)) != 0 || listen(fd, SOMAXCONN) != 0)
+    {
+        fprintf(stderr, "Nao foi possivel abrir o socket %s.\n", caminho);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    chmod(caminho, 0660); // terminais do mesmo grupo
+    return fd;
+}
+#endif
+
+int clinica_servir(void)
+{
+#ifdef CLINICA_THREADS
+    if (g_ctl)
+    {
+        fprintf(stderr, "O servidor nao roda com --compartilhado: ele ja e o unico dono dos arquivos.\n");
+        return CLINICA_INVALIDO;
+    }
+    const char *caminho = g_socket ? g_socket : CLINICA_SOCKET_PADRAO;
+    int fd = servidor_escutar(caminho);
+    if (fd < 0)
+        return CLINICA_ERRO_ARQUIVO;
+
+    // SA_RESTART: o sinal nao interrompe as gravacoes em andamento; o poll
+    // volta sozinho a cada SERVIDOR_ESPERA_MS
+    struct sigaction sa, antesInt, antesTerm, antesPipe;
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sa.sa_handler = servidor_sinal;
+    sigaction(SIGINT, &sa, &antesInt);
+    sigaction(SIGTERM, &sa, &antesTerm);
+    sa.sa_handler = SIG_IGN; // cliente que caiu no meio da resposta
+    sigaction(SIGPIPE, &sa, &antesPipe);
+
+    // Com glibc a trava de leitura daria preferencia as buscas e uma
+    // alteracao poderia esperar para sempre
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(&g_srvDados, &attr);
+    pthread_rwlockattr_destroy(&attr);
+
+    g_srvLog = g_avisosDefinidos ? g_avisos : stdout;
+    g_srvParar = 0;
+    servidor_log("Servidor em %s (ate %d clientes, %d thread(s) no pool). Ctrl+C encerra.\n", caminho,
+                 SERVIDOR_MAX_CLIENTES, pool_tamanho());
+    int numero = 0;
+    while (!g_srvParar)
+    {
+        struct pollfd p = {fd, POLLIN, 0};
+        if (poll(&p, 1, SERVIDOR_ESPERA_MS) <= 0)
+            continue;
+        int cli = accept(fd, NULL, NULL);
+        if (cli < 0)
+            continue;
+        Conexao *c = servidor_vaga();
+        if (!c)
+        {
+            // Resposta ao PED_OLA que o cliente manda ao conectar
+            Quadro q = {NULL, 0, 0, 0, 0};
+            quadro_iniciar(&q, RESP_FIM);
+            quadro_int(&q, CLINICA_ERRO_CONEXAO);
+            quadro_enviar(cli, &q);
+            quadro_liberar(&q);
+            close(cli);
+            servidor_log("Conexao recusada: %d clientes ja conectados.\n", SERVIDOR_MAX_CLIENTES);
+            continue;
+        }
+        memset(c, 0, sizeof(*c));
+        c->fd = cli;
+        c->numero = ++numero;
+        c->ocupada = 1;
+        servidor_log("Cliente %d conectado.\n", c->numero);
+        if (pthread_create(&c->thread, NULL, servir_conexao, c) != 0)
+        {
+            servidor_log("Cliente %d desconectado: sem recurso para a thread.\n", c->numero);
+            close(cli);
+            c->ocupada = 0;
+        }
+    }
+
+    // Quem esta esperando pedido sai do recv; quem esta no meio termina o pedido
+    close(fd);
+    unlink(caminho);
+    for (int i = 0; i < SERVIDOR_MAX_CLIENTES; i++)
+        if (g_conexoes[i].ocupada)
+            shutdown(g_conexoes[i].fd, SHUT_RDWR);
+    for (int i = 0; i < SERVIDOR_MAX_CLIENTES; i++)
+        if (g_conexoes[i].ocupada)
+        {
+            pthread_join(g_conexoes[i].thread, NULL);
+            close(g_conexoes[i].fd);
+            g_conexoes[i].ocupada = 0;
+        }
+    pthread_rwlock_destroy(&g_srvDados);
+    estado_liberar(&g_srvCopia);
+    g_srvCopiaValida = 0;
+    sigaction(SIGINT, &antesInt, NULL);
+    sigaction(SIGTERM, &antesTerm, NULL);
+    sigaction(SIGPIPE, &antesPipe, NULL);
+    servidor_log("Servidor encerrado.\n");
+    return CLINICA_OK;
+#else
+    fprintf(stderr, "Servidor indisponivel nesta plataforma (sem socket Unix).\n");
+    return CLINICA_INVALIDO;
+#endif
+}
+
+// ======== Inicializao ========
+static int inicializar_aplicacao()
+{
+    if (!tabela_adicionar_coluna(&g_tabCons, (void **)&g_consData, sizeof(int)) ||
+        !tabela_adicionar_coluna(&g_tabCons, (void **)&g_consId, sizeof(int)) ||
+        !tabela_adicionar_coluna(&g_tabCons, (void **)&g_consAnimal, sizeof(int)) ||
+        !tabela_adicionar_coluna(&g_tabCons, (void **)&g_consCrm, sizeof(int)) ||
+        !tabela_adicionar_coluna(&g_tabCons, (void **)&g_consValor, sizeof(double)) ||
+        !tabela_adicionar_coluna(&g_tabAnimais, (void **)&g_animalEspecie, sizeof(unsigned short)))
+        return CLINICA_ERRO_MEMORIA;
+    if (!tabela_reservar(&g_tabAnimais, TABELA_CAP_MIN) ||
+        !tabela_reservar(&g_tabVets, TABELA_CAP_MIN) ||
+        !tabela_reservar(&g_tabCons, TABELA_CAP_MIN))
+    {
+        aviso("Falha de memoria na inicializacao.\n");
+        tabela_liberar(&g_tabAnimais);
+        tabela_liberar(&g_tabVets);
+        tabela_liberar(&g_tabCons);
+        return CLINICA_ERRO_MEMORIA;
+    }
+    if (g_somenteMemoria)
+        return CLINICA_OK;
+    if (g_compartilhado)
+    {
+        int r = compartilhado_abrir(); // a carga inteira acontece com a trava do log
+        if (r != CLINICA_OK)
+            return r;
+    }
+
+    // Carregar dados dos binrios (se existirem)
+    Medicao m = metrica_iniciar();
+    if (!carregar_animais(ARQ_ANIMAIS))
+    {
+        aviso("Erro ao carregar animais.\n");
+        return CLINICA_ERRO_ARQUIVO;
+    }
+    metrica_registrar(MET_CARREGAR, &m, g_nAnimais);
+    m = metrica_iniciar();
+    if (!carregar_vets(ARQ_VETS))
+    {
+        aviso("Erro ao carregar veterinarios.\n");
+        return CLINICA_ERRO_ARQUIVO;
+    }
+    metrica_registrar(MET_CARREGAR, &m, g_nVets);
+    m = metrica_iniciar();
+    if (!carregar_cons(ARQ_CONS))
+    {
+        aviso("Erro ao carregar consultas.\n");
+        return CLINICA_ERRO_ARQUIVO;
+    }
+    metrica_registrar(MET_CARREGAR, &m, g_nCons);
+
+    // Alteracoes feitas depois do ultimo checkpoint
+    int wal = wal_abrir(ARQ_WAL, g_ctl ? (long)g_ctl->fimLog : -1);
+    if (wal < 0)
+    {
+        aviso("Erro ao reaplicar o log " ARQ_WAL ".\n");
+        return CLINICA_ERRO_ARQUIVO;
+    }
+    if (wal == 0 && g_ctl)
+    {
+        aviso("O modo compartilhado precisa do log " ARQ_WAL ".\n");
+        return CLINICA_ERRO_ARQUIVO;
+    }
+    if (wal == 0)
+        aviso("Aviso: log indisponivel; os dados serao salvos so nos .bin.\n");
+
+    // Arquivos no formato antigo sao convertidos ja na partida
+    if (g_arquivosLegados > 0)
+    {
+        aviso("Convertendo arquivos para o formato atual...\n");
+        if (!checkpoint())
+            return CLINICA_ERRO_GRAVACAO;
+    }
+
+    return compartilhado_publicar(CLINICA_OK);
+}
+
+
+// ======== API: sessao ========
+void clinica_definir_avisos(FILE *f)
+{
+    g_avisos = f;
+    g_avisosDefinidos = 1;
+}
+
+int clinica_data(const char *data)
+{
+    return data_to_int(data);
+}
+
+void clinica_totais(int *animais, int *vets, int *consultas)
+{
+    compartilhado_ler();
+    if (animais)
+        *animais = tabela_ativos(&g_tabAnimais);
+    if (vets)
+        *vets = tabela_ativos(&g_tabVets);
+    if (consultas)
+        *consultas = tabela_ativos(&g_tabCons);
+}
+
+double clinica_segundos(void)
+{
+    return agora_segundos();
+}
+
+static int g_sessaoAberta = 0;
+
+int clinica_abrir(const OpcoesClinica *op)
+{
+    static const OpcoesClinica padrao = {0, 0, 0, NULL, 0};
+    if (g_sessaoAberta)
+        return CLINICA_INVALIDO;
+    if (!op)
+        op = &padrao;
+    g_threads = op->threads;
+    g_usarMmap = !op->semMmap;
+    g_somenteMemoria = g_semGravar = op->somenteMemoria != 0;
+    g_socket = op->servidor;
+    g_compartilhado = op->compartilhado && !op->somenteMemoria;
+    g_sessaoAberta = 1;
+    g_metInicio = agora_segundos();
+    if (!g_filtroInt)
+        filtros_escolher();
+    pool_iniciar();
+    int r = inicializar_aplicacao();
+    if (r != CLINICA_OK)
+        clinica_fechar();
+    return r;
+}
+
+// Tambem volta ao estado de antes de clinica_abrir: a sessao pode ser reaberta
+void clinica_fechar(void)
+{
+    if (g_saidaExportacao)
+        fclose(g_saidaExportacao);
+    g_saidaExportacao = NULL;
+    if (g_wal)
+        fclose(g_wal);
+    g_wal = NULL;
+    g_walUsado = 0; // o que nao foi sincronizado e descartado, como o resto
+    g_walBytes = 0;
+    g_walPendente = 0;
+    g_walErro = 0;
+    compartilhado_fechar();
+
+    tabela_liberar(&g_tabAnimais);
+    tabela_liberar(&g_tabVets);
+    tabela_liberar(&g_tabCons);
+    rev_liberar(&g_consPorAnimal);
+    rev_liberar(&g_consPorVet);
+    rev_liberar(&g_consPorEspecie);
+    idxdata_liberar(&g_consPorData);
+    agregados_liberar(&g_agrPorVet);
+    agregados_liberar(&g_agrPorEspecie);
+    agregados_liberar(&g_agrPorMes);
+    especies_liberar();
+    pool_encerrar();
+    buffers_liberar();
+    g_nextIdAnimal = 1;
+    g_nextIdConsulta = 1;
+    g_arquivosLegados = 0;
+    g_sessaoAberta = 0;
+}
@@ -0,0 +1,208 @@
+#ifndef CLINICA_H
+#define CLINICA_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Nucleo da clinica (libclinica): tabelas, buscas, persistencia (.bin + log),
+// filtros, relatorios e estatisticas. Nada aqui le a entrada padrao: os dados
+// entram por parametro e saem por struct, FILE* ou codigo de retorno.
+//
+// Uma sessao aberta por vez no processo (clinica_abrir ... clinica_fechar;
+// depois de fechar, ou de uma abertura que falhou, pode abrir de novo), chamada
+// de uma thread so; o pool de threads dos relatorios e da importacao e interno. O
+// servidor (clinica_servir) e quem chama de varias threads, com as travas dele.
+// Os arquivos (.bin, log, relatorios) ficam na pasta atual.
+//
+// No modo compartilhado varios processos usam a mesma pasta: cada alteracao
+// trava o log, aplica antes o que os outros gravaram e sai do log ja visivel
+// para eles; cada leitura aplica o que os outros gravaram desde a anterior.
+//
+// Avisos da carga, do checkpoint e os resumos de importacao, exportacao e
+// relatorios vao para o fluxo de avisos (clinica_definir_avisos; padrao:
+// saida padrao). Linhas rejeitadas na importacao e erros de argumento das
+// rotinas de linha de comando vao para stderr.
+
+#define NOME_TAM 50
+#define ESPECIE_TAM 30
+#define DATA_TAM 11 // "DD/MM/AAAA" + '\0'
+#define TELEFONE_TAM 16
+
+typedef struct
+{
+    int idAnimal;
+    char nome[NOME_TAM];
+    char especie[ESPECIE_TAM];
+    char dataNascimento[DATA_TAM];
+    double peso;
+} Animal;
+
+typedef struct
+{
+    int crmVet;
+    char nome[NOME_TAM];
+    char telefone[TELEFONE_TAM];
+} Veterinario;
+
+typedef struct
+{
+    int idConsulta;
+    int idAnimal; // FK -> Animal.idAnimal
+    int crmVet;   // FK -> Veterinario.crmVet
+    char dataConsulta[DATA_TAM];
+    double valor;
+} Consulta;
+
+// ======== Codigos de retorno ========
+// Sucesso e >= 0 (algumas funcoes devolvem uma quantidade); erro e < 0
+#define CLINICA_OK 0
+#define CLINICA_ERRO_MEMORIA -1
+#define CLINICA_NAO_ENCONTRADO -2      // chave primaria inexistente
+#define CLINICA_DUPLICADO -3           // CRM ja cadastrado
+#define CLINICA_INVALIDO -4            // argumento fora do dominio (CRM <= 0, faixa, tipo, linhas rejeitadas)
+#define CLINICA_DATA_INVALIDA -5       // data fora de DD/MM/AAAA ou periodo invertido
+#define CLINICA_ANIMAL_INEXISTENTE -6  // FK da consulta
+#define CLINICA_VET_INEXISTENTE -7     // FK da consulta
+#define CLINICA_EM_USO -8              // ha consultas vinculadas
+#define CLINICA_ERRO_ARQUIVO -9        // arquivo nao abriu / nao carregou
+#define CLINICA_ERRO_GRAVACAO -10      // falha ao gravar (.bin, log ou relatorio)
+#define CLINICA_ERRO_CONEXAO -11       // cliente remoto: servidor fora do ar ou conexao caiu
+
+// Mensagem curta do codigo ("animal inexistente", ...)
+const char *clinica_erro(int codigo);
+
+// ======== Sessao ========
+typedef struct
+{
+    int threads;          // tamanho do pool (0 = um por processador)
+    int semMmap;          // carrega os .bin com fread
+    int somenteMemoria;   // nao le nem grava arquivos de dados (benchmarks)
+    const char *servidor; // socket do servidor (NULL = CLINICA_SOCKET_PADRAO)
+    int compartilhado;    // varios processos na mesma pasta (clinica.trava); so POSIX
+} OpcoesClinica;
+
+// Carrega os .bin, reaplica o log e sobe o pool; NULL = opcoes padrao.
+// Com uma sessao ja aberta, CLINICA_INVALIDO.
+int clinica_abrir(const OpcoesClinica *op);
+// Libera tudo; nao grava nada (ver clinica_consolidar)
+void clinica_fechar(void);
+// Fluxo dos avisos; NULL = silencio
+void clinica_definir_avisos(FILE *f);
+
+// DD/MM/AAAA -> AAAAMMDD (-1 = invalida)
+int clinica_data(const char *data);
+void clinica_totais(int *animais, int *vets, int *consultas);
+// Relogio monotonico em segundos (para medir tempos)
+double clinica_segundos(void);
+
+// ======== Cadastros ========
+// Os ids de animal e de consulta sao atribuidos na inclusao; o CRM vem de fora.
+// Buscar com destino NULL so confere a existencia. Alterar nao troca a chave
+// primaria e so valida a data (e as FKs da consulta) que mudaram.
+int clinica_incluir_animal(Animal *a);
+int clinica_buscar_animal(int id, Animal *a);
+int clinica_alterar_animal(const Animal *a);
+int clinica_excluir_animal(int id);
+
+int clinica_incluir_vet(const Veterinario *v);
+int clinica_buscar_vet(int crm, Veterinario *v);
+int clinica_alterar_vet(const Veterinario *v);
+int clinica_excluir_vet(int crm);
+
+int clinica_incluir_consulta(Consulta *c);
+int clinica_buscar_consulta(int id, Consulta *c);
+int clinica_alterar_consulta(const Consulta *c);
+int clinica_excluir_consulta(int id);
+// Remove as consultas anteriores a data; devolve quantas
+int clinica_expurgar_consultas(const char *data);
+
+// ======== Listagens e relatorios ========
+// Listagens no formato da tela; devolvem quantos registros sairam
+int clinica_listar_animais(FILE *f);
+int clinica_listar_vets(FILE *f);
+
+#define CLINICA_TODAS 0       // todas, em ordem de id (so listagem)
+#define CLINICA_A_PARTIR_DE 1 // data <= dataConsulta, em ordem cronologica
+#define CLINICA_PERIODO 2     // data <= dataConsulta <= dataFim
+#define CLINICA_VALOR 3       // valorMin <= valor <= valorMax
+#define CLINICA_POR_CRM 4     // chave = CRM
+#define CLINICA_POR_ANIMAL 5  // chave = id do animal (so listagem)
+#define CLINICA_POR_ESPECIE 6 // especie (qualquer grafia)
+
+typedef struct
+{
+    int tipo;
+    const char *data;
+    const char *dataFim;
+    double valorMin;
+    double valorMax;
+    int chave;
+    const char *especie;
+} FiltroConsultas;
+
+int clinica_listar_consultas(FILE *f, const FiltroConsultas *filtro);
+// Relatorio .txt do filtro; o nome do arquivo sai em 'arquivo' (mesmo em erro)
+int clinica_relatorio_consultas(const FiltroConsultas *filtro, char *arquivo, size_t tam);
+// Varios relatorios numa passada so. Lista separada por virgulas: crm, especie
+// (todos), crm:N, especie:Nome, data:DD/MM/AAAA, periodo:DD/MM/AAAA:DD/MM/AAAA
+int clinica_relatorios(const char *lista);
+// Um relatorio por CRM e um por especie (CLINICA_NAO_ENCONTRADO = nenhum)
+int clinica_relatorios_todos(void);
+
+// ======== Estatisticas ========
+#define CLINICA_EST_VET 0
+#define CLINICA_EST_ESPECIE 1
+#define CLINICA_EST_MES 2
+
+int clinica_estatisticas(FILE *f, int tipo);
+int clinica_relatorio_estatisticas(char *arquivo, size_t tam);
+
+// ======== Persistencia ========
+// Commit do log (sem log ativo nao ha o que fazer)
+int clinica_sincronizar(void);
+// Fecha um grupo de alteracoes: compacta, sincroniza o log e faz o checkpoint
+// se o log passou do limite
+int clinica_confirmar(void);
+// Com log, so sincroniza; sem log, grava os .bin inteiros
+int clinica_salvar(void);
+// Consolida o log nos .bin e zera o log
+int clinica_checkpoint(void);
+// Antes de sair: sincroniza e faz o checkpoint se falhar ou se o log ja cresceu
+int clinica_consolidar(void);
+
+// ======== Cargas, exportacao e bench ========
+// Troca tudo por 10 animais, 10 veterinarios e 10 consultas
+int clinica_popular_exemplos(void);
+// Base sintetica; gravar = 0 deixa a sessao so em memoria. consultas >= 0,
+// animais >= 1 e 1 <= vets <= INT_MAX - 1000 (CRMs a partir de 1000); fora
+// disso, CLINICA_INVALIDO
+int clinica_gerar(int consultas, int animais, int vets, int semente, int gravar);
+// tipo: animais, vets ou consultas
+int clinica_importar(const char *tipo, const char *arquivo);
+// tipo: animais, vets, consultas ou atendimentos; formato: csv ou ndjson; "-" = saida padrao
+int clinica_exportar(const char *tipo, const char *formato, const char *arquivo);
+// Para exportar em "-": chamar antes de abrir; o resto do que sai na saida
+// padrao passa para stderr
+int clinica_separar_saida_padrao(void);
+// Relatorios em lote com 1, 2, 4... threads e filtros escalar x SIMD
+int clinica_bench(FILE *f);
+
+// ======== Servidor ========
+#define CLINICA_SOCKET_PADRAO "clinica.sock" // na pasta atual
+
+// Atende clientes (clinica_cliente) pelo socket Unix ate SIGINT/SIGTERM; cada
+// alteracao e confirmada no log antes da resposta. Nao existe no Windows.
+int clinica_servir(void);
+
+// ======== Diagnostico ========
+void clinica_uso_memoria(FILE *f);
+void clinica_metricas(FILE *f);
+void clinica_histogramas(FILE *f);
+// Metricas em JSON
+int clinica_gravar_metricas(const char *arquivo);
+void clinica_zerar_metricas(void);
+// Para os testes: a n-esima realocacao das estruturas a partir de agora falha
+// como se faltasse memoria (0 = desliga). Sessao de uma thread so.
+void clinica_falhar_realocacao(int n);
+
+#endif
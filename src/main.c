@@ -1,57 +1,14 @@
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define NOME_TAM 50
-#define ESPECIE_TAM 30
-#define DATA_TAM 11 // "DD/MM/AAAA" + '\0'
-#define TELEFONE_TAM 16
-#define GROWTH_STEP 5
+#include "clinica.h"
 
-#define ARQ_ANIMAIS "animais.bin"
-#define ARQ_VETS "veterinarios.bin"
-#define ARQ_CONS "consultas.bin"
+// Menus, prompts e modo lote: cliente da libclinica (clinica.h), que faz todo
+// o trabalho sobre os dados
 
-// ======== Estruturas ========
-typedef struct
-{
-    int idAnimal;
-    char nome[NOME_TAM];
-    char especie[ESPECIE_TAM];
-    char dataNascimento[DATA_TAM];
-    double peso;
-} Animal;
-
-typedef struct
-{
-    int crmVet;
-    char nome[NOME_TAM];
-    char telefone[TELEFONE_TAM];
-} Veterinario;
-
-typedef struct
-{
-    int idConsulta;
-    int idAnimal; // FK -> Animal.idAnimal
-    int crmVet;   // FK -> Veterinario.crmVet
-    char dataConsulta[DATA_TAM];
-    double valor;
-} Consulta;
-
-static Animal *g_animais = NULL;
-static int g_nAnimais = 0;
-static int g_capAnimais = 0;
-
-static Veterinario *g_vets = NULL;
-static int g_nVets = 0;
-static int g_capVets = 0;
-
-static Consulta *g_consultas = NULL;
-static int g_nCons = 0;
-static int g_capCons = 0;
-
-static int g_nextIdAnimal = 1;
-static int g_nextIdConsulta = 1;
+#define ARQ_METRICAS "metricas.json" // menu Diagnostico; --metricas escolhe outro
 
 // ======== Utilidades ========
 static void limpar_buffer_entrada()
@@ -62,344 +19,27 @@ static void limpar_buffer_entrada()
     }
 }
 
-// Converses de data "DD/MM/AAAA"
-static int parse_data(const char *s, int *dd, int *mm, int *aaaa)
-{
-    if (!s || strlen(s) < 10)
-        return 0;
-    // Espera "DD/MM/AAAA"
-    if (sscanf(s, "%2d/%2d/%4d", dd, mm, aaaa) != 3)
-        return 0;
-    if (*dd < 1 || *dd > 31 || *mm < 1 || *mm > 12 || *aaaa < 1)
-        return 0;
-    return 1;
-}
-static int data_to_int(const char *s)
-{
-    int d, m, a;
-    if (!parse_data(s, &d, &m, &a))
-        return -1;
-    return a * 10000 + m * 100 + d; // AAAAMMDD
-}
-
-// ======== Capacidade dinmica ========
-static int garantir_capacidade_animais(int extra)
-{
-    if (g_nAnimais + extra <= g_capAnimais)
-        return 1;
-    int novo = g_capAnimais + GROWTH_STEP;
-    Animal *p = (Animal *)realloc(g_animais, novo * sizeof(Animal));
-    if (!p)
-        return 0;
-    g_animais = p;
-    g_capAnimais = novo;
-    return 1;
-}
-static int garantir_capacidade_veterinarios(int extra)
+static int ler_inteiro(const char *s, int *v)
 {
-    if (g_nVets + extra <= g_capVets)
-        return 1;
-    int novo = g_capVets + GROWTH_STEP;
-    Veterinario *p = (Veterinario *)realloc(g_vets, novo * sizeof(Veterinario));
-    if (!p)
+    char *fim;
+    long x = strtol(s, &fim, 10);
+    if (fim == s || *fim != '\0' || x < INT_MIN || x > INT_MAX)
         return 0;
-    g_vets = p;
-    g_capVets = novo;
+    *v = (int)x;
     return 1;
 }
-static int garantir_capacidade_consultas(int extra)
-{
-    if (g_nCons + extra <= g_capCons)
-        return 1;
-    int novo = g_capCons + GROWTH_STEP;
-    Consulta *p = (Consulta *)realloc(g_consultas, novo * sizeof(Consulta));
-    if (!p)
-        return 0;
-    g_consultas = p;
-    g_capCons = novo;
-    return 1;
-}
-
-// Ajuste para manter at 5 posies livres
-static void ajustar_capacidade_animais()
-{
-    int livres = g_capAnimais - g_nAnimais;
-    if (livres > GROWTH_STEP)
-    {
-        int novo = g_nAnimais + GROWTH_STEP;
-        Animal *p = (Animal *)realloc(g_animais, novo * sizeof(Animal));
-        if (p)
-        {
-            g_animais = p;
-            g_capAnimais = novo;
-        }
-    }
-}
-static void ajustar_capacidade_veterinarios()
-{
-    int livres = g_capVets - g_nVets;
-    if (livres > GROWTH_STEP)
-    {
-        int novo = g_nVets + GROWTH_STEP;
-        Veterinario *p = (Veterinario *)realloc(g_vets, novo * sizeof(Veterinario));
-        if (p)
-        {
-            g_vets = p;
-            g_capVets = novo;
-        }
-    }
-}
-static void ajustar_capacidade_consultas()
-{
-    int livres = g_capCons - g_nCons;
-    if (livres > GROWTH_STEP)
-    {
-        int novo = g_nCons + GROWTH_STEP;
-        Consulta *p = (Consulta *)realloc(g_consultas, novo * sizeof(Consulta));
-        if (p)
-        {
-            g_consultas = p;
-            g_capCons = novo;
-        }
-    }
-}
 
-// ======== Buscas ========
-static int encontrar_indice_animal_por_id(int id)
-{
-    for (int i = 0; i < g_nAnimais; i++)
-        if (g_animais[i].idAnimal == id)
-            return i;
-    return -1;
-}
-static int encontrar_indice_veterinario_por_crm(int crm)
-{
-    for (int i = 0; i < g_nVets; i++)
-        if (g_vets[i].crmVet == crm)
-            return i;
-    return -1;
-}
-static int encontrar_indice_consulta_por_id(int id)
-{
-    for (int i = 0; i < g_nCons; i++)
-        if (g_consultas[i].idConsulta == id)
-            return i;
-    return -1;
-}
-static int tem_consulta_para_animal(int idAnimal)
+static int ler_real(const char *s, double *v)
 {
-    for (int i = 0; i < g_nCons; i++)
-        if (g_consultas[i].idAnimal == idAnimal)
-            return 1;
-    return 0;
-}
-static int tem_consulta_para_vet(int crm)
-{
-    for (int i = 0; i < g_nCons; i++)
-        if (g_consultas[i].crmVet == crm)
-            return 1;
-    return 0;
+    char *fim;
+    *v = strtod(s, &fim);
+    return fim != s && *fim == '\0';
 }
 
-// ======== Persistncia ========
-static int salvar_animais(const char *path)
-{
-    FILE *f = fopen(path, "wb");
-    if (!f)
-        return 0;
-    if (fwrite(&g_nAnimais, sizeof(int), 1, f) != 1)
-    {
-        fclose(f);
-        return 0;
-    }
-    if (g_nAnimais > 0 && fwrite(g_animais, sizeof(Animal), g_nAnimais, f) != (size_t)g_nAnimais)
-    {
-        fclose(f);
-        return 0;
-    }
-    fclose(f);
-    return 1;
-}
-static int carregar_animais(const char *path)
+static void copiar_campo(char *dst, const char *src, size_t tam)
 {
-    FILE *f = fopen(path, "rb");
-    if (!f)
-    {
-        g_nAnimais = 0;
-        g_capAnimais = 0;
-        g_animais = NULL;
-        g_nextIdAnimal = 1;
-        return 1;
-    }
-
-    int qtd = 0;
-    if (fread(&qtd, sizeof(int), 1, f) != 1 || qtd < 0)
-    {
-        fclose(f);
-        return 0;
-    }
-
-    int cap = ((qtd / GROWTH_STEP) + 1) * GROWTH_STEP;
-    Animal *p = (Animal *)malloc((cap > 0 ? cap : GROWTH_STEP) * sizeof(Animal));
-    if (!p)
-    {
-        fclose(f);
-        return 0;
-    }
-
-    if (qtd > 0 && fread(p, sizeof(Animal), qtd, f) != (size_t)qtd)
-    {
-        free(p);
-        fclose(f);
-        return 0;
-    }
-    fclose(f);
-
-    if (g_animais)
-        free(g_animais);
-    g_animais = p;
-    g_nAnimais = qtd;
-    g_capAnimais = (cap > 0 ? cap : GROWTH_STEP);
-
-    int maxId = 0;
-    for (int i = 0; i < g_nAnimais; i++)
-        if (g_animais[i].idAnimal > maxId)
-            maxId = g_animais[i].idAnimal;
-    g_nextIdAnimal = maxId + 1;
-    if (g_nextIdAnimal < 1)
-        g_nextIdAnimal = 1;
-
-    return 1;
-}
-
-static int salvar_vets(const char *path)
-{
-    FILE *f = fopen(path, "wb");
-    if (!f)
-        return 0;
-    if (fwrite(&g_nVets, sizeof(int), 1, f) != 1)
-    {
-        fclose(f);
-        return 0;
-    }
-    if (g_nVets > 0 && fwrite(g_vets, sizeof(Veterinario), g_nVets, f) != (size_t)g_nVets)
-    {
-        fclose(f);
-        return 0;
-    }
-    fclose(f);
-    return 1;
-}
-static int carregar_vets(const char *path)
-{
-    FILE *f = fopen(path, "rb");
-    if (!f)
-    {
-        g_nVets = 0;
-        g_capVets = 0;
-        g_vets = NULL;
-        return 1;
-    }
-
-    int qtd = 0;
-    if (fread(&qtd, sizeof(int), 1, f) != 1 || qtd < 0)
-    {
-        fclose(f);
-        return 0;
-    }
-
-    int cap = ((qtd / GROWTH_STEP) + 1) * GROWTH_STEP;
-    Veterinario *p = (Veterinario *)malloc((cap > 0 ? cap : GROWTH_STEP) * sizeof(Veterinario));
-    if (!p)
-    {
-        fclose(f);
-        return 0;
-    }
-
-    if (qtd > 0 && fread(p, sizeof(Veterinario), qtd, f) != (size_t)qtd)
-    {
-        free(p);
-        fclose(f);
-        return 0;
-    }
-    fclose(f);
-
-    if (g_vets)
-        free(g_vets);
-    g_vets = p;
-    g_nVets = qtd;
-    g_capVets = (cap > 0 ? cap : GROWTH_STEP);
-    return 1;
-}
-
-static int salvar_cons(const char *path)
-{
-    FILE *f = fopen(path, "wb");
-    if (!f)
-        return 0;
-    if (fwrite(&g_nCons, sizeof(int), 1, f) != 1)
-    {
-        fclose(f);
-        return 0;
-    }
-    if (g_nCons > 0 && fwrite(g_consultas, sizeof(Consulta), g_nCons, f) != (size_t)g_nCons)
-    {
-        fclose(f);
-        return 0;
-    }
-    fclose(f);
-    return 1;
-}
-static int carregar_cons(const char *path)
-{
-    FILE *f = fopen(path, "rb");
-    if (!f)
-    {
-        g_nCons = 0;
-        g_capCons = 0;
-        g_consultas = NULL;
-        g_nextIdConsulta = 1;
-        return 1;
-    }
-
-    int qtd = 0;
-    if (fread(&qtd, sizeof(int), 1, f) != 1 || qtd < 0)
-    {
-        fclose(f);
-        return 0;
-    }
-
-    int cap = ((qtd / GROWTH_STEP) + 1) * GROWTH_STEP;
-    Consulta *p = (Consulta *)malloc((cap > 0 ? cap : GROWTH_STEP) * sizeof(Consulta));
-    if (!p)
-    {
-        fclose(f);
-        return 0;
-    }
-
-    if (qtd > 0 && fread(p, sizeof(Consulta), qtd, f) != (size_t)qtd)
-    {
-        free(p);
-        fclose(f);
-        return 0;
-    }
-    fclose(f);
-
-    if (g_consultas)
-        free(g_consultas);
-    g_consultas = p;
-    g_nCons = qtd;
-    g_capCons = (cap > 0 ? cap : GROWTH_STEP);
-
-    int maxId = 0;
-    for (int i = 0; i < g_nCons; i++)
-        if (g_consultas[i].idConsulta > maxId)
-            maxId = g_consultas[i].idConsulta;
-    g_nextIdConsulta = maxId + 1;
-    if (g_nextIdConsulta < 1)
-        g_nextIdConsulta = 1;
-
-    return 1;
+    strncpy(dst, src, tam - 1);
+    dst[tam - 1] = '\0';
 }
 
 // ======== Cabecalho/Menu util ========
@@ -410,17 +50,39 @@ static void cabecalho(const char *titulo)
     printf("========================================\n");
 }
 
-// ======== CRUD: Animais ========
-static void cadastrar_animal()
+// Mensagem de tela dos erros comuns a varias telas
+static void mostrar_erro(int r)
 {
-    if (!garantir_capacidade_animais(1))
+    switch (r)
     {
+    case CLINICA_DATA_INVALIDA:
+        printf("Data invalida.\n");
+        break;
+    case CLINICA_ANIMAL_INEXISTENTE:
+        printf("Animal inexistente.\n");
+        break;
+    case CLINICA_VET_INEXISTENTE:
+        printf("Veterinario inexistente.\n");
+        break;
+    case CLINICA_EM_USO:
+        printf("Nao e possivel remover: ha consultas vinculadas.\n");
+        break;
+    case CLINICA_ERRO_GRAVACAO:
+        printf("Falha ao gravar o log.\n");
+        break;
+    case CLINICA_ERRO_CONEXAO:
+        printf("Sem conexao com o servidor.\n");
+        break;
+    default:
         printf("Erro de memoria.\n");
-        return;
     }
+}
 
+// ======== CRUD: Animais ========
+static void cadastrar_animal()
+{
     Animal a;
-    a.idAnimal = g_nextIdAnimal++;
+    memset(&a, 0, sizeof(a));
     printf("\n[Cadastrar Animal]\n");
     printf("Nome: ");
     limpar_buffer_entrada();
@@ -436,7 +98,12 @@ static void cadastrar_animal()
         a.peso = 0.0;
     }
 
-    g_animais[g_nAnimais++] = a;
+    int r = clinica_incluir_animal(&a);
+    if (r != CLINICA_OK)
+    {
+        mostrar_erro(r);
+        return;
+    }
     printf("Animal cadastrado com id %d.\n", a.idAnimal);
 }
 
@@ -451,8 +118,8 @@ static void atualizar_animal()
         return;
     }
 
-    int idx = encontrar_indice_animal_por_id(id);
-    if (idx < 0)
+    Animal atual;
+    if (clinica_buscar_animal(id, &atual) != CLINICA_OK)
     {
         printf("Animal nao encontrado.\n");
         return;
@@ -474,25 +141,26 @@ static void atualizar_animal()
             opc = -1;
         }
 
+        Animal a = atual;
         switch (opc)
         {
         case 1:
             limpar_buffer_entrada();
             printf("Novo nome: ");
-            scanf(" %49[^\n]", g_animais[idx].nome);
+            scanf(" %49[^\n]", a.nome);
             break;
         case 2:
             limpar_buffer_entrada();
             printf("Nova especie: ");
-            scanf(" %29[^\n]", g_animais[idx].especie);
+            scanf(" %29[^\n]", a.especie);
             break;
         case 3:
             printf("Nova data (DD/MM/AAAA): ");
-            scanf(" %10s", g_animais[idx].dataNascimento);
+            scanf(" %10s", a.dataNascimento);
             break;
         case 4:
             printf("Novo peso (kg): ");
-            if (scanf("%lf", &g_animais[idx].peso) != 1)
+            if (scanf("%lf", &a.peso) != 1)
             {
                 limpar_buffer_entrada();
             }
@@ -503,6 +171,14 @@ static void atualizar_animal()
         default:
             printf("Opcao invalida.\n");
         }
+        if (opc >= 1 && opc <= 4)
+        {
+            int r = clinica_alterar_animal(&a);
+            if (r == CLINICA_OK)
+                atual = a;
+            else
+                mostrar_erro(r);
+        }
     } while (opc != 0);
 }
 
@@ -517,24 +193,13 @@ static void remover_animal()
         return;
     }
 
-    int idx = encontrar_indice_animal_por_id(id);
-    if (idx < 0)
-    {
+    int r = clinica_excluir_animal(id);
+    if (r == CLINICA_NAO_ENCONTRADO)
         printf("Animal nao encontrado.\n");
-        return;
-    }
-
-    if (tem_consulta_para_animal(id))
-    {
-        printf("Nao e possivel remover: ha consultas vinculadas.\n");
-        return;
-    }
-
-    for (int i = idx; i < g_nAnimais - 1; i++)
-        g_animais[i] = g_animais[i + 1];
-    g_nAnimais--;
-    ajustar_capacidade_animais();
-    printf("Animal removido.\n");
+    else if (r != CLINICA_OK)
+        mostrar_erro(r);
+    else
+        printf("Animal removido.\n");
 }
 
 static void consultar_animal_por_id()
@@ -548,53 +213,37 @@ static void consultar_animal_por_id()
         return;
     }
 
-    int idx = encontrar_indice_animal_por_id(id);
-    if (idx < 0)
+    Animal a;
+    if (clinica_buscar_animal(id, &a) != CLINICA_OK)
     {
         printf("Animal nao encontrado.\n");
         return;
     }
-
-    Animal *a = &g_animais[idx];
     printf("\n#%d | Nome: %s | Especie: %s | Nasc: %s | Peso: %.2f kg\n",
-           a->idAnimal, a->nome, a->especie, a->dataNascimento, a->peso);
+           a.idAnimal, a.nome, a.especie, a.dataNascimento, a.peso);
 }
 
 static void listar_animais()
 {
     printf("\n[Listar Animais]\n");
-    if (g_nAnimais == 0)
-    {
+    if (clinica_listar_animais(stdout) == 0)
         printf("Nenhum animal cadastrado.\n");
-        return;
-    }
-    for (int i = 0; i < g_nAnimais; i++)
-    {
-        printf("#%d | Nome: %s | Especie: %s | Nasc: %s | Peso: %.2f kg\n",
-               g_animais[i].idAnimal, g_animais[i].nome,
-               g_animais[i].especie, g_animais[i].dataNascimento, g_animais[i].peso);
-    }
 }
 
-// ======== CRUD: Veterinrios ========
+// ======== CRUD: Veterinarios ========
 static void cadastrar_veterinario()
 {
-    if (!garantir_capacidade_veterinarios(1))
-    {
-        printf("Erro de memoria.\n");
-        return;
-    }
-
     Veterinario v;
+    memset(&v, 0, sizeof(v));
     printf("\n[Cadastrar Veterinario]\n");
     printf("CRM (apenas numeros): ");
-    if (scanf("%d", &v.crmVet) != 1)
+    if (scanf("%d", &v.crmVet) != 1 || v.crmVet <= 0)
     {
         limpar_buffer_entrada();
         printf("Entrada invalida.\n");
         return;
     }
-    if (encontrar_indice_veterinario_por_crm(v.crmVet) != -1)
+    if (clinica_buscar_vet(v.crmVet, NULL) == CLINICA_OK)
     {
         printf("Ja existe veterinario com esse CRM.\n");
         return;
@@ -606,7 +255,11 @@ static void cadastrar_veterinario()
     printf("Telefone: ");
     scanf(" %15s", v.telefone);
 
-    g_vets[g_nVets++] = v;
+    if (clinica_incluir_vet(&v) != CLINICA_OK)
+    {
+        printf("Erro de memoria.\n");
+        return;
+    }
     printf("Veterinario cadastrado (CRM %d).\n", v.crmVet);
 }
 
@@ -621,8 +274,8 @@ static void atualizar_veterinario()
         return;
     }
 
-    int idx = encontrar_indice_veterinario_por_crm(crm);
-    if (idx < 0)
+    Veterinario v;
+    if (clinica_buscar_vet(crm, &v) != CLINICA_OK)
     {
         printf("Veterinario nao encontrado.\n");
         return;
@@ -647,11 +300,13 @@ static void atualizar_veterinario()
         case 1:
             limpar_buffer_entrada();
             printf("Novo nome: ");
-            scanf(" %49[^\n]", g_vets[idx].nome);
+            scanf(" %49[^\n]", v.nome);
+            clinica_alterar_vet(&v);
             break;
         case 2:
             printf("Novo telefone: ");
-            scanf(" %15s", g_vets[idx].telefone);
+            scanf(" %15s", v.telefone);
+            clinica_alterar_vet(&v);
             break;
         case 0:
             printf("Atualizacao concluida.\n");
@@ -673,24 +328,13 @@ static void remover_veterinario()
         return;
     }
 
-    int idx = encontrar_indice_veterinario_por_crm(crm);
-    if (idx < 0)
-    {
+    int r = clinica_excluir_vet(crm);
+    if (r == CLINICA_NAO_ENCONTRADO)
         printf("Veterinario nao encontrado.\n");
-        return;
-    }
-
-    if (tem_consulta_para_vet(crm))
-    {
-        printf("Nao e possivel remover: ha consultas vinculadas.\n");
-        return;
-    }
-
-    for (int i = idx; i < g_nVets - 1; i++)
-        g_vets[i] = g_vets[i + 1];
-    g_nVets--;
-    ajustar_capacidade_veterinarios();
-    printf("Veterinario removido.\n");
+    else if (r != CLINICA_OK)
+        mostrar_erro(r);
+    else
+        printf("Veterinario removido.\n");
 }
 
 static void consultar_veterinario_por_crm()
@@ -704,42 +348,27 @@ static void consultar_veterinario_por_crm()
         return;
     }
 
-    int idx = encontrar_indice_veterinario_por_crm(crm);
-    if (idx < 0)
+    Veterinario v;
+    if (clinica_buscar_vet(crm, &v) != CLINICA_OK)
     {
         printf("Veterinario nao encontrado.\n");
         return;
     }
-
-    Veterinario *v = &g_vets[idx];
-    printf("CRM %d | Nome: %s | Tel: %s\n", v->crmVet, v->nome, v->telefone);
+    printf("CRM %d | Nome: %s | Tel: %s\n", v.crmVet, v.nome, v.telefone);
 }
 
 static void listar_veterinarios()
 {
     printf("\n[Listar Veterinarios]\n");
-    if (g_nVets == 0)
-    {
+    if (clinica_listar_vets(stdout) == 0)
         printf("Nenhum veterinario cadastrado.\n");
-        return;
-    }
-    for (int i = 0; i < g_nVets; i++)
-    {
-        printf("CRM %d | Nome: %s | Tel: %s\n",
-               g_vets[i].crmVet, g_vets[i].nome, g_vets[i].telefone);
-    }
 }
 
 // ======== CRUD: Consultas ========
 static void cadastrar_consulta()
 {
-    if (!garantir_capacidade_consultas(1))
-    {
-        printf("Erro de memoria.\n");
-        return;
-    }
-
     Consulta c;
+    memset(&c, 0, sizeof(c));
     printf("\n[Cadastrar Consulta]\n");
     printf("ID do Animal: ");
     if (scanf("%d", &c.idAnimal) != 1)
@@ -748,7 +377,7 @@ static void cadastrar_consulta()
         printf("Entrada invalida.\n");
         return;
     }
-    if (encontrar_indice_animal_por_id(c.idAnimal) < 0)
+    if (clinica_buscar_animal(c.idAnimal, NULL) != CLINICA_OK)
     {
         printf("Animal inexistente.\n");
         return;
@@ -761,7 +390,7 @@ static void cadastrar_consulta()
         printf("Entrada invalida.\n");
         return;
     }
-    if (encontrar_indice_veterinario_por_crm(c.crmVet) < 0)
+    if (clinica_buscar_vet(c.crmVet, NULL) != CLINICA_OK)
     {
         printf("Veterinario inexistente.\n");
         return;
@@ -776,9 +405,12 @@ static void cadastrar_consulta()
         c.valor = 0.0;
     }
 
-    c.idConsulta = g_nextIdConsulta++;
-
-    g_consultas[g_nCons++] = c;
+    int r = clinica_incluir_consulta(&c);
+    if (r != CLINICA_OK)
+    {
+        mostrar_erro(r);
+        return;
+    }
     printf("Consulta cadastrada (id %d).\n", c.idConsulta);
 }
 
@@ -793,8 +425,8 @@ static void atualizar_consulta()
         return;
     }
 
-    int idx = encontrar_indice_consulta_por_id(id);
-    if (idx < 0)
+    Consulta atual;
+    if (clinica_buscar_consulta(id, &atual) != CLINICA_OK)
     {
         printf("Consulta nao encontrada.\n");
         return;
@@ -816,54 +448,43 @@ static void atualizar_consulta()
             opc = -1;
         }
 
+        Consulta c = atual;
+        int alterar = 0;
         switch (opc)
         {
         case 1:
-        {
-            int novoId;
             printf("Novo ID Animal: ");
-            if (scanf("%d", &novoId) != 1)
+            if (scanf("%d", &c.idAnimal) != 1)
             {
                 limpar_buffer_entrada();
                 printf("Invalido.\n");
                 break;
             }
-            if (encontrar_indice_animal_por_id(novoId) < 0)
-            {
-                printf("Animal inexistente.\n");
-                break;
-            }
-            g_consultas[idx].idAnimal = novoId;
-        }
-        break;
+            alterar = 1;
+            break;
         case 2:
-        {
-            int novoCrm;
             printf("Novo CRM Vet: ");
-            if (scanf("%d", &novoCrm) != 1)
+            if (scanf("%d", &c.crmVet) != 1)
             {
                 limpar_buffer_entrada();
                 printf("Invalido.\n");
                 break;
             }
-            if (encontrar_indice_veterinario_por_crm(novoCrm) < 0)
-            {
-                printf("Vet inexistente.\n");
-                break;
-            }
-            g_consultas[idx].crmVet = novoCrm;
-        }
-        break;
+            alterar = 1;
+            break;
         case 3:
             printf("Nova data (DD/MM/AAAA): ");
-            scanf(" %10s", g_consultas[idx].dataConsulta);
+            scanf(" %10s", c.dataConsulta);
+            alterar = 1;
             break;
         case 4:
             printf("Novo valor (R$): ");
-            if (scanf("%lf", &g_consultas[idx].valor) != 1)
+            if (scanf("%lf", &c.valor) != 1)
             {
                 limpar_buffer_entrada();
+                break;
             }
+            alterar = 1;
             break;
         case 0:
             printf("Atualizacao concluida.\n");
@@ -871,6 +492,16 @@ static void atualizar_consulta()
         default:
             printf("Opcao invalida.\n");
         }
+        if (alterar)
+        {
+            int r = clinica_alterar_consulta(&c);
+            if (r == CLINICA_OK)
+                atual = c;
+            else if (r == CLINICA_VET_INEXISTENTE)
+                printf("Vet inexistente.\n");
+            else
+                mostrar_erro(r);
+        }
     } while (opc != 0);
 }
 
@@ -885,235 +516,243 @@ static void remover_consulta()
         return;
     }
 
-    int idx = encontrar_indice_consulta_por_id(id);
-    if (idx < 0)
+    if (clinica_excluir_consulta(id) != CLINICA_OK)
     {
         printf("Consulta nao encontrada.\n");
         return;
     }
-
-    for (int i = idx; i < g_nCons - 1; i++)
-        g_consultas[i] = g_consultas[i + 1];
-    g_nCons--;
-    ajustar_capacidade_consultas();
     printf("Consulta removida.\n");
 }
 
+static void expurgar_consultas()
+{
+    char data[DATA_TAM];
+    printf("\n[Remover consultas anteriores a uma data]\nData (DD/MM/AAAA): ");
+    scanf(" %10s", data);
+    int qtd = clinica_expurgar_consultas(data);
+    if (qtd < 0)
+        mostrar_erro(qtd);
+    else
+        printf("%d consulta(s) removida(s).\n", qtd);
+}
+
 // ======== Listagens / Filtros da Estrutura 3 ========
-static void mostrar_consulta_expandida(const Consulta *c)
+static FiltroConsultas novo_filtro(int tipo)
 {
-    // Busca Animal e Vet
-    int ia = encontrar_indice_animal_por_id(c->idAnimal);
-    int iv = encontrar_indice_veterinario_por_crm(c->crmVet);
+    FiltroConsultas fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.tipo = tipo;
+    return fl;
+}
 
-    const char *nomeA = (ia >= 0 ? g_animais[ia].nome : "??");
-    const char *espA = (ia >= 0 ? g_animais[ia].especie : "??");
-    const char *nomeV = (iv >= 0 ? g_vets[iv].nome : "??");
-    const char *telV = (iv >= 0 ? g_vets[iv].telefone : "??");
+// Data ou periodo que nao passou na validacao da biblioteca
+static void mostrar_erro_filtro(const FiltroConsultas *fl, int r)
+{
+    if (r == CLINICA_DATA_INVALIDA && fl->tipo == CLINICA_PERIODO)
+        printf("Periodo invalido.\n");
+    else
+        mostrar_erro(r);
+}
 
-    printf("#%d | Data: %s | Valor: R$ %.2f | Animal: %s (id %d, %s) | Vet: %s (CRM %d, %s)\n",
-           c->idConsulta, c->dataConsulta, c->valor,
-           nomeA, c->idAnimal, espA,
-           nomeV, c->crmVet, telV);
+static void listar(const FiltroConsultas *fl)
+{
+    int n = clinica_listar_consultas(stdout, fl);
+    if (n == 0)
+        printf("Nenhum registro encontrado.\n");
+    else if (n < 0)
+        mostrar_erro_filtro(fl, n);
+}
+
+static int ler_faixa_valor(double *lo, double *hi)
+{
+    printf("Valor minimo (R$): ");
+    if (scanf("%lf", lo) == 1)
+    {
+        printf("Valor maximo (R$): ");
+        if (scanf("%lf", hi) == 1)
+        {
+            if (*lo <= *hi)
+                return 1;
+            printf("Faixa invalida.\n");
+            return 0;
+        }
+    }
+    limpar_buffer_entrada();
+    printf("Entrada invalida.\n");
+    return 0;
+}
+
+// Le as duas datas de um periodo (validado pela biblioteca)
+static void ler_periodo(char *dataIni, char *dataFim)
+{
+    printf("Data inicial (DD/MM/AAAA): ");
+    scanf(" %10s", dataIni);
+    printf("Data final (DD/MM/AAAA): ");
+    scanf(" %10s", dataFim);
 }
 
 static void listar_todas_consultas()
 {
     printf("\n[Listar Consultas]\n");
-    if (g_nCons == 0)
-    {
+    FiltroConsultas fl = novo_filtro(CLINICA_TODAS);
+    int n = clinica_listar_consultas(stdout, &fl);
+    if (n == 0)
         printf("Nenhuma consulta cadastrada.\n");
-        return;
-    }
-    for (int i = 0; i < g_nCons; i++)
-    {
-        mostrar_consulta_expandida(&g_consultas[i]);
-    }
+    else if (n < 0)
+        mostrar_erro(n);
 }
 
 static void listar_consultas_por_data_min()
 {
     char data[DATA_TAM];
+    FiltroConsultas fl = novo_filtro(CLINICA_A_PARTIR_DE);
     printf("\n[Consultas a partir de uma data]\nData (DD/MM/AAAA): ");
     scanf(" %10s", data);
-    int corte = data_to_int(data);
-    if (corte < 0)
-    {
-        printf("Data invalida.\n");
-        return;
-    }
+    fl.data = data;
+    listar(&fl);
+}
+
+static void listar_consultas_por_valor()
+{
+    FiltroConsultas fl = novo_filtro(CLINICA_VALOR);
+    printf("\n[Consultas por faixa de valor]\n");
+    if (ler_faixa_valor(&fl.valorMin, &fl.valorMax))
+        listar(&fl);
+}
+
+static void listar_consultas_por_periodo()
+{
+    char dataIni[DATA_TAM], dataFim[DATA_TAM];
+    FiltroConsultas fl = novo_filtro(CLINICA_PERIODO);
+    printf("\n[Consultas entre duas datas]\n");
+    ler_periodo(dataIni, dataFim);
+    fl.data = dataIni;
+    fl.dataFim = dataFim;
+    listar(&fl);
+}
 
-    int achou = 0;
-    for (int i = 0; i < g_nCons; i++)
+static void listar_consultas_por_crm()
+{
+    FiltroConsultas fl = novo_filtro(CLINICA_POR_CRM);
+    printf("\n[Consultas por CRM do veterinario]\nCRM: ");
+    if (scanf("%d", &fl.chave) != 1)
     {
-        if (data_to_int(g_consultas[i].dataConsulta) >= corte)
-        {
-            mostrar_consulta_expandida(&g_consultas[i]);
-            achou = 1;
-        }
+        limpar_buffer_entrada();
+        printf("Entrada invalida.\n");
+        return;
     }
-    if (!achou)
-        printf("Nenhum registro encontrado.\n");
+    listar(&fl);
 }
 
-static void listar_consultas_por_crm()
+static void listar_consultas_por_animal()
 {
-    int crm;
-    printf("\n[Consultas por CRM do veterinario]\nCRM: ");
-    if (scanf("%d", &crm) != 1)
+    FiltroConsultas fl = novo_filtro(CLINICA_POR_ANIMAL);
+    printf("\n[Consultas por animal]\nID do Animal: ");
+    if (scanf("%d", &fl.chave) != 1)
     {
         limpar_buffer_entrada();
         printf("Entrada invalida.\n");
         return;
     }
-    int achou = 0;
-    for (int i = 0; i < g_nCons; i++)
-        if (g_consultas[i].crmVet == crm)
-        {
-            mostrar_consulta_expandida(&g_consultas[i]);
-            achou = 1;
-        }
-    if (!achou)
-        printf("Nenhum registro encontrado.\n");
+    listar(&fl);
 }
 
 static void listar_consultas_por_especie()
 {
     char esp[ESPECIE_TAM];
+    FiltroConsultas fl = novo_filtro(CLINICA_POR_ESPECIE);
     printf("\n[Consultas por especie do animal]\nEspecie: ");
     limpar_buffer_entrada();
     scanf(" %29[^\n]", esp);
+    fl.especie = esp;
+    listar(&fl);
+}
 
-    int achou = 0;
-    for (int i = 0; i < g_nCons; i++)
-    {
-        int ia = encontrar_indice_animal_por_id(g_consultas[i].idAnimal);
-        if (ia >= 0 && strcasecmp(g_animais[ia].especie, esp) == 0)
-        {
-            mostrar_consulta_expandida(&g_consultas[i]);
-            achou = 1;
-        }
-    }
-    if (!achou)
-        printf("Nenhum registro encontrado.\n");
+// ======== Relatorios .txt ========
+// Resultado de um relatorio .txt (quantidade ou codigo de erro)
+static void avisar_gerado(int r, const char *arquivo)
+{
+    if (r >= 0)
+        printf("Gerado: %s\n", arquivo);
+    else if (r == CLINICA_ERRO_ARQUIVO)
+        printf("Erro ao criar arquivo.\n");
+    else if (r == CLINICA_ERRO_GRAVACAO)
+        printf("Erro ao gravar %s.\n", arquivo);
+    else
+        printf("Erro de memoria.\n");
+}
+
+static void gerar_relatorio(const FiltroConsultas *fl)
+{
+    char arquivo[128];
+    int r = clinica_relatorio_consultas(fl, arquivo, sizeof(arquivo));
+    if (r == CLINICA_DATA_INVALIDA)
+        mostrar_erro_filtro(fl, r);
+    else
+        avisar_gerado(r, arquivo);
 }
 
-// ======== Relatrios .txt ========
 static void gerar_relatorio_data_min()
 {
     char data[DATA_TAM];
+    FiltroConsultas fl = novo_filtro(CLINICA_A_PARTIR_DE);
     printf("\n[Relatorio] Consultas a partir de uma data\nData (DD/MM/AAAA): ");
     scanf(" %10s", data);
-    int corte = data_to_int(data);
-    if (corte < 0)
-    {
-        printf("Data invalida.\n");
-        return;
-    }
+    fl.data = data;
+    gerar_relatorio(&fl);
+}
 
-    FILE *f = fopen("relatorio_data.txt", "w");
-    if (!f)
-    {
-        printf("Erro ao criar arquivo.\n");
-        return;
-    }
+static void gerar_relatorio_periodo()
+{
+    char dataIni[DATA_TAM], dataFim[DATA_TAM];
+    FiltroConsultas fl = novo_filtro(CLINICA_PERIODO);
+    printf("\n[Relatorio] Consultas entre duas datas\n");
+    ler_periodo(dataIni, dataFim);
+    fl.data = dataIni;
+    fl.dataFim = dataFim;
+    gerar_relatorio(&fl);
+}
 
-    int total = 0;
-    fprintf(f, "RELATORIO: Consultas a partir de %s\n\n", data);
-    for (int i = 0; i < g_nCons; i++)
-    {
-        if (data_to_int(g_consultas[i].dataConsulta) >= corte)
-        {
-            int ia = encontrar_indice_animal_por_id(g_consultas[i].idAnimal);
-            int iv = encontrar_indice_veterinario_por_crm(g_consultas[i].crmVet);
-            fprintf(f, "#%d | Data: %s | Valor: %.2f | Animal: %s (id %d, %s) | Vet: %s (CRM %d)\n",
-                    g_consultas[i].idConsulta, g_consultas[i].dataConsulta, g_consultas[i].valor,
-                    ia >= 0 ? g_animais[ia].nome : "??", g_consultas[i].idAnimal, ia >= 0 ? g_animais[ia].especie : "??",
-                    iv >= 0 ? g_vets[iv].nome : "??", g_consultas[i].crmVet);
-            total++;
-        }
-    }
-    fprintf(f, "\nTotal: %d consultas.\n", total);
-    fclose(f);
-    printf("Gerado: relatorio_data.txt\n");
+static void gerar_relatorio_valor()
+{
+    FiltroConsultas fl = novo_filtro(CLINICA_VALOR);
+    printf("\n[Relatorio] Consultas por faixa de valor\n");
+    if (ler_faixa_valor(&fl.valorMin, &fl.valorMax))
+        gerar_relatorio(&fl);
 }
 
 static void gerar_relatorio_crm()
 {
-    int crm;
+    FiltroConsultas fl = novo_filtro(CLINICA_POR_CRM);
     printf("\n[Relatorio] Consultas por CRM do veterinario\nCRM: ");
-    if (scanf("%d", &crm) != 1)
+    if (scanf("%d", &fl.chave) != 1)
     {
         limpar_buffer_entrada();
         printf("Entrada invalida.\n");
         return;
     }
-
-    char nomeArq[64];
-    snprintf(nomeArq, sizeof(nomeArq), "relatorio_crm_%d.txt", crm);
-    FILE *f = fopen(nomeArq, "w");
-    if (!f)
-    {
-        printf("Erro ao criar arquivo.\n");
-        return;
-    }
-
-    int total = 0;
-    fprintf(f, "RELATORIO: Consultas por CRM %d\n\n", crm);
-    for (int i = 0; i < g_nCons; i++)
-        if (g_consultas[i].crmVet == crm)
-        {
-            int ia = encontrar_indice_animal_por_id(g_consultas[i].idAnimal);
-            int iv = encontrar_indice_veterinario_por_crm(g_consultas[i].crmVet);
-            fprintf(f, "#%d | Data: %s | Valor: %.2f | Animal: %s (id %d, %s) | Vet: %s (CRM %d)\n",
-                    g_consultas[i].idConsulta, g_consultas[i].dataConsulta, g_consultas[i].valor,
-                    ia >= 0 ? g_animais[ia].nome : "??", g_consultas[i].idAnimal, ia >= 0 ? g_animais[ia].especie : "??",
-                    iv >= 0 ? g_vets[iv].nome : "??", g_consultas[i].crmVet);
-            total++;
-        }
-    fprintf(f, "\nTotal: %d consultas.\n", total);
-    fclose(f);
-    printf("Gerado: %s\n", nomeArq);
+    gerar_relatorio(&fl);
 }
 
 static void gerar_relatorio_especie()
 {
     char esp[ESPECIE_TAM];
+    FiltroConsultas fl = novo_filtro(CLINICA_POR_ESPECIE);
     printf("\n[Relatorio] Consultas por especie do animal\nEspecie: ");
     limpar_buffer_entrada();
     scanf(" %29[^\n]", esp);
+    fl.especie = esp;
+    gerar_relatorio(&fl);
+}
 
-    char nomeArq[96];
-    snprintf(nomeArq, sizeof(nomeArq), "relatorio_especie_%s.txt", esp);
-    // Trocar espaos por '_' para nome de arquivo
-    for (char *p = nomeArq; *p; ++p)
-        if (*p == ' ')
-            *p = '_';
-    FILE *f = fopen(nomeArq, "w");
-    if (!f)
-    {
-        printf("Erro ao criar arquivo.\n");
-        return;
-    }
-
-    int total = 0;
-    fprintf(f, "RELATORIO: Consultas por especie '%s'\n\n", esp);
-    for (int i = 0; i < g_nCons; i++)
-    {
-        int ia = encontrar_indice_animal_por_id(g_consultas[i].idAnimal);
-        if (ia >= 0 && strcasecmp(g_animais[ia].especie, esp) == 0)
-        {
-            int iv = encontrar_indice_veterinario_por_crm(g_consultas[i].crmVet);
-            fprintf(f, "#%d | Data: %s | Valor: %.2f | Animal: %s (id %d, %s) | Vet: %s (CRM %d)\n",
-                    g_consultas[i].idConsulta, g_consultas[i].dataConsulta, g_consultas[i].valor,
-                    g_animais[ia].nome, g_consultas[i].idAnimal, g_animais[ia].especie,
-                    iv >= 0 ? g_vets[iv].nome : "??", g_consultas[i].crmVet);
-            total++;
-        }
-    }
-    fprintf(f, "\nTotal: %d consultas.\n", total);
-    fclose(f);
-    printf("Gerado: %s\n", nomeArq);
+static void gerar_relatorios_todos()
+{
+    printf("\n[Relatorio] Todos por CRM e por especie\n");
+    int r = clinica_relatorios_todos();
+    if (r == CLINICA_ERRO_MEMORIA)
+        printf("Erro de memoria.\n");
+    else if (r == CLINICA_NAO_ENCONTRADO)
+        printf("Nenhum veterinario ou animal cadastrado.\n");
 }
 
 // ======== Submenus ========
@@ -1193,6 +832,9 @@ static void submenu_consultar_consultas()
         printf("(2) Filtrar por data minima (>=)\n");
         printf("(3) Filtrar por CRM do veterinario\n");
         printf("(4) Filtrar por especie do animal\n");
+        printf("(5) Filtrar por animal (id)\n");
+        printf("(6) Filtrar por periodo (entre datas)\n");
+        printf("(7) Filtrar por faixa de valor\n");
         printf("(0) Voltar\n");
         printf("----------------------------------------\n");
         printf("Escolha: ");
@@ -1216,6 +858,15 @@ static void submenu_consultar_consultas()
         case 4:
             listar_consultas_por_especie();
             break;
+        case 5:
+            listar_consultas_por_animal();
+            break;
+        case 6:
+            listar_consultas_por_periodo();
+            break;
+        case 7:
+            listar_consultas_por_valor();
+            break;
         case 0:
             break;
         default:
@@ -1230,6 +881,7 @@ static void menu_animais()
     int op;
     do
     {
+        clinica_sincronizar();
         cabecalho("MENU => ANIMAIS");
         printf("(1) Cadastrar\n");
         printf("(2) Atualizar\n");
@@ -1271,6 +923,7 @@ static void menu_veterinarios()
     int op;
     do
     {
+        clinica_sincronizar();
         cabecalho("MENU => VETERINARIOS");
         printf("(1) Cadastrar\n");
         printf("(2) Atualizar\n");
@@ -1317,6 +970,9 @@ static void menu_relatorios()
         printf("(1) Gerar por data minima\n");
         printf("(2) Gerar por CRM do veterinario\n");
         printf("(3) Gerar por especie do animal\n");
+        printf("(4) Gerar por periodo (entre datas)\n");
+        printf("(5) Gerar todos por CRM e por especie\n");
+        printf("(6) Gerar por faixa de valor\n");
         printf("(0) Voltar\n");
         printf("----------------------------------------\n");
         printf("Escolha: ");
@@ -1337,6 +993,15 @@ static void menu_relatorios()
         case 3:
             gerar_relatorio_especie();
             break;
+        case 4:
+            gerar_relatorio_periodo();
+            break;
+        case 5:
+            gerar_relatorios_todos();
+            break;
+        case 6:
+            gerar_relatorio_valor();
+            break;
         case 0:
             break;
         default:
@@ -1345,73 +1010,118 @@ static void menu_relatorios()
     } while (op != 0);
 }
 
-// ======== Popular exemplos (opcional til para gerar os .bin com >=10) ========
-static void popular_exemplos()
+// ======== Estatisticas (receita e consultas) ========
+static void mostrar_estatisticas(int tipo)
 {
-    // Limpar atuais
-    g_nAnimais = g_nVets = g_nCons = 0;
-    g_nextIdAnimal = 1;
-    g_nextIdConsulta = 1;
+    static const char *titulos[] = {"por veterinario", "por especie", "por mes"};
+    printf("\n[Estatisticas] Receita e consultas %s\n", titulos[tipo]);
+    if (clinica_estatisticas(stdout, tipo) != CLINICA_OK)
+        printf("Erro de memoria.\n");
+}
 
-    // Animais (10)
-    const char *nomesA[10] = {"Luna", "Thor", "Mel", "Rex", "Nina", "Bob", "Maya", "Max", "Lola", "Koda"};
-    const char *espsA[10] = {"Cachorro", "Gato", "Cachorro", "Cachorro", "Gato", "Cachorro", "Pssaro", "Gato", "Cachorro", "Coelho"};
-    const char *datasA[10] = {"01/01/2020", "15/03/2019", "22/07/2021", "05/11/2018", "09/09/2020", "30/06/2017", "12/12/2022", "25/05/2016", "10/10/2019", "02/08/2023"};
-    double pesosA[10] = {12.5, 4.2, 9.8, 20.1, 3.9, 18.0, 0.2, 5.0, 14.3, 1.1};
+static void gerar_relatorio_estatisticas()
+{
+    char arquivo[64];
+    avisar_gerado(clinica_relatorio_estatisticas(arquivo, sizeof(arquivo)), arquivo);
+}
 
-    for (int i = 0; i < 10; i++)
+static void menu_estatisticas()
+{
+    int op;
+    do
     {
-        if (!garantir_capacidade_animais(1))
-            return;
-        Animal a;
-        a.idAnimal = g_nextIdAnimal++;
-        strncpy(a.nome, nomesA[i], NOME_TAM);
-        a.nome[NOME_TAM - 1] = '\0';
-        strncpy(a.especie, espsA[i], ESPECIE_TAM);
-        a.especie[ESPECIE_TAM - 1] = '\0';
-        strncpy(a.dataNascimento, datasA[i], DATA_TAM);
-        a.dataNascimento[DATA_TAM - 1] = '\0';
-        a.peso = pesosA[i];
-        g_animais[g_nAnimais++] = a;
-    }
+        cabecalho("MENU => ESTATISTICAS");
+        printf("(1) Receita e consultas por veterinario\n");
+        printf("(2) Receita e consultas por especie\n");
+        printf("(3) Receita e consultas por mes\n");
+        printf("(4) Gerar relatorio (.txt)\n");
+        printf("(0) Voltar\n");
+        printf("----------------------------------------\n");
+        printf("Escolha: ");
+        if (scanf("%d", &op) != 1)
+        {
+            limpar_buffer_entrada();
+            op = -1;
+        }
 
-    // Veterinarios (10)
-    const char *nomesV[10] = {"Dr. Silva", "Dra. Souza", "Dr. Pereira", "Dra. Rocha", "Dr. Lima", "Dra. Alves", "Dr. Gomes", "Dra. Costa", "Dr. Araujo", "Dra. Moraes"};
-    const char *telsV[10] = {"34-1111-1111", "34-2222-2222", "34-3333-3333", "34-4444-4444", "34-5555-5555",
-                             "34-6666-6666", "34-7777-7777", "34-8888-8888", "34-9999-9999", "34-1234-5678"};
-    for (int i = 0; i < 10; i++)
-    {
-        if (!garantir_capacidade_veterinarios(1))
-            return;
-        Veterinario v;
-        v.crmVet = 1000 + i; // nico
-        strncpy(v.nome, nomesV[i], NOME_TAM);
-        v.nome[NOME_TAM - 1] = '\0';
-        strncpy(v.telefone, telsV[i], TELEFONE_TAM);
-        v.telefone[TELEFONE_TAM - 1] = '\0';
-        g_vets[g_nVets++] = v;
-    }
+        switch (op)
+        {
+        case 1:
+            mostrar_estatisticas(CLINICA_EST_VET);
+            break;
+        case 2:
+            mostrar_estatisticas(CLINICA_EST_ESPECIE);
+            break;
+        case 3:
+            mostrar_estatisticas(CLINICA_EST_MES);
+            break;
+        case 4:
+            gerar_relatorio_estatisticas();
+            break;
+        case 0:
+            break;
+        default:
+            printf("Opcao invalida.\n");
+        }
+    } while (op != 0);
+}
 
-    // Consultas (10)  distribui datas e valores
-    const char *datasC[10] = {"01/09/2024", "15/10/2024", "20/12/2024", "03/01/2025", "18/02/2025",
-                              "05/03/2025", "22/04/2025", "10/05/2025", "19/06/2025", "01/07/2025"};
-    double valores[10] = {120, 150, 90, 200, 80, 140, 95, 110, 180, 160};
+// ======== Diagnostico (metricas das operacoes) ========
+static void mostrar_uso_memoria()
+{
+    cabecalho("USO DE MEMORIA DAS TABELAS");
+    clinica_uso_memoria(stdout);
+}
 
-    for (int i = 0; i < 10; i++)
+static void menu_diagnostico()
+{
+    int op;
+    do
     {
-        if (!garantir_capacidade_consultas(1))
-            return;
-        Consulta c;
-        c.idConsulta = g_nextIdConsulta++;
-        c.idAnimal = g_animais[(i * 3) % 10].idAnimal;
-        c.crmVet = g_vets[(i * 2) % 10].crmVet;
-        strncpy(c.dataConsulta, datasC[i], DATA_TAM);
-        c.dataConsulta[DATA_TAM - 1] = '\0';
-        c.valor = valores[i];
-        g_consultas[g_nCons++] = c;
-    }
+        cabecalho("MENU => DIAGNOSTICO");
+        printf("(1) Metricas das operacoes\n");
+        printf("(2) Histogramas de latencia\n");
+        printf("(3) Uso de memoria das tabelas\n");
+        printf("(4) Gravar metricas em " ARQ_METRICAS "\n");
+        printf("(5) Zerar metricas\n");
+        printf("(0) Voltar\n");
+        printf("----------------------------------------\n");
+        printf("Escolha: ");
+        if (scanf("%d", &op) != 1)
+        {
+            limpar_buffer_entrada();
+            op = -1;
+        }
 
-    printf("Dados de exemplo inseridos (10 de cada estrutura).\n");
+        switch (op)
+        {
+        case 1:
+            cabecalho("DIAGNOSTICO => METRICAS DAS OPERACOES");
+            clinica_metricas(stdout);
+            break;
+        case 2:
+            cabecalho("DIAGNOSTICO => HISTOGRAMAS DE LATENCIA");
+            clinica_histogramas(stdout);
+            break;
+        case 3:
+            mostrar_uso_memoria();
+            break;
+        case 4:
+            if (clinica_gravar_metricas(ARQ_METRICAS) == CLINICA_OK)
+                printf("Gerado: %s\n", ARQ_METRICAS);
+            else
+                printf("Erro ao gravar %s.\n", ARQ_METRICAS);
+            break;
+        case 5:
+            clinica_zerar_metricas();
+            printf("Metricas zeradas.\n");
+            break;
+        case 0:
+            break;
+        default:
+            printf("Opcao invalida.\n");
+        }
+    } while (op != 0);
 }
 
 // ======== Menu principal ========
@@ -1420,11 +1130,13 @@ static void menu_consultas()
     int op;
     do
     {
+        clinica_sincronizar();
         cabecalho("MENU => CONSULTAS");
         printf("(1) Cadastrar\n");
         printf("(2) Atualizar\n");
         printf("(3) Remover\n");
         printf("(4) Consultar/Listar (filtros)\n");
+        printf("(5) Remover consultas anteriores a uma data\n");
         printf("(0) Voltar\n");
         printf("----------------------------------------\n");
         printf("Escolha: ");
@@ -1448,6 +1160,9 @@ static void menu_consultas()
         case 4:
             submenu_consultar_consultas();
             break;
+        case 5:
+            expurgar_consultas();
+            break;
         case 0:
             break;
         default:
@@ -1468,6 +1183,10 @@ static void menu_principal()
         printf("(4) Relatorios (TXT)\n");
         printf("(5) Popular exemplos (gera 10 de cada)\n");
         printf("(6) Salvar agora\n");
+        printf("(7) Uso de memoria das tabelas\n");
+        printf("(8) Checkpoint (consolidar o log nos .bin)\n");
+        printf("(9) Estatisticas (receita e consultas)\n");
+        printf("(10) Diagnostico (metricas das operacoes)\n");
         printf("(0) Sair (salva e encerra)\n");
         printf("----------------------------------------\n");
         printf("Escolha: ");
@@ -1492,83 +1211,483 @@ static void menu_principal()
             menu_relatorios();
             break;
         case 5:
-            popular_exemplos();
+            if (clinica_popular_exemplos() == CLINICA_OK)
+                printf("Dados de exemplo inseridos (10 de cada estrutura).\n");
+            else
+                printf("Erro de memoria.\n");
             break;
         case 6:
-        {
-            if (!salvar_animais(ARQ_ANIMAIS))
-                puts("Falha ao salvar animais.");
-            if (!salvar_vets(ARQ_VETS))
-                puts("Falha ao salvar veterinarios.");
-            if (!salvar_cons(ARQ_CONS))
-                puts("Falha ao salvar consultas.");
-            else
+            if (clinica_salvar() == CLINICA_OK)
                 puts("Arquivos salvos.");
-        }
-        break;
+            break;
+        case 7:
+            mostrar_uso_memoria();
+            break;
+        case 8:
+            clinica_checkpoint();
+            break;
+        case 9:
+            menu_estatisticas();
+            break;
+        case 10:
+            menu_diagnostico();
+            break;
         case 0:
             printf("Salvando e saindo...\n");
-            if (!salvar_animais(ARQ_ANIMAIS))
-                puts("Falha ao salvar animais.");
-            if (!salvar_vets(ARQ_VETS))
-                puts("Falha ao salvar veterinarios.");
-            if (!salvar_cons(ARQ_CONS))
-                puts("Falha ao salvar consultas.");
+            clinica_consolidar();
             break;
         default:
             printf("Opcao invalida.\n");
         }
+        if (op != 0)
+            clinica_confirmar(); // commit em grupo do que foi feito na opcao
     } while (op != 0);
 }
 
-// ======== Inicializao ========
-static int inicializar_aplicacao()
+// ======== Modo lote (--lote) ========
+// Uma operacao por linha, direto na biblioteca, sem menus nem prompts:
+//   add-animal <nome> <especie> <DD/MM/AAAA> <peso>
+//   set-animal <id> nome|especie|nascimento|peso <valor>
+//   del-animal <id>
+//   add-vet <crm> <nome> <telefone>
+//   set-vet <crm> nome|telefone <valor>
+//   del-vet <crm>
+//   add-consulta <idAnimal> <crm> <DD/MM/AAAA> <valor>
+//   set-consulta <id> animal|vet|data|valor <valor>
+//   del-consulta <id>
+//   expurgar <DD/MM/AAAA>
+//   commit | checkpoint
+// Campos com espacos vao entre aspas ("Dr. Silva"); '#' inicia comentario.
+// O log e sincronizado a cada 'g_loteGrupo' operacoes (commit em grupo).
+#define LOTE_MAX_ARGS 6
+#define LOTE_LINHA_TAM 1024
+
+static int g_loteGrupo = 1000;
+
+// Quebra a linha em campos (separados por espaco, aspas agrupam); devolve a
+// quantidade ou -1 se passar de 'max'
+static int lote_separar(char *s, char **campos, int max)
+{
+    int n = 0;
+    for (;;)
+    {
+        while (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n')
+            s++;
+        if (*s == '\0' || *s == '#')
+            return n;
+        if (n == max)
+            return -1;
+        if (*s == '"')
+        {
+            campos[n++] = ++s;
+            while (*s && *s != '"')
+                s++;
+        }
+        else
+        {
+            campos[n++] = s;
+            while (*s && *s != ' ' && *s != '\t' && *s != '\r' && *s != '\n')
+                s++;
+        }
+        if (*s)
+            *s++ = '\0';
+    }
+}
+
+// Texto do erro de uma chamada (NULL = deu certo)
+static const char *lote_erro(int r)
+{
+    return r >= 0 ? NULL : clinica_erro(r);
+}
+
+static const char *lote_add_animal(char **a)
+{
+    Animal an;
+    memset(&an, 0, sizeof(an));
+    copiar_campo(an.nome, a[0], NOME_TAM);
+    copiar_campo(an.especie, a[1], ESPECIE_TAM);
+    copiar_campo(an.dataNascimento, a[2], DATA_TAM);
+    if (clinica_data(an.dataNascimento) < 0)
+        return "data invalida";
+    if (!ler_real(a[3], &an.peso))
+        return "peso invalido";
+    return lote_erro(clinica_incluir_animal(&an));
+}
+
+static const char *lote_set_animal(char **a)
+{
+    int id;
+    Animal an;
+    if (!ler_inteiro(a[0], &id) || clinica_buscar_animal(id, &an) != CLINICA_OK)
+        return "animal nao encontrado";
+    if (strcmp(a[1], "nome") == 0)
+        copiar_campo(an.nome, a[2], NOME_TAM);
+    else if (strcmp(a[1], "especie") == 0)
+        copiar_campo(an.especie, a[2], ESPECIE_TAM);
+    else if (strcmp(a[1], "nascimento") == 0)
+    {
+        if (clinica_data(a[2]) < 0)
+            return "data invalida";
+        copiar_campo(an.dataNascimento, a[2], DATA_TAM);
+    }
+    else if (strcmp(a[1], "peso") == 0)
+    {
+        if (!ler_real(a[2], &an.peso))
+            return "peso invalido";
+    }
+    else
+        return "campo desconhecido";
+    return lote_erro(clinica_alterar_animal(&an));
+}
+
+static const char *lote_del_animal(char **a)
+{
+    int id, r;
+    if (!ler_inteiro(a[0], &id) || (r = clinica_excluir_animal(id)) == CLINICA_NAO_ENCONTRADO)
+        return "animal nao encontrado";
+    return lote_erro(r);
+}
+
+static const char *lote_add_vet(char **a)
+{
+    Veterinario v;
+    memset(&v, 0, sizeof(v));
+    if (!ler_inteiro(a[0], &v.crmVet))
+        return "CRM invalido";
+    copiar_campo(v.nome, a[1], NOME_TAM);
+    copiar_campo(v.telefone, a[2], TELEFONE_TAM);
+    int r = clinica_incluir_vet(&v);
+    if (r == CLINICA_INVALIDO)
+        return "CRM invalido";
+    if (r == CLINICA_DUPLICADO)
+        return "ja existe veterinario com esse CRM";
+    return lote_erro(r);
+}
+
+static const char *lote_set_vet(char **a)
+{
+    int crm;
+    Veterinario v;
+    if (!ler_inteiro(a[0], &crm) || clinica_buscar_vet(crm, &v) != CLINICA_OK)
+        return "veterinario nao encontrado";
+    if (strcmp(a[1], "nome") == 0)
+        copiar_campo(v.nome, a[2], NOME_TAM);
+    else if (strcmp(a[1], "telefone") == 0)
+        copiar_campo(v.telefone, a[2], TELEFONE_TAM);
+    else
+        return "campo desconhecido";
+    return lote_erro(clinica_alterar_vet(&v));
+}
+
+static const char *lote_del_vet(char **a)
 {
-    g_capAnimais = GROWTH_STEP;
-    g_capVets = GROWTH_STEP;
-    g_capCons = GROWTH_STEP;
+    int crm, r;
+    if (!ler_inteiro(a[0], &crm) || (r = clinica_excluir_vet(crm)) == CLINICA_NAO_ENCONTRADO)
+        return "veterinario nao encontrado";
+    return lote_erro(r);
+}
 
-    g_animais = (Animal *)malloc(g_capAnimais * sizeof(Animal));
-    g_vets = (Veterinario *)malloc(g_capVets * sizeof(Veterinario));
-    g_consultas = (Consulta *)malloc(g_capCons * sizeof(Consulta));
+static const char *lote_add_consulta(char **a)
+{
+    Consulta c;
+    memset(&c, 0, sizeof(c));
+    if (!ler_inteiro(a[0], &c.idAnimal) || clinica_buscar_animal(c.idAnimal, NULL) != CLINICA_OK)
+        return "animal inexistente";
+    if (!ler_inteiro(a[1], &c.crmVet) || clinica_buscar_vet(c.crmVet, NULL) != CLINICA_OK)
+        return "veterinario inexistente";
+    copiar_campo(c.dataConsulta, a[2], DATA_TAM);
+    if (clinica_data(c.dataConsulta) < 0)
+        return "data invalida";
+    if (!ler_real(a[3], &c.valor))
+        return "valor invalido";
+    return lote_erro(clinica_incluir_consulta(&c));
+}
 
-    if (!g_animais || !g_vets || !g_consultas)
+static const char *lote_set_consulta(char **a)
+{
+    int id;
+    Consulta c;
+    if (!ler_inteiro(a[0], &id) || clinica_buscar_consulta(id, &c) != CLINICA_OK)
+        return "consulta nao encontrada";
+    if (strcmp(a[1], "animal") == 0)
     {
-        printf("Falha de memoria na inicializacao.\n");
-        free(g_animais);
-        free(g_vets);
-        free(g_consultas);
-        return 0;
+        if (!ler_inteiro(a[2], &c.idAnimal) || clinica_buscar_animal(c.idAnimal, NULL) != CLINICA_OK)
+            return "animal inexistente";
     }
+    else if (strcmp(a[1], "vet") == 0)
+    {
+        if (!ler_inteiro(a[2], &c.crmVet) || clinica_buscar_vet(c.crmVet, NULL) != CLINICA_OK)
+            return "veterinario inexistente";
+    }
+    else if (strcmp(a[1], "data") == 0)
+    {
+        if (clinica_data(a[2]) < 0)
+            return "data invalida";
+        copiar_campo(c.dataConsulta, a[2], DATA_TAM);
+    }
+    else if (strcmp(a[1], "valor") == 0)
+    {
+        if (!ler_real(a[2], &c.valor))
+            return "valor invalido";
+    }
+    else
+        return "campo desconhecido";
+    return lote_erro(clinica_alterar_consulta(&c));
+}
+
+static const char *lote_del_consulta(char **a)
+{
+    int id, r;
+    if (!ler_inteiro(a[0], &id) || (r = clinica_excluir_consulta(id)) == CLINICA_NAO_ENCONTRADO)
+        return "consulta nao encontrada";
+    return lote_erro(r);
+}
+
+static const char *lote_expurgar(char **a)
+{
+    return lote_erro(clinica_expurgar_consultas(a[0]));
+}
 
-    // Carregar dados dos binrios (se existirem)
-    if (!carregar_animais(ARQ_ANIMAIS))
+typedef struct
+{
+    const char *nome;
+    int nArgs;
+    const char *(*executar)(char **args);
+} ComandoLote;
+
+static const ComandoLote COMANDOS_LOTE[] = {
+    {"add-animal", 4, lote_add_animal},
+    {"set-animal", 3, lote_set_animal},
+    {"del-animal", 1, lote_del_animal},
+    {"add-vet", 3, lote_add_vet},
+    {"set-vet", 3, lote_set_vet},
+    {"del-vet", 1, lote_del_vet},
+    {"add-consulta", 4, lote_add_consulta},
+    {"set-consulta", 3, lote_set_consulta},
+    {"del-consulta", 1, lote_del_consulta},
+    {"expurgar", 1, lote_expurgar},
+};
+
+// Executa o arquivo de comandos ("-" = entrada padrao). Devolve 1 se todas as
+// linhas foram aceitas.
+static int executar_lote(const char *path)
+{
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!f)
     {
-        puts("Erro ao carregar animais.");
+        fprintf(stderr, "Nao foi possivel abrir %s.\n", path);
         return 0;
     }
-    if (!carregar_vets(ARQ_VETS))
+
+    char linha[LOTE_LINHA_TAM];
+    char *campos[LOTE_MAX_ARGS];
+    long nLinha = 0, nOps = 0, nErros = 0, nCommits = 0, pendentes = 0;
+    double inicio = clinica_segundos();
+    while (fgets(linha, sizeof(linha), f))
     {
-        puts("Erro ao carregar veterinarios.");
-        return 0;
+        nLinha++;
+        // Linha sem '\n' antes do fim do arquivo nao coube no buffer: descarta
+        // o resto dela em vez de executar cada pedaco como um comando
+        size_t tam = strlen(linha);
+        if (tam > 0 && linha[tam - 1] != '\n' && !feof(f))
+        {
+            int ch = fgetc(f);
+            if (ch != '\n' && ch != EOF)
+            {
+                while ((ch = fgetc(f)) != '\n' && ch != EOF)
+                    ;
+                fprintf(stderr, "linha %ld: linha longa demais (max. %d caracteres)\n", nLinha,
+                        LOTE_LINHA_TAM - 1);
+                nErros++;
+                continue;
+            }
+        }
+
+        int n = lote_separar(linha, campos, LOTE_MAX_ARGS);
+        if (n == 0)
+            continue;
+
+        const char *erro = NULL;
+        if (n < 0)
+            erro = "campos demais na linha";
+        else if (strcmp(campos[0], "commit") == 0 && n == 1)
+        {
+            nCommits++;
+            pendentes = 0;
+            erro = clinica_confirmar() == CLINICA_OK ? NULL : "falha ao gravar o log";
+        }
+        else if (strcmp(campos[0], "checkpoint") == 0 && n == 1)
+        {
+            pendentes = 0;
+            erro = clinica_checkpoint() == CLINICA_OK ? NULL : "falha no checkpoint";
+        }
+        else
+        {
+            const ComandoLote *cmd = NULL;
+            for (size_t k = 0; k < sizeof(COMANDOS_LOTE) / sizeof(COMANDOS_LOTE[0]); k++)
+                if (strcmp(campos[0], COMANDOS_LOTE[k].nome) == 0)
+                    cmd = &COMANDOS_LOTE[k];
+            if (!cmd)
+                erro = "comando desconhecido";
+            else if (n - 1 != cmd->nArgs)
+                erro = "quantidade de campos errada";
+            else if ((erro = cmd->executar(campos + 1)) == NULL)
+            {
+                nOps++;
+                if (++pendentes >= g_loteGrupo)
+                {
+                    nCommits++;
+                    pendentes = 0;
+                    if (clinica_confirmar() != CLINICA_OK)
+                        erro = "falha ao gravar o log";
+                }
+            }
+        }
+        if (erro)
+        {
+            fprintf(stderr, "linha %ld: %s\n", nLinha, erro);
+            nErros++;
+        }
     }
-    if (!carregar_cons(ARQ_CONS))
+    if (f != stdin)
+        fclose(f);
+    if (pendentes > 0)
     {
-        puts("Erro ao carregar consultas.");
-        return 0;
+        nCommits++;
+        if (clinica_confirmar() != CLINICA_OK)
+        {
+            fprintf(stderr, "Falha ao gravar o log.\n");
+            nErros++;
+        }
     }
 
-    return 1;
+    double seg = clinica_segundos() - inicio;
+    printf("Lote: %ld linha(s), %ld operacao(oes), %ld erro(s), %ld commit(s) em %.3f s", nLinha, nOps, nErros,
+           nCommits, seg);
+    if (seg > 0)
+        printf(" (%.0f op/s)", nOps / seg);
+    printf(".\n");
+    return nErros == 0;
 }
 
-int main()
+int main(int argc, char **argv)
 {
-    if (!inicializar_aplicacao())
+    const char *lote = NULL;
+    const char *importarTipo = NULL, *importarArq = NULL;
+    const char *exportarTipo = NULL, *exportarArq = NULL, *formato = "csv";
+    const char *relatorios = NULL;
+    int bench = 0, servidor = 0;
+    const char *metricas = NULL;
+    int gerar = -1, gerarAnimais = 0, gerarVets = 0, semente = 1, semGravar = 0;
+    OpcoesClinica opcoes = {0, 0, 0, NULL, 0};
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--sem-mmap") == 0)
+            opcoes.semMmap = 1;
+        else if (strcmp(argv[i], "--compartilhado") == 0)
+            opcoes.compartilhado = 1;
+        else if (strcmp(argv[i], "--lote") == 0 && i + 1 < argc)
+            lote = argv[++i];
+        else if (strcmp(argv[i], "--grupo") == 0 && i + 1 < argc && ler_inteiro(argv[i + 1], &g_loteGrupo) &&
+                 g_loteGrupo > 0)
+            i++;
+        else if (strcmp(argv[i], "--importar") == 0 && i + 2 < argc)
+        {
+            importarTipo = argv[++i];
+            importarArq = argv[++i];
+        }
+        else if (strcmp(argv[i], "--exportar") == 0 && i + 2 < argc)
+        {
+            exportarTipo = argv[++i];
+            exportarArq = argv[++i];
+        }
+        else if (strcmp(argv[i], "--formato") == 0 && i + 1 < argc)
+            formato = argv[++i];
+        else if (strcmp(argv[i], "--relatorios") == 0 && i + 1 < argc)
+            relatorios = argv[++i];
+        else if (strcmp(argv[i], "--bench") == 0)
+            bench = 1;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc && ler_inteiro(argv[i + 1], &opcoes.threads) &&
+                 opcoes.threads > 0)
+            i++;
+        else if (strcmp(argv[i], "--gerar") == 0 && i + 1 < argc && ler_inteiro(argv[i + 1], &gerar) && gerar >= 0)
+            i++;
+        else if (strcmp(argv[i], "--animais") == 0 && i + 1 < argc && ler_inteiro(argv[i + 1], &gerarAnimais) &&
+                 gerarAnimais > 0)
+            i++;
+        else if (strcmp(argv[i], "--vets") == 0 && i + 1 < argc && ler_inteiro(argv[i + 1], &gerarVets) &&
+                 gerarVets > 0 && gerarVets <= INT_MAX - 1000)
+            i++;
+        else if (strcmp(argv[i], "--semente") == 0 && i + 1 < argc && ler_inteiro(argv[i + 1], &semente))
+            i++;
+        else if (strcmp(argv[i], "--sem-gravar") == 0)
+            semGravar = 1;
+        else if (strcmp(argv[i], "--metricas") == 0 && i + 1 < argc)
+            metricas = argv[++i];
+        else if (strcmp(argv[i], "--servidor") == 0)
+            servidor = 1;
+        else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc)
+            opcoes.servidor = argv[++i];
+        else
+        {
+            fprintf(stderr,
+                    "Uso: %s [--sem-mmap] [--compartilhado] [--lote <arquivo|-> [--grupo N]]\n"
+                    "       [--importar <animais|vets|consultas> <arquivo.csv>]\n"
+                    "       [--exportar <animais|vets|consultas|atendimentos> <arquivo|-> [--formato csv|ndjson]]\n"
+                    "       [--relatorios crm,especie,crm:N,especie:Nome,data:D,periodo:D1:D2] [--bench]\n"
+                    "       [--threads N] [--metricas <arquivo.json>]\n"
+                    "       [--gerar <consultas> [--animais N] [--vets N] [--semente S] [--sem-gravar]]\n"
+                    "       [--servidor] [--socket <caminho>]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (semGravar && (gerar < 0 || lote || importarTipo))
+    {
+        fprintf(stderr, "--sem-gravar so vale com --gerar, e nao com --lote ou --importar.\n");
         return 1;
-    menu_principal();
+    }
 
-    free(g_animais);
-    free(g_vets);
-    free(g_consultas);
-    return 0;
+    if (exportarArq && strcmp(exportarArq, "-") == 0 && clinica_separar_saida_padrao() != CLINICA_OK)
+    {
+        fprintf(stderr, "Nao foi possivel redirecionar a saida padrao.\n");
+        return 1;
+    }
+    if (clinica_abrir(&opcoes) != CLINICA_OK)
+        return 1;
+    int status = 0;
+    if (gerar >= 0)
+    {
+        // Padrao: um animal para cada 10 consultas e um veterinario para cada 5000
+        int nAnimais = gerarAnimais ? gerarAnimais : gerar / 10 > 10 ? gerar / 10 : 10;
+        int nVets = gerarVets ? gerarVets : gerar / 5000 > 10 ? gerar / 5000 : 10;
+        if (clinica_gerar(gerar, nAnimais, nVets, semente, !semGravar) != CLINICA_OK)
+            status = 2;
+    }
+    if (importarTipo && clinica_importar(importarTipo, importarArq) != CLINICA_OK)
+        status = 2;
+    if (lote && !executar_lote(lote))
+        status = 2;
+    if (exportarTipo && clinica_exportar(exportarTipo, formato, exportarArq) != CLINICA_OK)
+        status = 2;
+    if (relatorios && clinica_relatorios(relatorios) != CLINICA_OK)
+        status = 2;
+    if (bench && clinica_bench(stdout) != CLINICA_OK)
+        status = 2;
+    if (servidor)
+    {
+        if (clinica_servir() != CLINICA_OK)
+            status = 2;
+        clinica_consolidar();
+    }
+    else if (!lote && !importarTipo && !exportarTipo && !relatorios && !bench && gerar < 0)
+        menu_principal();
+    if (metricas && clinica_gravar_metricas(metricas) != CLINICA_OK)
+    {
+        fprintf(stderr, "Erro ao gravar %s.\n", metricas);
+        status = 2;
+    }
+    clinica_fechar();
+    return status;
 }
+
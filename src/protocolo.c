@@ -0,0 +1,332 @@
+#include "protocolo.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // macOS: quem abre o socket ignora SIGPIPE
+#endif
+#endif
+
+// ======== Codigos de retorno ========
+// Aqui e nao em clinica.c: o cliente remoto tambem precisa dos textos
+const char *clinica_erro(int codigo)
+{
+    static const char *const mensagens[] = {"ok",
+                                            "erro de memoria",
+                                            "registro nao encontrado",
+                                            "registro duplicado",
+                                            "valor invalido",
+                                            "data invalida",
+                                            "animal inexistente",
+                                            "veterinario inexistente",
+                                            "ha consultas vinculadas",
+                                            "erro ao abrir arquivo",
+                                            "erro de gravacao",
+                                            "sem conexao com o servidor"};
+    if (codigo > 0)
+        codigo = 0;
+    if (-codigo >= (int)(sizeof(mensagens) / sizeof(mensagens[0])))
+        return "erro desconhecido";
+    return mensagens[-codigo];
+}
+
+// ======== Montagem ========
+static int quadro_garantir(Quadro *q, size_t extra)
+{
+    if (q->erro)
+        return 0;
+    if (q->n + extra <= q->cap)
+        return 1;
+    size_t novo = q->cap ? q->cap * 2 : 256;
+    while (novo < q->n + extra)
+        novo *= 2;
+    unsigned char *p = (unsigned char *)realloc(q->p, novo);
+    if (!p)
+    {
+        q->erro = 1;
+        return 0;
+    }
+    q->p = p;
+    q->cap = novo;
+    return 1;
+}
+
+// Reaproveita o buffer do quadro anterior
+void quadro_iniciar(Quadro *q, int tipo)
+{
+    q->n = 0;
+    q->pos = QUADRO_CABECALHO;
+    q->erro = 0;
+    if (quadro_garantir(q, QUADRO_CABECALHO))
+    {
+        memset(q->p, 0, 4);
+        q->p[4] = (unsigned char)tipo;
+        q->n = QUADRO_CABECALHO;
+    }
+}
+
+int quadro_tipo(const Quadro *q)
+{
+    return q->n >= QUADRO_CABECALHO ? q->p[4] : -1;
+}
+
+void quadro_liberar(Quadro *q)
+{
+    free(q->p);
+    q->p = NULL;
+    q->n = q->cap = q->pos = 0;
+    q->erro = 0;
+}
+
+void quadro_bytes(Quadro *q, const void *p, size_t k)
+{
+    if (!quadro_garantir(q, k))
+        return;
+    memcpy(q->p + q->n, p, k);
+    q->n += k;
+}
+
+void *quadro_reservar(Quadro *q, size_t k)
+{
+    if (!quadro_garantir(q, k))
+        return NULL;
+    void *p = q->p + q->n;
+    q->n += k;
+    return p;
+}
+
+void quadro_int(Quadro *q, int v)
+{
+    int32_t x = v;
+    quadro_bytes(q, &x, sizeof(x));
+}
+
+void quadro_int_em(Quadro *q, size_t pos, int v)
+{
+    int32_t x = v;
+    if (QUADRO_CABECALHO + pos + sizeof(x) <= q->n)
+        memcpy(q->p + QUADRO_CABECALHO + pos, &x, sizeof(x));
+}
+
+void quadro_real(Quadro *q, double v)
+{
+    quadro_bytes(q, &v, sizeof(v));
+}
+
+void quadro_texto(Quadro *q, const char *s)
+{
+    size_t k = s ? strlen(s) : 0;
+    if (k >= QUADRO_TEXTO_NULO)
+        k = QUADRO_TEXTO_NULO - 1;
+    uint16_t t = s ? (uint16_t)k : (uint16_t)QUADRO_TEXTO_NULO;
+    quadro_bytes(q, &t, sizeof(t));
+    if (s)
+    {
+        quadro_bytes(q, s, k);
+        quadro_bytes(q, "", 1);
+    }
+}
+
+// ======== Leitura ========
+static const unsigned char *quadro_consumir(Quadro *q, size_t k)
+{
+    if (q->erro || q->pos + k > q->n)
+    {
+        q->erro = 1;
+        return NULL;
+    }
+    const unsigned char *p = q->p + q->pos;
+    q->pos += k;
+    return p;
+}
+
+void quadro_ler_bytes(Quadro *q, void *p, size_t k)
+{
+    const unsigned char *s = quadro_consumir(q, k);
+    if (s)
+        memcpy(p, s, k);
+    else
+        memset(p, 0, k);
+}
+
+int quadro_ler_int(Quadro *q)
+{
+    int32_t x;
+    quadro_ler_bytes(q, &x, sizeof(x));
+    return (int)x;
+}
+
+double quadro_ler_real(Quadro *q)
+{
+    double v;
+    quadro_ler_bytes(q, &v, sizeof(v));
+    return v;
+}
+
+const char *quadro_ler_texto(Quadro *q)
+{
+    uint16_t t;
+    quadro_ler_bytes(q, &t, sizeof(t));
+    if (q->erro || t == QUADRO_TEXTO_NULO)
+        return NULL;
+    const unsigned char *s = quadro_consumir(q, (size_t)t + 1);
+    if (!s || s[t] != '\0')
+    {
+        q->erro = 1;
+        return NULL;
+    }
+    return (const char *)s;
+}
+
+const void *quadro_ler_resto(Quadro *q, size_t *k)
+{
+    *k = q->pos < q->n ? q->n - q->pos : 0;
+    const void *p = q->p + q->pos;
+    q->pos += *k;
+    return p;
+}
+
+// ======== Registros ========
+void quadro_animal(Quadro *q, const Animal *a)
+{
+    quadro_bytes(q, a, sizeof(*a));
+}
+
+void quadro_vet(Quadro *q, const Veterinario *v)
+{
+    quadro_bytes(q, v, sizeof(*v));
+}
+
+void quadro_consulta(Quadro *q, const Consulta *c)
+{
+    quadro_bytes(q, c, sizeof(*c));
+}
+
+void quadro_filtro(Quadro *q, const FiltroConsultas *f)
+{
+    quadro_int(q, f->tipo);
+    quadro_texto(q, f->data);
+    quadro_texto(q, f->dataFim);
+    quadro_real(q, f->valorMin);
+    quadro_real(q, f->valorMax);
+    quadro_int(q, f->chave);
+    quadro_texto(q, f->especie);
+}
+
+// A outra ponta pode mandar campos sem o '\0'
+void quadro_ler_animal(Quadro *q, Animal *a)
+{
+    quadro_ler_bytes(q, a, sizeof(*a));
+    a->nome[NOME_TAM - 1] = '\0';
+    a->especie[ESPECIE_TAM - 1] = '\0';
+    a->dataNascimento[DATA_TAM - 1] = '\0';
+}
+
+void quadro_ler_vet(Quadro *q, Veterinario *v)
+{
+    quadro_ler_bytes(q, v, sizeof(*v));
+    v->nome[NOME_TAM - 1] = '\0';
+    v->telefone[TELEFONE_TAM - 1] = '\0';
+}
+
+void quadro_ler_consulta(Quadro *q, Consulta *c)
+{
+    quadro_ler_bytes(q, c, sizeof(*c));
+    c->dataConsulta[DATA_TAM - 1] = '\0';
+}
+
+// Textos nulos viram "": o filtro nunca chega ao nucleo com NULL
+void quadro_ler_filtro(Quadro *q, FiltroConsultas *f)
+{
+    const char *s;
+    f->tipo = quadro_ler_int(q);
+    s = quadro_ler_texto(q);
+    f->data = s ? s : "";
+    s = quadro_ler_texto(q);
+    f->dataFim = s ? s : "";
+    f->valorMin = quadro_ler_real(q);
+    f->valorMax = quadro_ler_real(q);
+    f->chave = quadro_ler_int(q);
+    s = quadro_ler_texto(q);
+    f->especie = s ? s : "";
+}
+
+// ======== Transporte ========
+#if !defined(_WIN32)
+int quadro_enviar(int fd, Quadro *q)
+{
+    if (q->erro || q->n < QUADRO_CABECALHO)
+        return 0;
+    uint32_t tam = (uint32_t)(q->n - 4);
+    memcpy(q->p, &tam, sizeof(tam));
+    size_t feito = 0;
+    while (feito < q->n)
+    {
+        ssize_t w = send(fd, q->p + feito, q->n - feito, MSG_NOSIGNAL);
+        if (w < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+        feito += (size_t)w;
+    }
+    return 1;
+}
+
+// 1 = leu k bytes; 0 = fim logo no inicio; -1 = erro ou fim no meio
+static int ler_tudo(int fd, unsigned char *p, size_t k)
+{
+    size_t feito = 0;
+    while (feito < k)
+    {
+        ssize_t r = recv(fd, p + feito, k - feito, 0);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return r == 0 && feito == 0 ? 0 : -1;
+        feito += (size_t)r;
+    }
+    return 1;
+}
+
+int quadro_receber(int fd, Quadro *q)
+{
+    uint32_t tam;
+    int r = ler_tudo(fd, (unsigned char *)&tam, sizeof(tam));
+    if (r <= 0)
+        return r;
+    if (tam < 1 || tam > QUADRO_MAX + 1)
+        return -1;
+    q->n = 0;
+    q->erro = 0;
+    if (!quadro_garantir(q, (size_t)tam + 4))
+        return -1;
+    memcpy(q->p, &tam, sizeof(tam));
+    if (ler_tudo(fd, q->p + 4, tam) != 1)
+        return -1;
+    q->n = (size_t)tam + 4;
+    q->pos = QUADRO_CABECALHO;
+    return 1;
+}
+#else
+int quadro_enviar(int fd, Quadro *q)
+{
+    (void)fd;
+    (void)q;
+    return 0;
+}
+
+int quadro_receber(int fd, Quadro *q)
+{
+    (void)fd;
+    (void)q;
+    return -1;
+}
+#endif
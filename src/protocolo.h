@@ -0,0 +1,110 @@
+#ifndef PROTOCOLO_H
+#define PROTOCOLO_H
+
+#include <stddef.h>
+
+#include "clinica.h"
+
+// Protocolo binario entre o servidor (clinica --servidor) e o cliente
+// (clinica_cliente), pelo socket Unix. Os dois lados rodam na mesma maquina:
+// inteiros, reais e registros vao na representacao nativa, sem conversao, e o
+// PED_OLA confere a versao e o tamanho dos registros.
+//
+// Quadro: tamanho (uint32, bytes depois dele) | tipo (1 byte) | corpo
+// - pedido: tipo = PED_*, corpo = argumentos na ordem da funcao de clinica.h
+// - resposta: zero ou mais RESP_SAIDA (texto para o FILE* da chamada) e
+//   RESP_AVISO (texto para o fluxo de avisos), depois um RESP_FIM com o codigo
+//   de retorno (int) seguido dos resultados
+// Texto: uint16 com o tamanho (QUADRO_TEXTO_NULO = NULL), os bytes e um '\0'
+
+#define PROTOCOLO_VERSAO 1
+#define QUADRO_CABECALHO 5       // tamanho + tipo
+#define QUADRO_MAX (1 << 20)     // maior corpo aceito
+#define QUADRO_TEXTO_NULO 0xFFFF
+
+#define PED_OLA 1 // versao, sizeof(Animal), sizeof(Veterinario), sizeof(Consulta)
+#define PED_DATA 2
+#define PED_TOTAIS 3
+#define PED_INCLUIR_ANIMAL 4
+#define PED_BUSCAR_ANIMAL 5
+#define PED_ALTERAR_ANIMAL 6
+#define PED_EXCLUIR_ANIMAL 7
+#define PED_INCLUIR_VET 8
+#define PED_BUSCAR_VET 9
+#define PED_ALTERAR_VET 10
+#define PED_EXCLUIR_VET 11
+#define PED_INCLUIR_CONSULTA 12
+#define PED_BUSCAR_CONSULTA 13
+#define PED_ALTERAR_CONSULTA 14
+#define PED_EXCLUIR_CONSULTA 15
+#define PED_EXPURGAR 16
+#define PED_LISTAR_ANIMAIS 17
+#define PED_LISTAR_VETS 18
+#define PED_LISTAR_CONSULTAS 19
+#define PED_RELATORIO_CONSULTAS 20
+#define PED_RELATORIOS 21
+#define PED_RELATORIOS_TODOS 22
+#define PED_ESTATISTICAS 23
+#define PED_RELATORIO_ESTATISTICAS 24
+#define PED_SALVAR 25
+#define PED_CHECKPOINT 26
+#define PED_POPULAR_EXEMPLOS 27
+#define PED_USO_MEMORIA 28
+#define PED_METRICAS 29
+#define PED_HISTOGRAMAS 30
+#define PED_GRAVAR_METRICAS 31
+#define PED_ZERAR_METRICAS 32
+
+#define RESP_SAIDA 0x80
+#define RESP_AVISO 0x81
+#define RESP_FIM 0x82
+
+// Montado com quadro_iniciar + quadro_<tipo>; lido com quadro_ler_<tipo>.
+// Ler alem do corpo marca 'erro' e devolve zeros, entao basta conferir
+// 'erro' depois de ler todos os argumentos.
+typedef struct
+{
+    unsigned char *p; // cabecalho + corpo
+    size_t n;         // bytes usados
+    size_t cap;
+    size_t pos; // proxima leitura
+    int erro;   // faltou memoria ao montar ou o corpo acabou antes na leitura
+} Quadro;
+
+void quadro_iniciar(Quadro *q, int tipo);
+int quadro_tipo(const Quadro *q);
+void quadro_liberar(Quadro *q);
+
+void quadro_int(Quadro *q, int v);
+void quadro_real(Quadro *q, double v);
+void quadro_texto(Quadro *q, const char *s);
+void quadro_bytes(Quadro *q, const void *p, size_t k);
+// k bytes no fim do corpo para o chamador preencher (NULL sem memoria)
+void *quadro_reservar(Quadro *q, size_t k);
+// Troca o int gravado na posicao 'pos' do corpo
+void quadro_int_em(Quadro *q, size_t pos, int v);
+
+int quadro_ler_int(Quadro *q);
+double quadro_ler_real(Quadro *q);
+// Aponta para dentro do quadro; NULL = texto nulo (ou erro)
+const char *quadro_ler_texto(Quadro *q);
+void quadro_ler_bytes(Quadro *q, void *p, size_t k);
+// O que falta ler do corpo
+const void *quadro_ler_resto(Quadro *q, size_t *k);
+
+// Registros e filtro; na leitura os textos saem sempre terminados em '\0'
+void quadro_animal(Quadro *q, const Animal *a);
+void quadro_vet(Quadro *q, const Veterinario *v);
+void quadro_consulta(Quadro *q, const Consulta *c);
+void quadro_filtro(Quadro *q, const FiltroConsultas *f);
+void quadro_ler_animal(Quadro *q, Animal *a);
+void quadro_ler_vet(Quadro *q, Veterinario *v);
+void quadro_ler_consulta(Quadro *q, Consulta *c);
+void quadro_ler_filtro(Quadro *q, FiltroConsultas *f);
+
+// 1 = ok; 0 = falhou (a conexao deve ser fechada)
+int quadro_enviar(int fd, Quadro *q);
+// 1 = quadro lido; 0 = a outra ponta fechou; -1 = erro ou quadro grande demais
+int quadro_receber(int fd, Quadro *q);
+
+#endif
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "clinica.h"
+
+// Arquivos de dados (.bin): os dos formatos antigos ([qtd][registros] e
+// [-1][qtd][registros]) sao convertidos na partida, e um bloco de registros
+// alterado fora do programa e recusado pelo CRC, com e sem mmap.
+// Roda numa pasta vazia (make test).
+
+#define ARQ_ANIMAIS "animais.bin"
+#define ARQ_VETS "veterinarios.bin"
+#define ARQ_CONS "consultas.bin"
+
+static int g_falhas = 0;
+
+static void conferir(int ok, const char *o_que)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "FALHOU: %s\n", o_que);
+        g_falhas++;
+    }
+}
+
+static int abrir(int semMmap)
+{
+    OpcoesClinica opcoes = {1, semMmap, 0, NULL, 0};
+    return clinica_abrir(&opcoes);
+}
+
+// Formato antigo: marca -1 opcional, quantidade e os registros como na memoria
+static int gravar_legado(const char *path, int marca, const void *regs, int qtd, size_t tam)
+{
+    FILE *f = fopen(path, "wb");
+    int v1 = -1;
+    int ok = f && (!marca || fwrite(&v1, sizeof(int), 1, f) == 1) && fwrite(&qtd, sizeof(int), 1, f) == 1 &&
+             fwrite(regs, tam, (size_t)qtd, f) == (size_t)qtd;
+    if (f && fclose(f) != 0)
+        ok = 0;
+    return ok;
+}
+
+static int formato_atual(const char *path)
+{
+    char magico[4] = {0};
+    FILE *f = fopen(path, "rb");
+    int ok = f && fread(magico, 1, 4, f) == 4 && memcmp(magico, "CLIN", 4) == 0;
+    if (f)
+        fclose(f);
+    return ok;
+}
+
+// Le e regrava um byte do arquivo; devolve o valor antigo (-1 = erro)
+static int trocar_byte(const char *path, long pos, int valor)
+{
+    FILE *f = fopen(path, "r+b");
+    int antigo = -1;
+    if (f && fseek(f, pos, SEEK_SET) == 0 && (antigo = fgetc(f)) != EOF && fseek(f, pos, SEEK_SET) == 0)
+        fputc(valor, f);
+    if (f && fclose(f) != 0)
+        antigo = -1;
+    return antigo;
+}
+
+// Inicio dos registros: u32 little-endian no byte 28 do cabecalho
+static long inicio_registros(const char *path)
+{
+    unsigned char cab[32];
+    FILE *f = fopen(path, "rb");
+    int ok = f && fread(cab, 1, sizeof(cab), f) == sizeof(cab);
+    if (f)
+        fclose(f);
+    return ok ? (long)(cab[28] | cab[29] << 8 | cab[30] << 16 | (unsigned long)cab[31] << 24) : -1;
+}
+
+static void conferir_dados(const char *quando)
+{
+    int nA, nV, nC;
+    clinica_totais(&nA, &nV, &nC);
+    conferir(nA == 2 && nV == 1 && nC == 2, quando);
+    Animal a;
+    Consulta c;
+    conferir(clinica_buscar_animal(2, &a) == CLINICA_OK && strcmp(a.nome, "Mimi") == 0 && a.peso == 3.25, quando);
+    conferir(clinica_buscar_vet(1000, NULL) == CLINICA_OK, quando);
+    conferir(clinica_buscar_consulta(7, &c) == CLINICA_OK && c.idAnimal == 2 && c.valor == 80, quando);
+}
+
+static void legado(void)
+{
+    Animal an[2];
+    memset(an, 0, sizeof(an));
+    an[0].idAnimal = 1;
+    strcpy(an[0].nome, "Rex");
+    strcpy(an[0].especie, "Cachorro");
+    strcpy(an[0].dataNascimento, "10/05/2018");
+    an[0].peso = 12.5;
+    an[1].idAnimal = 2;
+    strcpy(an[1].nome, "Mimi");
+    strcpy(an[1].especie, "Gato");
+    strcpy(an[1].dataNascimento, "01/02/2021");
+    an[1].peso = 3.25;
+    Veterinario v;
+    memset(&v, 0, sizeof(v));
+    v.crmVet = 1000;
+    strcpy(v.nome, "Dr. Silva");
+    strcpy(v.telefone, "34-1111-1111");
+    Consulta co[2];
+    memset(co, 0, sizeof(co));
+    co[0].idConsulta = 3;
+    co[0].idAnimal = 1;
+    co[0].crmVet = 1000;
+    strcpy(co[0].dataConsulta, "15/03/2024");
+    co[0].valor = 150;
+    co[1].idConsulta = 7;
+    co[1].idAnimal = 2;
+    co[1].crmVet = 1000;
+    strcpy(co[1].dataConsulta, "20/03/2024");
+    co[1].valor = 80;
+
+    conferir(gravar_legado(ARQ_ANIMAIS, 0, an, 2, sizeof(Animal)), "gravar animais [qtd]");
+    conferir(gravar_legado(ARQ_VETS, 1, &v, 1, sizeof(Veterinario)), "gravar veterinarios [-1][qtd]");
+    conferir(gravar_legado(ARQ_CONS, 1, co, 2, sizeof(Consulta)), "gravar consultas [-1][qtd]");
+
+    conferir(abrir(1) == CLINICA_OK, "abrir arquivos antigos");
+    conferir_dados("dados dos arquivos antigos");
+    conferir(formato_atual(ARQ_ANIMAIS) && formato_atual(ARQ_VETS) && formato_atual(ARQ_CONS),
+             "arquivos convertidos na partida");
+    // Os proximos ids seguem os maiores carregados
+    Consulta c = {0, 1, 1000, "01/04/2024", 50};
+    conferir(clinica_incluir_consulta(&c) == CLINICA_OK && c.idConsulta == 8, "proximo id depois da conversao");
+    conferir(clinica_excluir_consulta(8) == CLINICA_OK && clinica_checkpoint() == CLINICA_OK, "checkpoint");
+    clinica_fechar();
+
+    for (int semMmap = 0; semMmap <= 1; semMmap++)
+    {
+        conferir(abrir(semMmap) == CLINICA_OK, "reabrir convertidos");
+        conferir_dados("dados depois da conversao");
+        clinica_fechar();
+    }
+}
+
+static void bloco_corrompido(void)
+{
+    long ini = inicio_registros(ARQ_ANIMAIS);
+    conferir(ini >= 64, "cabecalho de animais.bin");
+    // Nome do primeiro animal ("Rex" -> "Fex")
+    long pos = ini + 4;
+    int antigo = trocar_byte(ARQ_ANIMAIS, pos, 'F');
+    conferir(antigo == 'R', "alterar um byte dos registros");
+    for (int semMmap = 0; semMmap <= 1; semMmap++)
+        conferir(abrir(semMmap) == CLINICA_ERRO_ARQUIVO, "bloco alterado e recusado");
+
+    // Com o byte de volta o arquivo vale de novo (e a sessao pode ser reaberta)
+    conferir(trocar_byte(ARQ_ANIMAIS, pos, antigo) == 'F', "desfazer a alteracao");
+    conferir(abrir(0) == CLINICA_OK, "abrir com o bloco restaurado");
+    conferir_dados("dados com o bloco restaurado");
+    clinica_fechar();
+
+    // Cabecalho alterado: tambem recusado
+    antigo = trocar_byte(ARQ_VETS, 16, 0x7F);
+    conferir(antigo >= 0 && abrir(0) == CLINICA_ERRO_ARQUIVO, "cabecalho alterado e recusado");
+    trocar_byte(ARQ_VETS, 16, antigo);
+}
+
+int main(void)
+{
+    clinica_definir_avisos(NULL);
+    legado();
+    bloco_corrompido();
+    if (g_falhas)
+        return 1;
+    printf("teste_arquivos: ok\n");
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "clinica.h"
+
+// Chaves que coincidem com as marcas internas do indice hash (INT_MIN marca a
+// posicao vazia e a lapide): com a tabela cheia, nenhuma operacao pode
+// encontrar um registro por elas. Sessao so em memoria.
+
+static int g_falhas = 0;
+
+static void conferir(int ok, const char *o_que)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "FALHOU: %s\n", o_que);
+        g_falhas++;
+    }
+}
+
+int main(void)
+{
+    OpcoesClinica opcoes = {1, 0, 1, NULL, 0};
+    clinica_definir_avisos(NULL);
+    if (clinica_abrir(&opcoes) != CLINICA_OK)
+    {
+        fprintf(stderr, "Nao foi possivel abrir a sessao.\n");
+        return 1;
+    }
+
+    Veterinario v = {1000, "Dr. Silva", "34-1111-1111"};
+    conferir(clinica_incluir_vet(&v) == CLINICA_OK, "incluir veterinario");
+    for (int i = 0; i < 3; i++)
+    {
+        Animal a;
+        memset(&a, 0, sizeof(a));
+        snprintf(a.nome, NOME_TAM, "Animal %d", i + 1);
+        strcpy(a.especie, "Gato");
+        strcpy(a.dataNascimento, "01/01/2020");
+        a.peso = 3.5;
+        conferir(clinica_incluir_animal(&a) == CLINICA_OK, "incluir animal");
+        Consulta c;
+        memset(&c, 0, sizeof(c));
+        c.idAnimal = a.idAnimal;
+        c.crmVet = 1000;
+        strcpy(c.dataConsulta, "01/01/2025");
+        c.valor = 100;
+        conferir(clinica_incluir_consulta(&c) == CLINICA_OK, "incluir consulta");
+    }
+
+    Animal a;
+    memset(&a, 0, sizeof(a));
+    a.idAnimal = INT_MIN;
+    conferir(clinica_buscar_animal(INT_MIN, NULL) == CLINICA_NAO_ENCONTRADO, "buscar animal INT_MIN");
+    conferir(clinica_alterar_animal(&a) == CLINICA_NAO_ENCONTRADO, "alterar animal INT_MIN");
+    conferir(clinica_excluir_animal(INT_MIN) == CLINICA_NAO_ENCONTRADO, "excluir animal INT_MIN");
+    conferir(clinica_buscar_vet(INT_MIN, NULL) == CLINICA_NAO_ENCONTRADO, "buscar veterinario INT_MIN");
+    conferir(clinica_excluir_vet(INT_MIN) == CLINICA_NAO_ENCONTRADO, "excluir veterinario INT_MIN");
+    conferir(clinica_buscar_consulta(INT_MIN, NULL) == CLINICA_NAO_ENCONTRADO, "buscar consulta INT_MIN");
+    conferir(clinica_excluir_consulta(INT_MIN) == CLINICA_NAO_ENCONTRADO, "excluir consulta INT_MIN");
+
+    // A exclusao de uma consulta deixa lapide (CHAVE_REMOVIDA): continua sem achar
+    conferir(clinica_excluir_consulta(1) == CLINICA_OK, "excluir consulta 1");
+    conferir(clinica_buscar_consulta(INT_MIN, NULL) == CLINICA_NAO_ENCONTRADO, "buscar INT_MIN com lapide");
+    conferir(clinica_excluir_consulta(INT_MIN) == CLINICA_NAO_ENCONTRADO, "excluir INT_MIN com lapide");
+
+    int nA, nV, nC;
+    clinica_totais(&nA, &nV, &nC);
+    conferir(nA == 3 && nV == 1 && nC == 2, "totais intactos");
+    for (int id = 1; id <= 3; id++)
+        conferir(clinica_buscar_animal(id, NULL) == CLINICA_OK, "animais intactos");
+
+    clinica_fechar();
+    if (g_falhas)
+        return 1;
+    printf("teste_chaves: ok\n");
+    return 0;
+}
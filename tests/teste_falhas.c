@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "clinica.h"
+
+// Falta de memoria no meio de uma alteracao (clinica_falhar_realocacao): a
+// operacao devolve erro e nada muda, ou da certo por inteiro. Depois de cada
+// tentativa, tabela, indices (por data, animal, especie) e agregados das
+// estatisticas contam as mesmas consultas. Sessao so em memoria.
+
+#define MAX_TENTATIVAS 400
+
+static int g_falhas = 0;
+
+static void conferir(int ok, const char *o_que)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "FALHOU: %s\n", o_que);
+        g_falhas++;
+    }
+}
+
+static const char *g_especies[] = {"Gato", "Cachorro", "Coelho", "Hamster", "Calopsita", "Jabuti"};
+#define N_ESPECIES (int)(sizeof(g_especies) / sizeof(g_especies[0]))
+#define N_ANIMAIS 5
+
+static int listar(const FiltroConsultas *fl)
+{
+    FILE *f = tmpfile();
+    int n = f ? clinica_listar_consultas(f, fl) : -1;
+    if (f)
+        fclose(f);
+    return n;
+}
+
+// "Total: N consultas" da estatistica
+static int total_estatistica(int tipo)
+{
+    FILE *f = tmpfile();
+    char linha[256];
+    int total = -1;
+    if (!f || clinica_estatisticas(f, tipo) < 0)
+    {
+        if (f)
+            fclose(f);
+        return -1;
+    }
+    rewind(f);
+    while (fgets(linha, sizeof(linha), f))
+        sscanf(linha, "Total: %d consultas", &total);
+    fclose(f);
+    return total;
+}
+
+static void conferir_consistencia(const char *depois)
+{
+    int nC;
+    clinica_totais(NULL, NULL, &nC);
+    FiltroConsultas fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.tipo = CLINICA_TODAS;
+    int todas = listar(&fl);
+    fl.tipo = CLINICA_A_PARTIR_DE;
+    fl.data = "01/01/0001";
+    int porData = listar(&fl);
+    int porAnimal = 0, porEspecie = 0;
+    fl.tipo = CLINICA_POR_ANIMAL;
+    for (int id = 1; id <= N_ANIMAIS; id++)
+    {
+        fl.chave = id;
+        porAnimal += listar(&fl);
+    }
+    fl.tipo = CLINICA_POR_ESPECIE;
+    for (int e = 0; e < N_ESPECIES; e++)
+    {
+        fl.especie = g_especies[e];
+        porEspecie += listar(&fl);
+    }
+    int ok = todas == nC && porData == nC && porAnimal == nC && porEspecie == nC &&
+             total_estatistica(CLINICA_EST_VET) == nC && total_estatistica(CLINICA_EST_ESPECIE) == nC &&
+             total_estatistica(CLINICA_EST_MES) == nC;
+    if (!ok)
+        fprintf(stderr, "%s: total %d, listagem %d, por data %d, por animal %d, por especie %d\n", depois, nC, todas,
+                porData, porAnimal, porEspecie);
+    conferir(ok, depois);
+}
+
+// Cada tentativa falha numa realocacao mais adiante, ate uma dar certo
+static void incluir_com_falhas(int idAnimal, int crm, const char *data)
+{
+    for (int k = 1; k <= MAX_TENTATIVAS; k++)
+    {
+        int nAntes, nDepois;
+        clinica_totais(NULL, NULL, &nAntes);
+        Consulta c = {0, idAnimal, crm, "", 100};
+        strcpy(c.dataConsulta, data);
+        clinica_falhar_realocacao(k);
+        int r = clinica_incluir_consulta(&c);
+        clinica_falhar_realocacao(0);
+        clinica_totais(NULL, NULL, &nDepois);
+        conferir_consistencia("incluir consulta");
+        if (r == CLINICA_OK)
+        {
+            conferir(nDepois == nAntes + 1, "inclusao conta uma consulta");
+            conferir(clinica_buscar_consulta(c.idConsulta, NULL) == CLINICA_OK, "consulta incluida existe");
+            return;
+        }
+        conferir(r == CLINICA_ERRO_MEMORIA && nDepois == nAntes, "inclusao que falhou nao deixa nada");
+    }
+    conferir(0, "inclusao nunca deu certo");
+}
+
+static void trocar_especie_com_falhas(int id, const char *especie)
+{
+    for (int k = 1; k <= MAX_TENTATIVAS; k++)
+    {
+        Animal antes, depois;
+        clinica_buscar_animal(id, &antes);
+        Animal novo = antes;
+        strcpy(novo.especie, especie);
+        clinica_falhar_realocacao(k);
+        int r = clinica_alterar_animal(&novo);
+        clinica_falhar_realocacao(0);
+        clinica_buscar_animal(id, &depois);
+        conferir_consistencia("trocar especie");
+        // As consultas do animal estao todas na especie que ficou gravada nele
+        FiltroConsultas fl;
+        memset(&fl, 0, sizeof(fl));
+        fl.tipo = CLINICA_POR_ANIMAL;
+        fl.chave = id;
+        int doAnimal = listar(&fl);
+        fl.tipo = CLINICA_POR_ESPECIE;
+        fl.especie = depois.especie;
+        conferir(listar(&fl) >= doAnimal, "consultas na especie do animal");
+        if (r == CLINICA_OK)
+        {
+            conferir(strcmp(depois.especie, especie) == 0, "especie trocada");
+            return;
+        }
+        conferir(r == CLINICA_ERRO_MEMORIA && strcmp(depois.especie, antes.especie) == 0,
+                 "troca que falhou mantem a especie");
+    }
+    conferir(0, "troca de especie nunca deu certo");
+}
+
+int main(void)
+{
+    OpcoesClinica opcoes = {1, 0, 1, NULL, 0};
+    clinica_definir_avisos(NULL);
+    if (clinica_abrir(&opcoes) != CLINICA_OK)
+    {
+        fprintf(stderr, "Nao foi possivel abrir a sessao.\n");
+        return 1;
+    }
+
+    for (int crm = 1000; crm < 1003; crm++)
+    {
+        Veterinario v = {crm, "Dr. Teste", "34-0000-0000"};
+        conferir(clinica_incluir_vet(&v) == CLINICA_OK, "incluir veterinario");
+    }
+    for (int i = 0; i < N_ANIMAIS; i++)
+    {
+        Animal a;
+        memset(&a, 0, sizeof(a));
+        snprintf(a.nome, NOME_TAM, "Animal %d", i + 1);
+        strcpy(a.especie, g_especies[i % 2]);
+        strcpy(a.dataNascimento, "01/01/2020");
+        a.peso = 5;
+        conferir(clinica_incluir_animal(&a) == CLINICA_OK, "incluir animal");
+    }
+
+    // Meses, anos e CRMs variados: cada inclusao pode precisar de listas e
+    // agregados novos, alem de crescer a tabela e os indices
+    char data[DATA_TAM];
+    for (int i = 0; i < 60; i++)
+    {
+        snprintf(data, sizeof(data), "%02d/%02d/%d", i % 28 + 1, i % 12 + 1, 2015 + i % 7);
+        incluir_com_falhas(i % 3 == 0 ? 1 : i % N_ANIMAIS + 1, 1000 + i % 3, data);
+    }
+
+    // O animal 1 tem a maior parte das consultas; especies novas e ja usadas
+    for (int e = 1; e < N_ESPECIES; e++)
+        trocar_especie_com_falhas(1, g_especies[e]);
+    trocar_especie_com_falhas(1, g_especies[0]);
+
+    clinica_fechar();
+    if (g_falhas)
+        return 1;
+    printf("teste_falhas: ok\n");
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clinica.h"
+
+// Importacao CSV: linhas rejeitadas vao para <arquivo>.erros com o numero
+// certo, e uma linha maior que o bloco de leitura (4 MB) e rejeitada inteira,
+// sem que o resto dela vire um registro. Roda numa pasta vazia (make test).
+
+#define BLOCO_CSV (4 * 1024 * 1024)
+
+static int g_falhas = 0;
+
+static void conferir(int ok, const char *o_que)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "FALHOU: %s\n", o_que);
+        g_falhas++;
+    }
+}
+
+// Linha "id,AAAA...,<resto>" com 'tam' letras no nome
+static void linha_longa(FILE *f, const char *id, size_t tam, const char *resto)
+{
+    fputs(id, f);
+    fputc(',', f);
+    for (size_t i = 0; i < tam; i++)
+        fputc('A', f);
+    fprintf(f, ",%s\n", resto);
+}
+
+// Procura "linha N: motivo" no arquivo de erros
+static int rejeitada(const char *erros, int linha, const char *motivo)
+{
+    char esperado[128], buf[256];
+    snprintf(esperado, sizeof(esperado), "linha %d: %s", linha, motivo);
+    FILE *f = fopen(erros, "r");
+    int achou = 0;
+    while (f && !achou && fgets(buf, sizeof(buf), f))
+    {
+        achou = strncmp(buf, esperado, strlen(esperado)) == 0;
+        // Linhas longas nao cabem no buffer: pula o resto delas
+        while (strchr(buf, '\n') == NULL && fgets(buf, sizeof(buf), f))
+            ;
+    }
+    if (f)
+        fclose(f);
+    return achou;
+}
+
+static int existe_animal(const char *nome)
+{
+    Animal a;
+    for (int id = 1; id <= 10; id++)
+        if (clinica_buscar_animal(id, &a) == CLINICA_OK && strcmp(a.nome, nome) == 0)
+            return 1;
+    return 0;
+}
+
+int main(void)
+{
+    OpcoesClinica opcoes = {1, 0, 1, NULL, 0};
+    clinica_definir_avisos(NULL);
+    if (clinica_abrir(&opcoes) != CLINICA_OK)
+    {
+        fprintf(stderr, "Nao foi possivel abrir a sessao.\n");
+        return 1;
+    }
+
+    FILE *f = fopen("animais.csv", "w");
+    if (!f)
+    {
+        fprintf(stderr, "Nao foi possivel criar animais.csv.\n");
+        return 1;
+    }
+    fputs("id,nome,especie,nascimento,peso\n", f); // 1: cabecalho
+    fputs(",Bob,Gato,01/01/2020,3\n", f);
+    linha_longa(f, "", 2000, "Gato,01/01/2020,3"); // 3: longa, mas dentro do bloco
+    fputs(",Tom,Gato,32/13/2020,3\n", f);
+    // 5: maior que o bloco, cortada bem antes de ",Fantasma,...", que sozinho seria um animal valido
+    linha_longa(f, "", BLOCO_CSV - 1, "Fantasma,Gato,01/01/2020,3");
+    fputs(",Rex,Cachorro,01/01/2019,5\n", f);
+    fputs(",Lua,Gato\n", f);
+    linha_longa(f, "", 2 * BLOCO_CSV + 10, "Outro,Gato,01/01/2020,3"); // 8: mais de dois blocos
+    fputs(",Nina,Gato,05/05/2022,2.5", f); // 9: sem quebra de linha no fim
+    fclose(f);
+
+    conferir(clinica_importar("animais", "animais.csv") == CLINICA_INVALIDO, "importacao com rejeitadas");
+    int nA;
+    clinica_totais(&nA, NULL, NULL);
+    conferir(nA == 3, "tres linhas aceitas");
+    conferir(existe_animal("Bob") && existe_animal("Rex") && existe_animal("Nina"), "linhas boas importadas");
+    conferir(!existe_animal("Fantasma") && !existe_animal("Outro"), "resto da linha longa nao vira registro");
+
+    const char *erros = "animais.csv.erros";
+    conferir(rejeitada(erros, 3, "linha muito longa"), "linha 3 rejeitada");
+    conferir(rejeitada(erros, 4, "data invalida"), "linha 4 rejeitada");
+    conferir(rejeitada(erros, 5, "linha muito longa"), "linha 5 rejeitada");
+    conferir(rejeitada(erros, 7, "quantidade de campos errada"), "linha 7 rejeitada");
+    conferir(rejeitada(erros, 8, "linha muito longa"), "linha 8 rejeitada");
+    conferir(!rejeitada(erros, 6, "") && !rejeitada(erros, 9, ""), "linhas boas fora dos erros");
+
+    clinica_fechar();
+    if (g_falhas)
+        return 1;
+    printf("teste_importacao: ok\n");
+    return 0;
+}
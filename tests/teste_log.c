@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clinica.h"
+
+// Log (clinica.wal) depois de uma queda: registro cortado no meio, lixo no
+// fim e arquivo criado sem o cabecalho completo. A sessao reabre com tudo o
+// que foi gravado inteiro, e o que vem depois continua do ponto certo.
+// Roda numa pasta vazia (make test).
+
+#define ARQ_WAL "clinica.wal"
+
+static int g_falhas = 0;
+
+static void conferir(int ok, const char *o_que)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "FALHOU: %s\n", o_que);
+        g_falhas++;
+    }
+}
+
+static int abrir(void)
+{
+    OpcoesClinica opcoes = {1, 0, 0, NULL, 0};
+    return clinica_abrir(&opcoes);
+}
+
+static int animais(void)
+{
+    int n;
+    clinica_totais(&n, NULL, NULL);
+    return n;
+}
+
+static int incluir_animal(const char *nome)
+{
+    Animal a;
+    memset(&a, 0, sizeof(a));
+    snprintf(a.nome, NOME_TAM, "%s", nome);
+    strcpy(a.especie, "Gato");
+    strcpy(a.dataNascimento, "01/01/2020");
+    a.peso = 4;
+    return clinica_incluir_animal(&a) == CLINICA_OK ? a.idAnimal : -1;
+}
+
+static long tamanho(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return -1;
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fclose(f);
+    return n;
+}
+
+// Regrava o arquivo com os primeiros 'n' bytes (queda no meio da escrita)
+static int cortar(const char *path, long n)
+{
+    FILE *f = fopen(path, "rb");
+    char *buf = (char *)malloc(n > 0 ? (size_t)n : 1);
+    int ok = f && buf && fread(buf, 1, (size_t)n, f) == (size_t)n;
+    if (f)
+        fclose(f);
+    f = ok ? fopen(path, "wb") : NULL;
+    ok = f && fwrite(buf, 1, (size_t)n, f) == (size_t)n;
+    if (f && fclose(f) != 0)
+        ok = 0;
+    free(buf);
+    return ok;
+}
+
+static int acrescentar(const char *path, const void *p, size_t n)
+{
+    FILE *f = fopen(path, "ab");
+    int ok = f && fwrite(p, 1, n, f) == n;
+    if (f && fclose(f) != 0)
+        ok = 0;
+    return ok;
+}
+
+// Cinco animais confirmados no log, sem checkpoint
+static void cauda_cortada(void)
+{
+    conferir(abrir() == CLINICA_OK, "abrir sessao nova");
+    char nome[NOME_TAM];
+    for (int i = 1; i <= 5; i++)
+    {
+        snprintf(nome, sizeof(nome), "Animal %d", i);
+        conferir(incluir_animal(nome) == i, "incluir animal");
+    }
+    conferir(clinica_sincronizar() == CLINICA_OK, "sincronizar log");
+    clinica_fechar();
+
+    // O ultimo registro perde os 7 bytes finais
+    conferir(cortar(ARQ_WAL, tamanho(ARQ_WAL) - 7), "cortar o log");
+    conferir(abrir() == CLINICA_OK, "reabrir com a cauda cortada");
+    conferir(animais() == 4, "so os registros inteiros voltam");
+    Animal a;
+    conferir(clinica_buscar_animal(4, &a) == CLINICA_OK && strcmp(a.nome, "Animal 4") == 0, "animal 4 intacto");
+    conferir(clinica_buscar_animal(5, NULL) == CLINICA_NAO_ENCONTRADO, "animal 5 perdido");
+    // O pedaco cortado foi descartado: o novo registro entra logo depois do ultimo inteiro
+    conferir(incluir_animal("Depois da queda") == 5, "incluir depois da queda");
+    conferir(clinica_sincronizar() == CLINICA_OK, "sincronizar depois da queda");
+    clinica_fechar();
+
+    conferir(abrir() == CLINICA_OK, "reabrir depois da queda");
+    conferir(animais() == 5, "o registro novo foi reaplicado");
+    conferir(clinica_buscar_animal(5, &a) == CLINICA_OK && strcmp(a.nome, "Depois da queda") == 0,
+             "animal novo intacto");
+    clinica_fechar();
+
+    // Lixo depois do ultimo registro (escrita que nao chegou a formar um registro)
+    unsigned char lixo[13];
+    memset(lixo, 0xAB, sizeof(lixo));
+    long antes = tamanho(ARQ_WAL);
+    conferir(acrescentar(ARQ_WAL, lixo, sizeof(lixo)), "acrescentar lixo");
+    conferir(abrir() == CLINICA_OK, "reabrir com lixo no fim");
+    conferir(animais() == 5, "o lixo e ignorado");
+    clinica_fechar();
+    conferir(tamanho(ARQ_WAL) == antes, "lixo cortado do arquivo");
+}
+
+// Queda entre criar o log e gravar o cabecalho de 8 bytes
+static void cabecalho_incompleto(long bytes)
+{
+    remove(ARQ_WAL);
+    unsigned char meio[8] = {0};
+    conferir(acrescentar(ARQ_WAL, meio, (size_t)bytes), "criar log incompleto");
+    conferir(abrir() == CLINICA_OK, "abrir com o cabecalho incompleto");
+    conferir(animais() == 0, "log incompleto vale como vazio");
+    conferir(incluir_animal("Primeiro") == 1, "incluir no log refeito");
+    conferir(clinica_sincronizar() == CLINICA_OK, "sincronizar no log refeito");
+    clinica_fechar();
+    conferir(abrir() == CLINICA_OK, "reabrir o log refeito");
+    conferir(animais() == 1, "registro do log refeito reaplicado");
+    clinica_fechar();
+}
+
+int main(void)
+{
+    clinica_definir_avisos(NULL);
+    cauda_cortada();
+    cabecalho_incompleto(0);
+    cabecalho_incompleto(3);
+
+    // Cabecalho inteiro, mas de outro arquivo: erro, e nada e apagado
+    remove(ARQ_WAL);
+    conferir(acrescentar(ARQ_WAL, "nao e log", 9), "criar log estranho");
+    conferir(abrir() == CLINICA_ERRO_ARQUIVO, "log de outro formato e recusado");
+    conferir(tamanho(ARQ_WAL) == 9, "log de outro formato fica como estava");
+
+    if (g_falhas)
+        return 1;
+    printf("teste_log: ok\n");
+    return 0;
+}